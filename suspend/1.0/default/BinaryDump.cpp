@@ -0,0 +1,374 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BinaryDump.h"
+
+#include <unordered_map>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+enum : uint64_t {
+    SECTION_STRINGS = 1,
+    SECTION_WAKE_LOCKS = 2,
+    SECTION_WAKEUPS = 3,
+    SECTION_KERNEL_SUSPEND_STATS = 4,
+    SECTION_SUSPEND_INFO = 5,
+};
+
+enum : uint64_t {
+    WAKE_LOCK_KERNEL = 1 << 0,
+    WAKE_LOCK_ACTIVE = 1 << 1,
+};
+
+static constexpr int64_t DumpedWakeLock::*kWakeLockStats[] = {
+    &DumpedWakeLock::activeCount,
+    &DumpedWakeLock::lastChange,
+    &DumpedWakeLock::maxTime,
+    &DumpedWakeLock::totalTime,
+    &DumpedWakeLock::activeTime,
+    &DumpedWakeLock::eventCount,
+    &DumpedWakeLock::expireCount,
+    &DumpedWakeLock::preventSuspendTime,
+    &DumpedWakeLock::wakeupCount,
+};
+
+static void putVarint(uint64_t value, std::string* out) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+static void putSigned(int64_t value, std::string* out) {
+    putVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63), out);
+}
+
+// Differences wrap around rather than overflow.
+static void putDelta(int64_t value, int64_t previous, std::string* out) {
+    putSigned(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous)),
+              out);
+}
+
+static void putSection(uint64_t tag, const std::string& payload, std::string* out) {
+    putVarint(tag, out);
+    putVarint(payload.size(), out);
+    out->append(payload);
+}
+
+namespace {
+
+// Strings of a dump, each stored once. Views into the dump encoded, which outlives the table.
+class StringTable {
+   public:
+    uint64_t intern(std::string_view string) {
+        auto [it, inserted] = mIndex.emplace(string, mStrings.size());
+        if (inserted) {
+            mStrings.push_back(string);
+        }
+        return it->second;
+    }
+
+    void encode(std::string* out) const {
+        putVarint(mStrings.size(), out);
+        for (std::string_view string : mStrings) {
+            putVarint(string.size(), out);
+            out->append(string);
+        }
+    }
+
+   private:
+    std::unordered_map<std::string_view, uint64_t> mIndex;
+    std::vector<std::string_view> mStrings;
+};
+
+class Reader {
+   public:
+    explicit Reader(std::string_view data) : mData(data) {}
+
+    bool empty() const { return mData.empty(); }
+
+    bool getVarint(uint64_t* value) {
+        uint64_t result = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (mData.empty()) {
+                return false;
+            }
+            uint8_t byte = mData.front();
+            mData.remove_prefix(1);
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                *value = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool getSigned(int64_t* value) {
+        uint64_t zigzag;
+        if (!getVarint(&zigzag)) {
+            return false;
+        }
+        *value = static_cast<int64_t>((zigzag >> 1) ^ -(zigzag & 1));
+        return true;
+    }
+
+    bool getDelta(int64_t previous, int64_t* value) {
+        int64_t delta;
+        if (!getSigned(&delta)) {
+            return false;
+        }
+        *value =
+            static_cast<int64_t>(static_cast<uint64_t>(previous) + static_cast<uint64_t>(delta));
+        return true;
+    }
+
+    bool getBytes(std::string_view* bytes) {
+        uint64_t size;
+        if (!getVarint(&size) || size > mData.size()) {
+            return false;
+        }
+        *bytes = mData.substr(0, size);
+        mData.remove_prefix(size);
+        return true;
+    }
+
+    bool getString(const std::vector<std::string>& strings, std::string* string) {
+        uint64_t index;
+        if (!getVarint(&index) || index >= strings.size()) {
+            return false;
+        }
+        *string = strings[index];
+        return true;
+    }
+
+    // Reads the number of items that follow. Each takes at least a byte, so that corrupt counts
+    // don't make callers reserve memory for them.
+    bool getCount(size_t* count) {
+        uint64_t value;
+        if (!getVarint(&value) || value > mData.size()) {
+            return false;
+        }
+        *count = value;
+        return true;
+    }
+
+   private:
+    std::string_view mData;
+};
+
+}  // namespace
+
+static void encodeStats(const std::vector<DumpedStat>& stats, StringTable* strings,
+                        std::string* out) {
+    putVarint(stats.size(), out);
+    for (const DumpedStat& stat : stats) {
+        putVarint(strings->intern(stat.name), out);
+        putVarint(stat.isString, out);
+        if (stat.isString) {
+            putVarint(strings->intern(stat.stringValue), out);
+        } else {
+            putSigned(stat.value, out);
+        }
+    }
+}
+
+std::string encodeBinaryDump(const BinaryDump& dump) {
+    StringTable strings;
+
+    std::string wakeLocks;
+    putVarint(dump.wakeLocks.size(), &wakeLocks);
+    const DumpedWakeLock noWakeLock;
+    const DumpedWakeLock* previousWakeLock = &noWakeLock;
+    for (const DumpedWakeLock& wakeLock : dump.wakeLocks) {
+        putVarint(strings.intern(wakeLock.name), &wakeLocks);
+        putVarint((wakeLock.isKernelWakelock ? WAKE_LOCK_KERNEL : uint64_t{0}) |
+                      (wakeLock.isActive ? WAKE_LOCK_ACTIVE : uint64_t{0}),
+                  &wakeLocks);
+        putDelta(wakeLock.pid, previousWakeLock->pid, &wakeLocks);
+        for (int64_t DumpedWakeLock::*stat : kWakeLockStats) {
+            putDelta(wakeLock.*stat, previousWakeLock->*stat, &wakeLocks);
+        }
+        previousWakeLock = &wakeLock;
+    }
+
+    std::string wakeups;
+    putVarint(dump.wakeups.size(), &wakeups);
+    int64_t previousCount = 0;
+    for (const DumpedWakeup& wakeup : dump.wakeups) {
+        putVarint(strings.intern(wakeup.name), &wakeups);
+        putDelta(wakeup.count, previousCount, &wakeups);
+        previousCount = wakeup.count;
+    }
+
+    std::string kernelSuspendStats;
+    encodeStats(dump.kernelSuspendStats, &strings, &kernelSuspendStats);
+    std::string suspendInfo;
+    encodeStats(dump.suspendInfo, &strings, &suspendInfo);
+
+    std::string stringTable;
+    strings.encode(&stringTable);
+
+    std::string out(kBinaryDumpMagic);
+    putVarint(kBinaryDumpVersion, &out);
+    // Strings go first, so that decoders can resolve them as they read the other sections.
+    putSection(SECTION_STRINGS, stringTable, &out);
+    putSection(SECTION_WAKE_LOCKS, wakeLocks, &out);
+    putSection(SECTION_WAKEUPS, wakeups, &out);
+    putSection(SECTION_KERNEL_SUSPEND_STATS, kernelSuspendStats, &out);
+    putSection(SECTION_SUSPEND_INFO, suspendInfo, &out);
+    return out;
+}
+
+static bool decodeStrings(Reader* reader, std::vector<std::string>* strings) {
+    size_t count;
+    if (!reader->getCount(&count)) {
+        return false;
+    }
+    strings->reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        std::string_view string;
+        if (!reader->getBytes(&string)) {
+            return false;
+        }
+        strings->emplace_back(string);
+    }
+    return true;
+}
+
+static bool decodeWakeLocks(Reader* reader, const std::vector<std::string>& strings,
+                            std::vector<DumpedWakeLock>* wakeLocks) {
+    size_t count;
+    if (!reader->getCount(&count)) {
+        return false;
+    }
+    wakeLocks->resize(count);
+    const DumpedWakeLock noWakeLock;
+    const DumpedWakeLock* previous = &noWakeLock;
+    for (DumpedWakeLock& wakeLock : *wakeLocks) {
+        uint64_t flags;
+        int64_t pid;
+        if (!reader->getString(strings, &wakeLock.name) || !reader->getVarint(&flags) ||
+            !reader->getDelta(previous->pid, &pid)) {
+            return false;
+        }
+        wakeLock.isKernelWakelock = flags & WAKE_LOCK_KERNEL;
+        wakeLock.isActive = flags & WAKE_LOCK_ACTIVE;
+        wakeLock.pid = static_cast<int32_t>(pid);
+        for (int64_t DumpedWakeLock::*stat : kWakeLockStats) {
+            if (!reader->getDelta(previous->*stat, &(wakeLock.*stat))) {
+                return false;
+            }
+        }
+        previous = &wakeLock;
+    }
+    return true;
+}
+
+static bool decodeWakeups(Reader* reader, const std::vector<std::string>& strings,
+                          std::vector<DumpedWakeup>* wakeups) {
+    size_t count;
+    if (!reader->getCount(&count)) {
+        return false;
+    }
+    wakeups->resize(count);
+    int64_t previousCount = 0;
+    for (DumpedWakeup& wakeup : *wakeups) {
+        if (!reader->getString(strings, &wakeup.name) ||
+            !reader->getDelta(previousCount, &wakeup.count)) {
+            return false;
+        }
+        previousCount = wakeup.count;
+    }
+    return true;
+}
+
+static bool decodeStats(Reader* reader, const std::vector<std::string>& strings,
+                        std::vector<DumpedStat>* stats) {
+    size_t count;
+    if (!reader->getCount(&count)) {
+        return false;
+    }
+    stats->resize(count);
+    for (DumpedStat& stat : *stats) {
+        uint64_t isString;
+        if (!reader->getString(strings, &stat.name) || !reader->getVarint(&isString)) {
+            return false;
+        }
+        stat.isString = isString;
+        if (stat.isString ? !reader->getString(strings, &stat.stringValue)
+                          : !reader->getSigned(&stat.value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decodeBinaryDump(std::string_view data, BinaryDump* dump) {
+    *dump = {};
+    if (data.substr(0, kBinaryDumpMagic.size()) != kBinaryDumpMagic) {
+        return false;
+    }
+    Reader reader(data.substr(kBinaryDumpMagic.size()));
+    uint64_t version;
+    if (!reader.getVarint(&version) || version != kBinaryDumpVersion) {
+        return false;
+    }
+
+    std::vector<std::string> strings;
+    while (!reader.empty()) {
+        uint64_t tag;
+        std::string_view payload;
+        if (!reader.getVarint(&tag) || !reader.getBytes(&payload)) {
+            return false;
+        }
+        Reader section(payload);
+        bool ok = true;
+        switch (tag) {
+            case SECTION_STRINGS:
+                ok = decodeStrings(&section, &strings);
+                break;
+            case SECTION_WAKE_LOCKS:
+                ok = decodeWakeLocks(&section, strings, &dump->wakeLocks);
+                break;
+            case SECTION_WAKEUPS:
+                ok = decodeWakeups(&section, strings, &dump->wakeups);
+                break;
+            case SECTION_KERNEL_SUSPEND_STATS:
+                ok = decodeStats(&section, strings, &dump->kernelSuspendStats);
+                break;
+            case SECTION_SUSPEND_INFO:
+                ok = decodeStats(&section, strings, &dump->suspendInfo);
+                break;
+            default:
+                // Added by a later version of the format.
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
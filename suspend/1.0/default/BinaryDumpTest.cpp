@@ -0,0 +1,139 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "BinaryDump.h"
+
+using android::system::suspend::V1_0::BinaryDump;
+using android::system::suspend::V1_0::decodeBinaryDump;
+using android::system::suspend::V1_0::DumpedStat;
+using android::system::suspend::V1_0::DumpedWakeLock;
+using android::system::suspend::V1_0::encodeBinaryDump;
+
+static BinaryDump makeBinaryDump() {
+    BinaryDump dump;
+    for (int i = 0; i < 10; i++) {
+        DumpedWakeLock& wakeLock = dump.wakeLocks.emplace_back();
+        wakeLock.name = "wakeLock" + std::to_string(i % 3);
+        wakeLock.isKernelWakelock = i % 2;
+        wakeLock.isActive = i % 3 == 0;
+        wakeLock.pid = i % 2 ? -1 : 1000 + i;
+        wakeLock.activeCount = i;
+        wakeLock.lastChange = 1000000 - i;
+        wakeLock.maxTime = i % 2 ? INT64_MAX : INT64_MIN;
+        wakeLock.totalTime = i * i;
+        wakeLock.activeTime = -i;
+        wakeLock.eventCount = i + 1;
+        wakeLock.expireCount = i + 2;
+        wakeLock.preventSuspendTime = i + 3;
+        wakeLock.wakeupCount = i + 4;
+    }
+    dump.wakeups.push_back({"wakeLock0", 5});
+    dump.wakeups.push_back({"Abort: reason", 1});
+    dump.kernelSuspendStats.push_back({"success", false, 42, ""});
+    dump.kernelSuspendStats.push_back({"last_failed_dev", true, 0, "dev"});
+    dump.suspendInfo.push_back({"suspend_attempts", false, -7, ""});
+    return dump;
+}
+
+static void assertSameStats(const std::vector<DumpedStat>& a, const std::vector<DumpedStat>& b) {
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        ASSERT_EQ(a[i].name, b[i].name);
+        ASSERT_EQ(a[i].isString, b[i].isString);
+        ASSERT_EQ(a[i].value, b[i].value);
+        ASSERT_EQ(a[i].stringValue, b[i].stringValue);
+    }
+}
+
+static void assertSameDump(const BinaryDump& a, const BinaryDump& b) {
+    ASSERT_EQ(a.wakeLocks.size(), b.wakeLocks.size());
+    for (size_t i = 0; i < a.wakeLocks.size(); i++) {
+        const DumpedWakeLock& x = a.wakeLocks[i];
+        const DumpedWakeLock& y = b.wakeLocks[i];
+        ASSERT_EQ(std::tie(x.name, x.isKernelWakelock, x.isActive, x.pid, x.activeCount,
+                           x.lastChange, x.maxTime, x.totalTime, x.activeTime, x.eventCount,
+                           x.expireCount, x.preventSuspendTime, x.wakeupCount),
+                  std::tie(y.name, y.isKernelWakelock, y.isActive, y.pid, y.activeCount,
+                           y.lastChange, y.maxTime, y.totalTime, y.activeTime, y.eventCount,
+                           y.expireCount, y.preventSuspendTime, y.wakeupCount));
+    }
+    ASSERT_EQ(a.wakeups.size(), b.wakeups.size());
+    for (size_t i = 0; i < a.wakeups.size(); i++) {
+        ASSERT_EQ(a.wakeups[i].name, b.wakeups[i].name);
+        ASSERT_EQ(a.wakeups[i].count, b.wakeups[i].count);
+    }
+    assertSameStats(a.kernelSuspendStats, b.kernelSuspendStats);
+    assertSameStats(a.suspendInfo, b.suspendInfo);
+}
+
+TEST(BinaryDumpTest, TestRoundTrip) {
+    const BinaryDump expected = makeBinaryDump();
+    BinaryDump actual;
+    ASSERT_TRUE(decodeBinaryDump(encodeBinaryDump(expected), &actual));
+    assertSameDump(actual, expected);
+
+    ASSERT_TRUE(decodeBinaryDump(encodeBinaryDump(BinaryDump()), &actual));
+    assertSameDump(actual, BinaryDump());
+}
+
+// Test that names are only stored once, and that small stats take a byte each.
+TEST(BinaryDumpTest, TestCompact) {
+    BinaryDump dump;
+    const std::string name(100, 'n');
+    for (int i = 0; i < 100; i++) {
+        DumpedWakeLock& wakeLock = dump.wakeLocks.emplace_back();
+        wakeLock.name = name;
+        wakeLock.pid = 1000 + i;
+        wakeLock.lastChange = 123456789 + i;
+    }
+    // A name, 100 entries of a name index, flags, pid and 9 stats, and the empty sections.
+    ASSERT_LT(encodeBinaryDump(dump).size(), name.size() + 100 * 12 + 64);
+}
+
+TEST(BinaryDumpTest, TestRejectsCorruptDumps) {
+    const std::string data = encodeBinaryDump(makeBinaryDump());
+    BinaryDump dump;
+    ASSERT_FALSE(decodeBinaryDump("", &dump));
+    ASSERT_FALSE(decodeBinaryDump("text", &dump));
+    // Last section cut short.
+    ASSERT_FALSE(decodeBinaryDump(data.substr(0, data.size() - 1), &dump));
+    // Unknown version.
+    std::string corrupt = data;
+    corrupt[4] = 2;
+    ASSERT_FALSE(decodeBinaryDump(corrupt, &dump));
+    // Strings referred to before the string table.
+    const std::string header = data.substr(0, 5);
+    const std::string wakeups = {3, 3, 1, 0, 2};
+    ASSERT_FALSE(decodeBinaryDump(header + wakeups, &dump));
+    // Counts larger than their section.
+    ASSERT_FALSE(decodeBinaryDump(header + std::string{1, 1, 100}, &dump));
+}
+
+TEST(BinaryDumpTest, TestSkipsUnknownSections) {
+    const BinaryDump expected = makeBinaryDump();
+    std::string data = encodeBinaryDump(expected);
+    data += std::string{100, 3, 1, 2, 3};
+    BinaryDump actual;
+    ASSERT_TRUE(decodeBinaryDump(data, &actual));
+    assertSameDump(actual, expected);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DumpWriter.h"
+
+#include <android-base/logging.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+DumpWriter::~DumpWriter() {
+    flush();
+}
+
+void DumpWriter::write(std::string_view text) {
+    while (!text.empty()) {
+        if (mBufferSize == kBufferSize || mNumIovecs == kMaxIovecs) {
+            flush();
+        }
+        size_t size = std::min(text.size(), kBufferSize - mBufferSize);
+        char* data = mBuffer.data() + mBufferSize;
+        memcpy(data, text.data(), size);
+        mBufferSize += size;
+        addIovec(data, size);
+        text.remove_prefix(size);
+    }
+}
+
+void DumpWriter::writeRef(std::string_view text) {
+    if (text.size() < kMinRefSize) {
+        write(text);
+        return;
+    }
+    addIovec(text.data(), text.size());
+}
+
+void DumpWriter::writeLeft(std::string_view text, size_t width) {
+    write(text);
+    if (text.size() < width) {
+        writeFill(' ', width - text.size());
+    }
+}
+
+void DumpWriter::writeRight(std::string_view text, size_t width) {
+    if (text.size() < width) {
+        writeFill(' ', width - text.size());
+    }
+    write(text);
+}
+
+void DumpWriter::writeRight(int64_t value, std::string_view suffix, size_t width) {
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    std::string_view number(digits, end - digits);
+    if (number.size() + suffix.size() < width) {
+        writeFill(' ', width - number.size() - suffix.size());
+    }
+    write(number);
+    write(suffix);
+}
+
+void DumpWriter::writeFill(char c, size_t count) {
+    while (count > 0) {
+        if (mBufferSize == kBufferSize || mNumIovecs == kMaxIovecs) {
+            flush();
+        }
+        size_t size = std::min(count, kBufferSize - mBufferSize);
+        char* data = mBuffer.data() + mBufferSize;
+        memset(data, c, size);
+        mBufferSize += size;
+        addIovec(data, size);
+        count -= size;
+    }
+}
+
+/*
+ * Appends data to the pending iovecs, extending the last one when data directly follows it, as
+ * consecutive copies into mBuffer do.
+ */
+void DumpWriter::addIovec(const char* data, size_t size) {
+    if (mNumIovecs > 0) {
+        iovec& last = mIovecs[mNumIovecs - 1];
+        if (static_cast<const char*>(last.iov_base) + last.iov_len == data) {
+            last.iov_len += size;
+            return;
+        }
+    }
+    if (mNumIovecs == kMaxIovecs) {
+        // Only references get here, copies flush first so that their data stays in mBuffer.
+        flush();
+    }
+    mIovecs[mNumIovecs++] = {const_cast<char*>(data), size};
+}
+
+bool DumpWriter::flush() {
+    iovec* iov = mIovecs.data();
+    size_t numIovecs = mNumIovecs;
+    while (!mFailed && numIovecs > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(writev(mFd, iov, numIovecs));
+        if (written < 0) {
+            PLOG(ERROR) << "Error writing dump";
+            mFailed = true;
+            break;
+        }
+        // Skip what was written, which may end in the middle of an iovec.
+        size_t remaining = written;
+        while (numIovecs > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            iov++;
+            numIovecs--;
+        }
+        if (numIovecs > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+    mBufferSize = 0;
+    mNumIovecs = 0;
+    return !mFailed;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * DumpWriter renders text into a fixed scratch buffer and writes it to a dump fd with writev
+ * whenever the buffer fills up, so that dumps take the same memory however long they are. Text
+ * known to outlive the next flush can be passed by reference instead of being copied.
+ * Once a write fails, e.g. because the reader went away, the rest of the dump is dropped.
+ * This class is not thread safe.
+ */
+class DumpWriter {
+   public:
+    static constexpr size_t kBufferSize = 4096;
+
+    explicit DumpWriter(int fd) : mFd(fd) {}
+    // Flushes what is left.
+    ~DumpWriter();
+    DumpWriter(const DumpWriter&) = delete;
+    DumpWriter& operator=(const DumpWriter&) = delete;
+
+    void write(std::string_view text);
+    // Same as above, without copying text, which must stay valid until the next flush().
+    void writeRef(std::string_view text);
+    // Writes text padded with spaces to width, on the right or on the left.
+    void writeLeft(std::string_view text, size_t width);
+    void writeRight(std::string_view text, size_t width);
+    // Writes value followed by suffix, padded with spaces on the left to width.
+    void writeRight(int64_t value, std::string_view suffix, size_t width);
+    void writeFill(char c, size_t count);
+    // Writes out everything written so far. Returns false if a write failed.
+    bool flush();
+
+   private:
+    void addIovec(const char* data, size_t size);
+
+    // Shorter references are copied, an iovec costs more than copying them.
+    static constexpr size_t kMinRefSize = 64;
+    static constexpr size_t kMaxIovecs = 64;
+
+    const int mFd;
+    bool mFailed = false;
+    std::array<char, kBufferSize> mBuffer;
+    size_t mBufferSize = 0;
+    std::array<iovec, kMaxIovecs> mIovecs;
+    size_t mNumIovecs = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,376 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeKernel.h"
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using ::android::base::Socketpair;
+using ::android::base::StringPrintf;
+using ::android::base::WriteStringToFile;
+using namespace std::chrono_literals;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr const char* kSuspendStatsCounters[] = {
+    "success",
+    "fail",
+    "failed_freeze",
+    "failed_prepare",
+    "failed_suspend",
+    "failed_suspend_late",
+    "failed_suspend_noirq",
+    "failed_resume",
+    "failed_resume_early",
+    "failed_resume_noirq",
+};
+static constexpr const char* kSuspendStatsStrings[] = {
+    "last_failed_dev",
+    "last_failed_errno",
+    "last_failed_step",
+};
+static constexpr const char* kWakeupSourceStats[] = {
+    "active_count",
+    "active_time_ms",
+    "event_count",
+    "expire_count",
+    "last_change_ms",
+    "max_time_ms",
+    "prevent_suspend_time_ms",
+    "total_time_ms",
+    "wakeup_count",
+};
+static constexpr char kAbortReason[] = "Abort: Pending Wakeup Sources: fake_kernel\n";
+static constexpr char kSleepState[] = "mem";
+
+static void makeDir(const std::string& path) {
+    if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+        PLOG(FATAL) << "FakeKernel: failed to create " << path;
+    }
+}
+
+static void writeFile(const std::string& path, const std::string& content) {
+    if (!WriteStringToFile(content, path)) {
+        PLOG(ERROR) << "FakeKernel: failed to write " << path;
+    }
+}
+
+static std::string formatSeconds(std::chrono::nanoseconds time) {
+    return StringPrintf("%" PRId64 ".%09" PRId64,
+                        static_cast<int64_t>(time.count() / 1000000000),
+                        static_cast<int64_t>(time.count() % 1000000000));
+}
+
+FakeKernel::FakeKernel(const FakeKernelConfig& config, size_t numWakeupSources)
+    : mSuspendStatsPath(std::string(mRoot.path) + "/power/suspend_stats"),
+      mWakeupSourcesPath(std::string(mRoot.path) + "/class/wakeup"),
+      mWakeupReasonsPath(std::string(mRoot.path) + "/kernel/wakeup_reasons/last_resume_reason"),
+      mSuspendTimePath(std::string(mRoot.path) + "/kernel/wakeup_reasons/last_suspend_time"),
+      mConfig(config) {
+    const std::string root(mRoot.path);
+    for (const char* dir : {"/power", "/power/suspend_stats", "/class", "/class/wakeup", "/kernel",
+                            "/kernel/wakeup_reasons"}) {
+        makeDir(root + dir);
+    }
+    for (const char* counter : kSuspendStatsCounters) {
+        writeFile(mSuspendStatsPath + "/" + counter, "0\n");
+    }
+    for (const char* stat : kSuspendStatsStrings) {
+        writeFile(mSuspendStatsPath + "/" + stat, "\n");
+    }
+    writeFile(mWakeupReasonsPath, "\n");
+    writeFile(mSuspendTimePath, "0.000000000 0.000000000\n");
+    setNumWakeupSources(numWakeupSources);
+
+    if (!Socketpair(SOCK_STREAM, &mWakeupCountFd, &mWakeupCountPeerFd)) {
+        PLOG(FATAL) << "FakeKernel: failed to create wakeup_count socketpair";
+    }
+
+    int stateFds[2];
+    if (pipe2(stateFds, O_CLOEXEC) != 0) {
+        PLOG(FATAL) << "FakeKernel: failed to create state pipe";
+    }
+    mStateReadFd.reset(stateFds[0]);
+    mStateWriteFd.reset(stateFds[1]);
+    // Keep the pipe as small as possible, it is filled up before every attempt.
+    fcntl(mStateWriteFd, F_SETPIPE_SZ, getpagesize());
+    mStatePipeCapacity = fcntl(mStateWriteFd, F_GETPIPE_SZ);
+    mStateFiller.assign(mStatePipeCapacity, 0);
+    if (!writeExactly(mStateWriteFd, mStateFiller.data(), mStateFiller.size())) {
+        PLOG(FATAL) << "FakeKernel: failed to fill state pipe";
+    }
+
+    mInotifyFd.reset(inotify_init1(IN_CLOEXEC));
+    if (mInotifyFd < 0 ||
+        inotify_add_watch(mInotifyFd, mWakeupReasonsPath.c_str(), IN_ACCESS) < 0) {
+        PLOG(FATAL) << "FakeKernel: failed to watch " << mWakeupReasonsPath;
+    }
+    mStopFd.reset(eventfd(0, EFD_CLOEXEC));
+
+    mThread = std::thread([this] { run(); });
+}
+
+FakeKernel::~FakeKernel() {
+    uint64_t stop = 1;
+    TEMP_FAILURE_RETRY(write(mStopFd, &stop, sizeof(stop)));
+    mThread.join();
+
+    // The autosuspend thread can't be stopped and may still be using its ends of wakeup_count and
+    // state. Keep our ends open so that it sees EOF and EAGAIN instead of getting SIGPIPE.
+    shutdown(mWakeupCountFd, SHUT_WR);
+    setStateNonBlocking(true);
+    mWakeupCountFd.release();
+    mStateReadFd.release();
+
+    setNumWakeupSources(0);
+    for (const char* counter : kSuspendStatsCounters) {
+        unlink((mSuspendStatsPath + "/" + counter).c_str());
+    }
+    for (const char* stat : kSuspendStatsStrings) {
+        unlink((mSuspendStatsPath + "/" + stat).c_str());
+    }
+    unlink(mWakeupReasonsPath.c_str());
+    unlink(mSuspendTimePath.c_str());
+    const std::string root(mRoot.path);
+    for (const char* dir : {"/kernel/wakeup_reasons", "/kernel", "/class/wakeup", "/class",
+                            "/power/suspend_stats", "/power"}) {
+        rmdir((root + dir).c_str());
+    }
+}
+
+unique_fd FakeKernel::takeWakeupCountFd() {
+    return std::move(mWakeupCountPeerFd);
+}
+
+unique_fd FakeKernel::takeStateFd() {
+    if (mStateWriteFdTaken) {
+        return unique_fd(-1);
+    }
+    mStateWriteFdTaken = true;
+    return unique_fd(fcntl(mStateWriteFd, F_DUPFD_CLOEXEC, 0));
+}
+
+unique_fd FakeKernel::openSuspendStatsFd() const {
+    return unique_fd(
+        TEMP_FAILURE_RETRY(open(mSuspendStatsPath.c_str(), O_CLOEXEC | O_DIRECTORY | O_RDONLY)));
+}
+
+unique_fd FakeKernel::openKernelWakelockStatsFd() const {
+    return unique_fd(
+        TEMP_FAILURE_RETRY(open(mWakeupSourcesPath.c_str(), O_CLOEXEC | O_DIRECTORY | O_RDONLY)));
+}
+
+unique_fd FakeKernel::openWakeupReasonsFd() const {
+    return unique_fd(TEMP_FAILURE_RETRY(open(mWakeupReasonsPath.c_str(), O_CLOEXEC | O_RDONLY)));
+}
+
+unique_fd FakeKernel::openSuspendTimeFd() const {
+    return unique_fd(TEMP_FAILURE_RETRY(open(mSuspendTimePath.c_str(), O_CLOEXEC | O_RDONLY)));
+}
+
+void FakeKernel::setConfig(const FakeKernelConfig& config) {
+    std::scoped_lock lock(mLock);
+    mConfig = config;
+}
+
+std::string FakeKernel::wakeupSourcePath(size_t index) const {
+    return StringPrintf("%s/wakeup%zu", mWakeupSourcesPath.c_str(), index);
+}
+
+void FakeKernel::setNumWakeupSources(size_t numWakeupSources) {
+    std::scoped_lock lock(mLock);
+    for (size_t i = mNumWakeupSources; i < numWakeupSources; i++) {
+        const std::string path = wakeupSourcePath(i);
+        makeDir(path);
+        writeFile(path + "/name", StringPrintf("fake_wakeup_source_%zu\n", i));
+        for (const char* stat : kWakeupSourceStats) {
+            writeFile(path + "/" + stat, "0\n");
+        }
+    }
+    for (size_t i = numWakeupSources; i < mNumWakeupSources; i++) {
+        const std::string path = wakeupSourcePath(i);
+        unlink((path + "/name").c_str());
+        for (const char* stat : kWakeupSourceStats) {
+            unlink((path + "/" + stat).c_str());
+        }
+        rmdir(path.c_str());
+    }
+    mNumWakeupSources = numWakeupSources;
+    mWakeupSourceCounts.resize(numWakeupSources);
+}
+
+FakeKernelStats FakeKernel::getStats() const {
+    std::scoped_lock lock(mLock);
+    return mStats;
+}
+
+bool FakeKernel::waitForAttempts(uint64_t count, std::chrono::milliseconds timeout) const {
+    auto lock = std::unique_lock(mLock);
+    return mAttemptCondVar.wait_for(lock, timeout, [&] { return mStats.attempts >= count; });
+}
+
+// Returns false if the kernel is stopping.
+bool FakeKernel::waitReadable(int fd) {
+    struct pollfd pfds[] = {
+        {.fd = fd, .events = POLLIN},
+        {.fd = mStopFd, .events = POLLIN},
+    };
+    while (true) {
+        int n = TEMP_FAILURE_RETRY(poll(pfds, 2, -1));
+        if (n < 0 || pfds[1].revents) return false;
+        if (pfds[0].revents) return true;
+    }
+}
+
+bool FakeKernel::readExactly(int fd, size_t size) {
+    char buf[4096];
+    while (size > 0) {
+        if (!waitReadable(fd)) return false;
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, buf, std::min(size, sizeof(buf))));
+        if (n <= 0) return false;
+        size -= n;
+    }
+    return true;
+}
+
+bool FakeKernel::writeExactly(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, data, size));
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool FakeKernel::setStateNonBlocking(bool nonBlocking) {
+    int flags = fcntl(mStateWriteFd, F_GETFL);
+    if (flags < 0) return false;
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(mStateWriteFd, F_SETFL, flags) == 0;
+}
+
+void FakeKernel::writeSuspendResult(const FakeKernelConfig& config, bool aborted) {
+    std::scoped_lock lock(mLock);
+    const uint64_t attempts = mStats.attempts + 1;
+    const uint64_t failures = mStats.aborted + (aborted ? 1 : 0);
+
+    if (aborted) {
+        writeFile(mSuspendTimePath,
+                  formatSeconds(config.reportedSuspendOverhead) + " " + formatSeconds(0ns) + "\n");
+        writeFile(mWakeupReasonsPath, kAbortReason);
+        writeFile(mSuspendStatsPath + "/fail", StringPrintf("%" PRIu64 "\n", failures));
+        writeFile(mSuspendStatsPath + "/failed_suspend", StringPrintf("%" PRIu64 "\n", failures));
+        writeFile(mSuspendStatsPath + "/last_failed_dev", "fake_kernel\n");
+        writeFile(mSuspendStatsPath + "/last_failed_errno", "-16\n");
+        writeFile(mSuspendStatsPath + "/last_failed_step", "suspend\n");
+        return;
+    }
+
+    writeFile(mSuspendTimePath, formatSeconds(config.reportedSuspendOverhead) + " " +
+                                    formatSeconds(config.reportedSuspendTime) + "\n");
+    writeFile(mSuspendStatsPath + "/success", StringPrintf("%" PRIu64 "\n", attempts - failures));
+    if (config.wakeupReasons.empty()) {
+        // Never leave the file empty, reading it wouldn't generate an inotify event.
+        writeFile(mWakeupReasonsPath, "\n");
+        return;
+    }
+
+    size_t reason = mSuccessCount % config.wakeupReasons.size();
+    writeFile(mWakeupReasonsPath, config.wakeupReasons[reason] + "\n");
+    if (mNumWakeupSources > 0) {
+        size_t source = reason % mNumWakeupSources;
+        const std::string count = StringPrintf("%" PRIu64 "\n", ++mWakeupSourceCounts[source]);
+        writeFile(wakeupSourcePath(source) + "/event_count", count);
+        writeFile(wakeupSourcePath(source) + "/wakeup_count", count);
+    }
+}
+
+void FakeKernel::run() {
+    uint64_t wakeupCount = 0;
+    char wakeupCountBuf[32];
+    inotify_event events[16];
+
+    while (true) {
+        FakeKernelConfig config;
+        {
+            std::scoped_lock lock(mLock);
+            config = mConfig;
+        }
+
+        std::this_thread::sleep_for(config.wakeupCountLatency);
+        // The previous attempt has completed, so SystemSuspend isn't writing to the pipe.
+        const uint64_t attempt = ++wakeupCount;
+        const bool aborted = config.failEvery > 0 && attempt % config.failEvery == 0;
+        if (aborted) {
+            // Report the failure before the attempt starts, SystemSuspend reads the results right
+            // after its write to /sys/power/state fails.
+            writeSuspendResult(config, true);
+        }
+        if (!setStateNonBlocking(aborted)) {
+            PLOG(ERROR) << "FakeKernel: failed to set state pipe flags";
+            return;
+        }
+
+        // MSG_NOSIGNAL, the other end may be closed while we're waiting to hand out a count.
+        int len = snprintf(wakeupCountBuf, sizeof(wakeupCountBuf), "%" PRIu64, wakeupCount);
+        if (TEMP_FAILURE_RETRY(send(mWakeupCountFd, wakeupCountBuf, len, MSG_NOSIGNAL)) != len ||
+            !readExactly(mWakeupCountFd, len)) {
+            return;
+        }
+
+        if (!aborted) {
+            std::this_thread::sleep_for(config.suspendLatency);
+            writeSuspendResult(config, false);
+            mSuccessCount++;
+            // Make room for the write to /sys/power/state, consume it and fill the pipe up again.
+            if (!readExactly(mStateReadFd, mStatePipeCapacity) ||
+                !readExactly(mStateReadFd, sizeof(kSleepState) - 1) ||
+                !writeExactly(mStateWriteFd, mStateFiller.data(), mStateFiller.size())) {
+                return;
+            }
+        }
+
+        // The attempt completes once SystemSuspend reads last_resume_reason, the last node it
+        // reads after writing to /sys/power/state.
+        if (!waitReadable(mInotifyFd) ||
+            TEMP_FAILURE_RETRY(read(mInotifyFd, events, sizeof(events))) <= 0) {
+            return;
+        }
+
+        std::scoped_lock lock(mLock);
+        mStats.attempts++;
+        if (aborted) mStats.aborted++;
+        mAttemptCondVar.notify_all();
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <utils/Mutex.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::base::unique_fd;
+
+struct FakeKernelConfig {
+    // Time the read of /sys/power/wakeup_count blocks before each suspend attempt
+    std::chrono::microseconds wakeupCountLatency{0};
+    // Time a successful write to /sys/power/state blocks, i.e. suspend entry, suspend and resume
+    std::chrono::microseconds suspendLatency{0};
+    // Reported in last_suspend_time after a successful suspend
+    std::chrono::milliseconds reportedSuspendTime{1000};
+    std::chrono::milliseconds reportedSuspendOverhead{10};
+    // Every failEvery-th suspend attempt is aborted and its write to /sys/power/state fails. 0 to
+    // never abort.
+    uint32_t failEvery = 0;
+    // Reported in last_resume_reason after successful suspends, in turn. Each one is attributed
+    // to a wakeup source under /sys/class/wakeup.
+    std::vector<std::string> wakeupReasons{"170 qpnp_rtc_alarm"};
+};
+
+struct FakeKernelStats {
+    uint64_t attempts = 0;
+    uint64_t aborted = 0;
+};
+
+/*
+ * FakeKernel simulates the kernel power management interfaces used by SystemSuspend, so that the
+ * real autosuspend loop can be run on a host without root or sysfs:
+ *
+ *  - /sys/power/wakeup_count is one end of a socketpair. A new wakeup count is handed out for
+ *    each suspend attempt and the value written back is consumed.
+ *  - /sys/power/state is the write end of a pipe that is kept full. A write blocks until the
+ *    simulated suspend completes and the pipe is drained. Aborted attempts mark the pipe
+ *    non-blocking beforehand, so the write fails with EAGAIN.
+ *  - /sys/power/suspend_stats, /sys/class/wakeup and /sys/kernel/wakeup_reasons are regular files
+ *    in a temporary directory, updated after each attempt.
+ *
+ * An attempt completes when SystemSuspend reads last_resume_reason after its write to
+ * /sys/power/state, which is observed with inotify.
+ * This class is thread safe.
+ */
+class FakeKernel {
+   public:
+    FakeKernel(const FakeKernelConfig& config, size_t numWakeupSources);
+    // Stops the kernel thread. Subsequent reads and writes by SystemSuspend fail.
+    ~FakeKernel();
+
+    // The following return fds to be passed to the SystemSuspend constructor.
+    // wakeup_count and state can only be taken once.
+    unique_fd takeWakeupCountFd();
+    unique_fd takeStateFd();
+    unique_fd openSuspendStatsFd() const;
+    unique_fd openKernelWakelockStatsFd() const;
+    unique_fd openWakeupReasonsFd() const;
+    unique_fd openSuspendTimeFd() const;
+
+    // Applies to the next suspend attempt.
+    void setConfig(const FakeKernelConfig& config);
+    // Adds or removes wakeup sources under /sys/class/wakeup.
+    void setNumWakeupSources(size_t numWakeupSources);
+    FakeKernelStats getStats() const;
+    // Blocks until at least count suspend attempts have completed. Returns false on timeout.
+    bool waitForAttempts(uint64_t count, std::chrono::milliseconds timeout) const;
+
+   private:
+    void run();
+    bool waitReadable(int fd);
+    bool readExactly(int fd, size_t size);
+    bool writeExactly(int fd, const char* data, size_t size);
+    bool setStateNonBlocking(bool nonBlocking);
+    void writeSuspendResult(const FakeKernelConfig& config, bool aborted);
+    std::string wakeupSourcePath(size_t index) const;
+
+    android::base::TemporaryDir mRoot;
+    const std::string mSuspendStatsPath;
+    const std::string mWakeupSourcesPath;
+    const std::string mWakeupReasonsPath;
+    const std::string mSuspendTimePath;
+
+    unique_fd mWakeupCountFd;
+    unique_fd mWakeupCountPeerFd;
+    unique_fd mStateReadFd;
+    // Same open file description as the fd handed out as /sys/power/state.
+    unique_fd mStateWriteFd;
+    bool mStateWriteFdTaken = false;
+    size_t mStatePipeCapacity = 0;
+    std::vector<char> mStateFiller;
+    unique_fd mInotifyFd;
+    unique_fd mStopFd;
+
+    mutable std::mutex mLock;
+    mutable std::condition_variable mAttemptCondVar;
+    FakeKernelConfig mConfig GUARDED_BY(mLock);
+    FakeKernelStats mStats GUARDED_BY(mLock);
+    size_t mNumWakeupSources GUARDED_BY(mLock) = 0;
+    std::vector<uint64_t> mWakeupSourceCounts GUARDED_BY(mLock);
+
+    // Only used by the kernel thread.
+    uint64_t mSuccessCount = 0;
+
+    std::thread mThread;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
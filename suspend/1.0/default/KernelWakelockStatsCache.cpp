@@ -0,0 +1,265 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelWakelockStatsCache.h"
+
+#include <algorithm>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+KernelWakelockStatsCache::KernelWakelockStatsCache(unique_fd kernelWakelockStatsFd,
+                                                   std::chrono::milliseconds refreshInterval,
+                                                   std::atomic<uint64_t>* generation)
+    : kRefreshInterval(refreshInterval),
+      mGeneration(generation),
+      mReader(std::move(kernelWakelockStatsFd)) {
+    if (kRefreshInterval > std::chrono::milliseconds::zero()) {
+        mRefresher = std::thread([this] { runRefresher(); });
+    }
+}
+
+KernelWakelockStatsCache::~KernelWakelockStatsCache() {
+    {
+        std::scoped_lock lock(mLock);
+        mStopped = true;
+    }
+    mCondVar.notify_one();
+    if (mRefresher.joinable()) {
+        mRefresher.join();
+    }
+}
+
+void KernelWakelockStatsCache::getStats(std::chrono::milliseconds maxAge,
+                                        std::vector<WakeLockInfo>* aidl_return) {
+    std::shared_ptr<const Snapshot> snapshot = getSnapshot(maxAge);
+    aidl_return->insert(aidl_return->end(), snapshot->infos.begin(), snapshot->infos.end());
+}
+
+std::shared_ptr<const std::vector<WakeLockInfo>> KernelWakelockStatsCache::getStatsSnapshot(
+    std::chrono::milliseconds maxAge) {
+    std::shared_ptr<const Snapshot> snapshot = getSnapshot(maxAge);
+    return std::shared_ptr<const std::vector<WakeLockInfo>>(snapshot, &snapshot->infos);
+}
+
+void KernelWakelockStatsCache::getTopStats(std::chrono::milliseconds maxAge, WakeLockMetric metric,
+                                           size_t k, std::vector<WakeLockInfo>* aidl_return) {
+    std::shared_ptr<const Snapshot> snapshot = getSnapshot(maxAge);
+    const size_t index = static_cast<size_t>(metric);
+    std::call_once(snapshot->topSelected[index], [&] {
+        snapshot->top[index] = selectTopWakeLocks(snapshot->infos, metric, kMaxTopWakeLocks);
+    });
+    const std::vector<uint32_t>& top = snapshot->top[index];
+    for (size_t i = 0; i < std::min(k, top.size()); i++) {
+        aidl_return->push_back(snapshot->infos[top[i]]);
+    }
+}
+
+bool KernelWakelockStatsCache::getStatsDelta(std::chrono::milliseconds maxAge, uint64_t since,
+                                             std::vector<WakeLockInfo>* changed,
+                                             std::vector<WakeLockInfo>* removed) {
+    std::shared_ptr<const Snapshot> snapshot = getSnapshot(maxAge);
+    {
+        std::scoped_lock lock(mLock);
+        if (since < mForgottenGeneration) {
+            return false;
+        }
+        // Removals stamped by later snapshots would hide entries of this one still reported.
+        for (const Removal& removal : mRemovals) {
+            if (removal.generation > since && removal.generation <= snapshot->generation) {
+                WakeLockInfo& info = removed->emplace_back();
+                info.name = removal.name;
+                info.isKernelWakelock = true;
+                info.pid = -1;  // N/A
+            }
+        }
+    }
+    for (size_t i = 0; i < snapshot->infos.size(); i++) {
+        if (snapshot->generations[i] > since) {
+            changed->push_back(snapshot->infos[i]);
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const KernelWakelockStatsCache::Snapshot> KernelWakelockStatsCache::getSnapshot(
+    std::chrono::milliseconds maxAge) {
+    const Clock::time_point now = Clock::now();
+    {
+        std::scoped_lock lock(mLock);
+        // Callers that always want a fresh read have no use for the background refresh.
+        if (maxAge > std::chrono::milliseconds::zero()) {
+            mLastReadTime = now;
+            if (mRefresherIdle) {
+                mCondVar.notify_one();
+            }
+        }
+        if (mSnapshot && now - mSnapshotTime <= maxAge) {
+            return mSnapshot;
+        }
+    }
+    return refresh(now);
+}
+
+void KernelWakelockStatsCache::pause() {
+    std::scoped_lock lock(mLock);
+    mPaused = true;
+}
+
+void KernelWakelockStatsCache::resume() {
+    {
+        std::scoped_lock lock(mLock);
+        mPaused = false;
+        mResumeCount++;
+        mSnapshot.reset();
+    }
+    mCondVar.notify_one();
+}
+
+/*
+ * Returns a snapshot read after notBefore, reading a new one unless another caller did while this
+ * one was waiting for mRefreshLock.
+ */
+std::shared_ptr<const KernelWakelockStatsCache::Snapshot> KernelWakelockStatsCache::refresh(
+    Clock::time_point notBefore) {
+    std::scoped_lock refreshLock(mRefreshLock);
+    uint64_t resumeCount;
+    {
+        std::scoped_lock lock(mLock);
+        if (mSnapshot && mSnapshotTime >= notBefore) {
+            return mSnapshot;
+        }
+        resumeCount = mResumeCount;
+    }
+
+    auto snapshot = std::make_shared<Snapshot>();
+    const Clock::time_point readTime = Clock::now();
+    mReader.getStats(&snapshot->infos);
+
+    std::scoped_lock lock(mLock);
+    stampSnapshot(snapshot.get());
+    mLastSnapshot = snapshot;
+    if (mResumeCount == resumeCount) {
+        mSnapshot = snapshot;
+        mSnapshotTime = readTime;
+    }
+    return snapshot;
+}
+
+static bool sameStats(const WakeLockInfo& a, const WakeLockInfo& b) {
+    return std::tie(a.activeCount, a.lastChange, a.maxTime, a.totalTime, a.isActive, a.activeTime,
+                    a.eventCount, a.expireCount, a.preventSuspendTime, a.wakeupCount) ==
+           std::tie(b.activeCount, b.lastChange, b.maxTime, b.totalTime, b.isActive, b.activeTime,
+                    b.eventCount, b.expireCount, b.preventSuspendTime, b.wakeupCount);
+}
+
+/*
+ * Sets the generations of a new snapshot by comparing it with mLastSnapshot. All the changes found
+ * share a single new generation.
+ */
+void KernelWakelockStatsCache::stampSnapshot(Snapshot* snapshot) {
+    uint64_t generation = 0;
+    auto newGeneration = [&] {
+        if (generation == 0) {
+            generation = mGeneration->fetch_add(1) + 1;
+        }
+        return generation;
+    };
+
+    const Snapshot* last = mLastSnapshot.get();
+    const size_t size = snapshot->infos.size();
+    snapshot->generations.resize(size);
+
+    // Wakeup sources rarely come and go, compare with the same position first.
+    bool sameLayout = last && last->infos.size() == size;
+    for (size_t i = 0; sameLayout && i < size; i++) {
+        sameLayout = last->infos[i].name == snapshot->infos[i].name;
+    }
+    if (sameLayout) {
+        for (size_t i = 0; i < size; i++) {
+            snapshot->generations[i] = sameStats(last->infos[i], snapshot->infos[i])
+                                           ? last->generations[i]
+                                           : newGeneration();
+        }
+    } else {
+        std::unordered_map<std::string_view, size_t> lastIndex;
+        if (last) {
+            for (size_t i = 0; i < last->infos.size(); i++) {
+                lastIndex.emplace(last->infos[i].name, i);
+            }
+        }
+        for (size_t i = 0; i < size; i++) {
+            auto it = lastIndex.find(snapshot->infos[i].name);
+            if (it != lastIndex.end() && sameStats(last->infos[it->second], snapshot->infos[i])) {
+                snapshot->generations[i] = last->generations[it->second];
+            } else {
+                snapshot->generations[i] = newGeneration();
+            }
+            if (it != lastIndex.end()) {
+                lastIndex.erase(it);
+            }
+        }
+        for (const auto& [name, index] : lastIndex) {
+            recordRemoval(last->infos[index].name, newGeneration());
+        }
+    }
+    snapshot->generation = mGeneration->load();
+}
+
+void KernelWakelockStatsCache::recordRemoval(const std::string& name, uint64_t generation) {
+    if (mRemovals.size() < kMaxRemovals) {
+        mRemovals.push_back({name, generation});
+        return;
+    }
+    Removal& removal = mRemovals[mNextRemoval];
+    mForgottenGeneration = std::max(mForgottenGeneration, removal.generation);
+    removal.name = name;
+    removal.generation = generation;
+    mNextRemoval = (mNextRemoval + 1) % kMaxRemovals;
+}
+
+void KernelWakelockStatsCache::runRefresher() {
+    auto lock = std::unique_lock(mLock);
+    while (!mStopped) {
+        const Clock::time_point now = Clock::now();
+        if (mPaused || now - mLastReadTime >= kIdleRefreshes * kRefreshInterval) {
+            // Nobody is polling, wait for the next read or resume.
+            mRefresherIdle = true;
+            mCondVar.wait(lock);
+            mRefresherIdle = false;
+            continue;
+        }
+        const Clock::time_point nextRefresh = mSnapshot ? mSnapshotTime + kRefreshInterval : now;
+        if (now < nextRefresh) {
+            mCondVar.wait_until(lock, nextRefresh);
+            continue;
+        }
+
+        lock.unlock();
+        refresh(now);
+        lock.lock();
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
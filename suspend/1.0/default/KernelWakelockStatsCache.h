@@ -0,0 +1,140 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/Mutex.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "KernelWakelockStatsReader.h"
+#include "WakeLockRanking.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * KernelWakelockStatsCache keeps the last snapshot of the kernel wakelock stats so that callers
+ * accepting stats up to some age old don't each read sysfs. Concurrent callers needing a new
+ * snapshot share a single read.
+ *
+ * With a non-zero refresh interval, a background thread also takes a new snapshot every interval
+ * for as long as the stats keep being read with a non-zero max age, so that pollers usually find a
+ * fresh enough one. The refresh is paused while the device suspends, and the snapshot taken before
+ * is dropped on resume.
+ *
+ * Each snapshot is compared with the previous one: the stats that changed are stamped with a new
+ * generation from the counter passed in, and the ones that disappeared are remembered with it, so
+ * that callers can ask for what changed since a given generation.
+ * This class is thread safe.
+ */
+class KernelWakelockStatsCache {
+   public:
+    KernelWakelockStatsCache(unique_fd kernelWakelockStatsFd,
+                             std::chrono::milliseconds refreshInterval,
+                             std::atomic<uint64_t>* generation);
+    ~KernelWakelockStatsCache();
+    // Appends the stats of every kernel wakelock, read at most maxAge ago, to aidl_return.
+    void getStats(std::chrono::milliseconds maxAge, std::vector<WakeLockInfo>* aidl_return);
+    // Same as above, sharing the stats instead of copying them.
+    std::shared_ptr<const std::vector<WakeLockInfo>> getStatsSnapshot(
+        std::chrono::milliseconds maxAge);
+    // Appends the stats of the up to k kernel wakelocks with the largest value of metric, in
+    // descending order. k is at most kMaxTopWakeLocks. The first call for a metric on a snapshot
+    // ranks all of its kernel wakelocks; later calls with the same snapshot take O(k).
+    void getTopStats(std::chrono::milliseconds maxAge, WakeLockMetric metric, size_t k,
+                     std::vector<WakeLockInfo>* aidl_return);
+    // Same as above for the kernel wakelocks whose stats changed after generation since. The
+    // kernel wakelocks removed since are appended to removed, with only their name set. Returns
+    // false if those removals were forgotten, in which case nothing is appended.
+    bool getStatsDelta(std::chrono::milliseconds maxAge, uint64_t since,
+                       std::vector<WakeLockInfo>* changed, std::vector<WakeLockInfo>* removed);
+    // Called before and after the device suspends.
+    void pause();
+    void resume();
+    std::chrono::milliseconds getRefreshInterval() const { return kRefreshInterval; }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Snapshot {
+        std::vector<WakeLockInfo> infos;
+        // Generation at which each of infos last changed.
+        std::vector<uint64_t> generations;
+        // Latest generation when the snapshot was stamped.
+        uint64_t generation = 0;
+        // Indices of the top kMaxTopWakeLocks infos by each metric, selected on the first
+        // getTopStats() for that metric rather than for every metric on every refresh.
+        mutable std::array<std::once_flag, kNumWakeLockMetrics> topSelected;
+        mutable std::array<std::vector<uint32_t>, kNumWakeLockMetrics> top;
+    };
+
+    struct Removal {
+        std::string name;
+        uint64_t generation = 0;
+    };
+
+    std::shared_ptr<const Snapshot> getSnapshot(std::chrono::milliseconds maxAge);
+    std::shared_ptr<const Snapshot> refresh(Clock::time_point notBefore);
+    void stampSnapshot(Snapshot* snapshot) REQUIRES(mLock);
+    void recordRemoval(const std::string& name, uint64_t generation) REQUIRES(mLock);
+    void runRefresher();
+
+    // The background refresh stops after this many intervals without a read.
+    static constexpr int kIdleRefreshes = 10;
+    static constexpr size_t kMaxRemovals = 256;
+
+    const std::chrono::milliseconds kRefreshInterval;
+    std::atomic<uint64_t>* const mGeneration;
+    KernelWakelockStatsReader mReader;
+    // Serializes reads of mReader, so that callers waiting for it can use its snapshot.
+    std::mutex mRefreshLock;
+
+    std::mutex mLock;
+    std::condition_variable mCondVar;
+    std::shared_ptr<const Snapshot> mSnapshot GUARDED_BY(mLock);
+    Clock::time_point mSnapshotTime GUARDED_BY(mLock);
+    Clock::time_point mLastReadTime GUARDED_BY(mLock);
+    // Bumped on resume, so that a read started before suspending doesn't become the snapshot.
+    uint64_t mResumeCount GUARDED_BY(mLock) = 0;
+    bool mPaused GUARDED_BY(mLock) = false;
+    bool mRefresherIdle GUARDED_BY(mLock) = false;
+    bool mStopped GUARDED_BY(mLock) = false;
+    // Snapshot new ones are compared with. Unlike mSnapshot, it isn't dropped on resume.
+    std::shared_ptr<const Snapshot> mLastSnapshot GUARDED_BY(mLock);
+    // Ring buffer of the most recent removals.
+    std::vector<Removal> mRemovals GUARDED_BY(mLock);
+    size_t mNextRemoval GUARDED_BY(mLock) = 0;
+    // Latest generation of the removals overwritten in mRemovals.
+    uint64_t mForgottenGeneration GUARDED_BY(mLock) = 0;
+    std::thread mRefresher;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelWakelockStatsReader.h"
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+
+using android::base::ReadFdToString;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr struct {
+    const char* fileName;
+    int64_t WakeLockInfo::*field;
+} kStats[] = {
+    {"active_count", &WakeLockInfo::activeCount},
+    {"active_time_ms", &WakeLockInfo::activeTime},
+    {"event_count", &WakeLockInfo::eventCount},
+    {"expire_count", &WakeLockInfo::expireCount},
+    {"last_change_ms", &WakeLockInfo::lastChange},
+    {"max_time_ms", &WakeLockInfo::maxTime},
+    {"prevent_suspend_time_ms", &WakeLockInfo::preventSuspendTime},
+    {"total_time_ms", &WakeLockInfo::totalTime},
+    {"wakeup_count", &WakeLockInfo::wakeupCount},
+};
+
+// Keep at most this share of RLIMIT_NOFILE open, the rest of the service needs fds too.
+static constexpr size_t kFdBudgetDivisor = 2;
+
+static bool isDotOrDotDot(const char* name) {
+    return !strcmp(name, ".") || !strcmp(name, "..");
+}
+
+static size_t getFdBudget() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+        return 1024 / kFdBudgetDivisor;
+    }
+    return limit.rlim_cur / kFdBudgetDivisor;
+}
+
+KernelWakelockStatsReader::KernelWakelockStatsReader(unique_fd kernelWakelockStatsFd,
+                                                     size_t numThreads)
+    : mNumThreads(std::max<size_t>(numThreads, 1)),
+      mKernelWakelockStatsFd(std::move(kernelWakelockStatsFd)),
+      mDir(nullptr, &closedir),
+      mFdBudget(getFdBudget()) {
+    static_assert(std::size(kStats) == kNumStats);
+    if (mKernelWakelockStatsFd >= 0) {
+        mDir.reset(fdopendir(dup(mKernelWakelockStatsFd.get())));
+    }
+}
+
+KernelWakelockStatsReader::~KernelWakelockStatsReader() {
+    {
+        std::scoped_lock lock(mScanLock);
+        mStopped = true;
+    }
+    mScanCondVar.notify_all();
+    std::scoped_lock lock(mLock);
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void KernelWakelockStatsReader::getStats(std::vector<WakeLockInfo>* aidl_return) {
+    std::scoped_lock lock(mLock);
+    if (!mDir) {
+        return;
+    }
+    if (!isUpToDate()) {
+        rescan();
+    }
+
+    size_t offset = aidl_return->size();
+    aidl_return->resize(offset + mSources.size());
+    WakeLockInfo* infos = aidl_return->data() + offset;
+    if (mNumThreads > 1 && mSources.size() >= 2 * kMinSourcesPerThread) {
+        readParallel(infos);
+    } else {
+        readSlice(0, 1, mSources.data(), mSources.size(), &mReader, infos);
+    }
+}
+
+/*
+ * Reads the stats of mSources into infos, the calling thread reading the first slice and the
+ * workers the others.
+ */
+void KernelWakelockStatsReader::readParallel(WakeLockInfo* infos) {
+    size_t numSlices = std::min(mNumThreads, mSources.size() / kMinSourcesPerThread);
+    {
+        std::scoped_lock lock(mScanLock);
+        // Workers are kept once started, they only wait for the next read.
+        for (size_t slice = mWorkers.size() + 1; slice < numSlices; slice++) {
+            mWorkers.emplace_back(
+                [this, slice, generation = mScanGeneration] { runWorker(slice, generation); });
+        }
+        numSlices = mWorkers.size() + 1;
+
+        mScanGeneration++;
+        mScanNumSlices = numSlices;
+        mPendingWorkers = mWorkers.size();
+        mScanSources = mSources.data();
+        mScanNumSources = mSources.size();
+        mScanInfos = infos;
+    }
+    mScanCondVar.notify_all();
+
+    readSlice(0, numSlices, mSources.data(), mSources.size(), &mReader, infos);
+
+    auto lock = std::unique_lock(mScanLock);
+    mScanDoneCondVar.wait(lock, [this] { return mPendingWorkers == 0; });
+}
+
+void KernelWakelockStatsReader::runWorker(size_t slice, uint64_t generation) {
+    SysfsReader reader;
+    while (true) {
+        size_t numSlices;
+        const Source* sources;
+        size_t numSources;
+        WakeLockInfo* infos;
+        {
+            auto lock = std::unique_lock(mScanLock);
+            mScanCondVar.wait(lock, [&] { return mStopped || mScanGeneration != generation; });
+            if (mStopped) {
+                return;
+            }
+            generation = mScanGeneration;
+            numSlices = mScanNumSlices;
+            sources = mScanSources;
+            numSources = mScanNumSources;
+            infos = mScanInfos;
+        }
+
+        readSlice(slice, numSlices, sources, numSources, &reader, infos);
+
+        std::scoped_lock lock(mScanLock);
+        if (--mPendingWorkers == 0) {
+            mScanDoneCondVar.notify_one();
+        }
+    }
+}
+
+void KernelWakelockStatsReader::readSlice(size_t slice, size_t numSlices, const Source* sources,
+                                          size_t numSources, SysfsReader* reader,
+                                          WakeLockInfo* infos) const {
+    size_t begin = numSources * slice / numSlices;
+    size_t end = numSources * (slice + 1) / numSlices;
+    for (size_t i = begin; i < end; i++) {
+        readSource(sources[i], reader, &infos[i]);
+    }
+}
+
+/*
+ * Returns whether the wakeup sources listed in the directory are still the ones in mSources, in
+ * the same order.
+ */
+bool KernelWakelockStatsReader::isUpToDate() {
+    // rewinddir, else subsequent calls will not get any kernel wakelocks.
+    rewinddir(mDir.get());
+
+    size_t i = 0;
+    struct dirent* de;
+    while ((de = readdir(mDir.get()))) {
+        if (isDotOrDotDot(de->d_name)) {
+            continue;
+        }
+        if (i == mSources.size() || mSources[i].ino != de->d_ino || mSources[i].id != de->d_name) {
+            return false;
+        }
+        i++;
+    }
+    return i == mSources.size();
+}
+
+/*
+ * Lists the wakeup sources again, opening the new ones and closing the ones that are gone.
+ */
+void KernelWakelockStatsReader::rescan() {
+    std::unordered_map<std::string, Source> oldSources;
+    for (Source& source : mSources) {
+        if (source.cached) {
+            mFdBudget += kNumStats;
+        }
+        std::string id = source.id;
+        oldSources.emplace(std::move(id), std::move(source));
+    }
+    mSources.clear();
+
+    rewinddir(mDir.get());
+    struct dirent* de;
+    while ((de = readdir(mDir.get()))) {
+        if (isDotOrDotDot(de->d_name)) {
+            continue;
+        }
+        auto old = oldSources.find(de->d_name);
+        if (old == oldSources.end() || old->second.ino != de->d_ino) {
+            mSources.push_back(openSource(de->d_name, de->d_ino));
+            continue;
+        }
+        Source& source = mSources.emplace_back(std::move(old->second));
+        if (!source.cached && mFdBudget >= kNumStats) {
+            openStatFiles(source.id, &source.statFds);
+            source.cached = true;
+        }
+        if (source.cached) {
+            mFdBudget -= kNumStats;
+        }
+    }
+}
+
+KernelWakelockStatsReader::Source KernelWakelockStatsReader::openSource(const char* id,
+                                                                        ino_t ino) {
+    Source source;
+    source.id = id;
+    source.ino = ino;
+
+    unique_fd nameFd{TEMP_FAILURE_RETRY(
+        openat(mKernelWakelockStatsFd, (source.id + "/name").c_str(), O_CLOEXEC | O_RDONLY))};
+    if (nameFd < 0 || !ReadFdToString(nameFd.get(), &source.name)) {
+        PLOG(ERROR) << "Error reading name for " << source.id;
+    }
+    // Trim newline
+    source.name.erase(std::remove(source.name.begin(), source.name.end(), '\n'),
+                      source.name.end());
+
+    if (mFdBudget >= kNumStats) {
+        openStatFiles(source.id, &source.statFds);
+        source.cached = true;
+        mFdBudget -= kNumStats;
+    }
+    return source;
+}
+
+void KernelWakelockStatsReader::openStatFiles(const std::string& id,
+                                              std::array<unique_fd, kNumStats>* statFds) const {
+    unique_fd wakelockFd{TEMP_FAILURE_RETRY(
+        openat(mKernelWakelockStatsFd, id.c_str(), O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
+    if (wakelockFd < 0) {
+        PLOG(ERROR) << "Error opening kernel wakelock stats for: " << id;
+        return;
+    }
+    for (size_t i = 0; i < kNumStats; i++) {
+        (*statFds)[i].reset(
+            TEMP_FAILURE_RETRY(openat(wakelockFd, kStats[i].fileName, O_CLOEXEC | O_RDONLY)));
+    }
+}
+
+static int64_t parseStat(std::string_view value) {
+    while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front()))) {
+        value.remove_prefix(1);
+    }
+    int64_t stat = 0;
+    std::from_chars(value.data(), value.data() + value.size(), stat);
+    return stat;
+}
+
+void KernelWakelockStatsReader::readSource(const Source& source, SysfsReader* reader,
+                                           WakeLockInfo* info) const {
+    info->name = source.name;
+    info->isKernelWakelock = true;
+    info->pid = -1;  // N/A
+
+    std::array<unique_fd, kNumStats> uncachedFds;
+    const std::array<unique_fd, kNumStats>* statFds = &source.statFds;
+    if (!source.cached) {
+        openStatFiles(source.id, &uncachedFds);
+        statFds = &uncachedFds;
+    }
+
+    for (size_t i = 0; i < kNumStats; i++) {
+        if ((*statFds)[i] < 0) {
+            continue;
+        }
+        std::string_view value = reader->read((*statFds)[i]);
+        if (value.empty()) {
+            PLOG(ERROR) << "Error reading " << kStats[i].fileName << " for " << source.id;
+            continue;
+        }
+        info->*kStats[i].field = parseStat(value);
+    }
+
+    // Derived stats
+    info->isActive = info->activeTime > 0;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+#include <android/system/suspend/internal/WakeLockInfo.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <utils/Mutex.h>
+
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SysfsReader.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::base::unique_fd;
+using ::android::system::suspend::internal::WakeLockInfo;
+
+/*
+ * KernelWakelockStatsReader reads the stats of the wakeup sources under /sys/class/wakeup.
+ *
+ * The stat files of each wakeup source are opened when the wakeup source is first seen and kept
+ * open, so that reading the stats again only takes a pread per file. The wakeup sources directory
+ * is still listed on every read, which takes a handful of getdents calls, to pick up wakeup
+ * sources as they appear and disappear. Files are only kept open within a budget derived from
+ * RLIMIT_NOFILE; the stats of wakeup sources beyond it are read by opening their files each time.
+ *
+ * Some drivers are slow to read their attributes, so with enough wakeup sources the reads are
+ * split into contiguous slices across up to numThreads threads: the calling one and workers
+ * started on first use. Each thread writes its slice of the presized output directly.
+ * This class is thread safe.
+ */
+class KernelWakelockStatsReader {
+   public:
+    static constexpr size_t kDefaultNumThreads = 4;
+
+    explicit KernelWakelockStatsReader(unique_fd kernelWakelockStatsFd,
+                                       size_t numThreads = kDefaultNumThreads);
+    ~KernelWakelockStatsReader();
+    // Appends the stats of every kernel wakelock to aidl_return.
+    void getStats(std::vector<WakeLockInfo>* aidl_return);
+
+   private:
+    // Number of stat files, besides "name", in the directory of a wakeup source.
+    static constexpr size_t kNumStats = 9;
+
+    struct Source {
+        // Directory of the wakeup source, e.g. "wakeup12", and its inode to tell it apart from a
+        // new wakeup source reusing the name.
+        std::string id;
+        ino_t ino = 0;
+        std::string name;
+        // Whether statFds are kept open.
+        bool cached = false;
+        std::array<unique_fd, kNumStats> statFds;
+    };
+
+    bool isUpToDate() REQUIRES(mLock);
+    void rescan() REQUIRES(mLock);
+    Source openSource(const char* id, ino_t ino) REQUIRES(mLock);
+    void openStatFiles(const std::string& id, std::array<unique_fd, kNumStats>* statFds) const;
+    void readSource(const Source& source, SysfsReader* reader, WakeLockInfo* info) const;
+    void readSlice(size_t slice, size_t numSlices, const Source* sources, size_t numSources,
+                   SysfsReader* reader, WakeLockInfo* infos) const;
+    void readParallel(WakeLockInfo* infos) REQUIRES(mLock);
+    void runWorker(size_t slice, uint64_t generation);
+
+    // Don't hand a thread less than this many wakeup sources.
+    static constexpr size_t kMinSourcesPerThread = 32;
+
+    const size_t mNumThreads;
+    std::mutex mLock;
+    unique_fd mKernelWakelockStatsFd;
+    std::unique_ptr<DIR, decltype(&closedir)> mDir GUARDED_BY(mLock);
+    std::vector<Source> mSources GUARDED_BY(mLock);
+    size_t mFdBudget GUARDED_BY(mLock);
+    SysfsReader mReader GUARDED_BY(mLock);
+    std::vector<std::thread> mWorkers GUARDED_BY(mLock);
+
+    // The current read, of which each worker takes a slice besides the calling thread's.
+    std::mutex mScanLock;
+    std::condition_variable mScanCondVar;
+    std::condition_variable mScanDoneCondVar;
+    bool mStopped GUARDED_BY(mScanLock) = false;
+    uint64_t mScanGeneration GUARDED_BY(mScanLock) = 0;
+    size_t mScanNumSlices GUARDED_BY(mScanLock) = 0;
+    size_t mPendingWorkers GUARDED_BY(mScanLock) = 0;
+    const Source* mScanSources GUARDED_BY(mScanLock) = nullptr;
+    size_t mScanNumSources GUARDED_BY(mScanLock) = 0;
+    WakeLockInfo* mScanInfos GUARDED_BY(mScanLock) = nullptr;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Values below kSubBuckets map one to one onto the first kSubBuckets buckets. Every following
+ * group of kSubBuckets buckets covers [2^e, 2^(e+1)) for e = kSubBucketBits .. kMaxExponent - 1.
+ */
+size_t LatencyHistogram::bucketIndex(uint64_t micros) {
+    if (micros < kSubBuckets) {
+        return micros;
+    }
+    int exponent = 63 - __builtin_clzll(micros);
+    if (exponent >= kMaxExponent) {
+        return kNumBuckets - 1;
+    }
+    uint64_t subBucket = (micros >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + subBucket;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    int exponent = index / kSubBuckets + kSubBucketBits - 1;
+    uint64_t subBucket = index % kSubBuckets;
+    uint64_t width = uint64_t{1} << (exponent - kSubBucketBits);
+    return (uint64_t{1} << exponent) + (subBucket + 1) * width - 1;
+}
+
+void LatencyHistogram::record(std::chrono::microseconds latency) {
+    uint64_t micros = std::max<int64_t>(latency.count(), 0);
+    mBuckets[bucketIndex(micros)]++;
+    mCount++;
+    mMaxMicros = std::max(mMaxMicros, micros);
+}
+
+uint64_t LatencyHistogram::percentileMicros(double percentile) const {
+    if (mCount == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(std::ceil(mCount * percentile / 100.0), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), mMaxMicros);
+        }
+    }
+    return mMaxMicros;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
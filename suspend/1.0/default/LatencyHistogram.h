@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * LatencyHistogram records durations in fixed log-linear buckets: every power of two range of
+ * microseconds is split into kSubBuckets linear buckets, bounding the relative error of reported
+ * percentiles to 1 / kSubBuckets. Values of 2^kMaxExponent us (~12.7 days) and above are clamped
+ * into the last bucket.
+ * This class is not thread safe.
+ */
+class LatencyHistogram {
+   public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kNumBuckets = kSubBuckets * (kMaxExponent - kSubBucketBits + 1);
+
+    void record(std::chrono::microseconds latency);
+    uint64_t count() const { return mCount; }
+    uint64_t maxMicros() const { return mMaxMicros; }
+    // Returns an upper bound of the given percentile (in [0, 100]) in microseconds, or 0 if no
+    // values have been recorded.
+    uint64_t percentileMicros(double percentile) const;
+
+    static size_t bucketIndex(uint64_t micros);
+    static uint64_t bucketUpperBound(size_t index);
+
+   private:
+    std::array<uint64_t, kNumBuckets> mBuckets{};
+    uint64_t mCount = 0;
+    uint64_t mMaxMicros = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PostResumeWorker.h"
+
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+PostResumeWorker::PostResumeWorker(size_t capacity, Handler handler)
+    : mHandler(std::move(handler)), mEvents(std::max<size_t>(capacity, 1)) {}
+
+PostResumeWorker::~PostResumeWorker() {
+    {
+        std::scoped_lock lock(mLock);
+        mStopped = true;
+    }
+    mCondVar.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void PostResumeWorker::start() {
+    mThread = std::thread([this] { run(); });
+}
+
+void PostResumeWorker::enqueue(bool success, std::vector<std::string>* wakeupReasons) {
+    {
+        std::scoped_lock lock(mLock);
+        if (mSize == mEvents.size()) {
+            // Drop the oldest pending event rather than blocking the autosuspend loop.
+            mHead = (mHead + 1) % mEvents.size();
+            mSize--;
+            if (mDropped++ == 0) {
+                LOG(WARNING) << "PostResumeWorker: queue full, dropping wakeup events";
+            }
+        }
+
+        Event& event = mEvents[(mHead + mSize) % mEvents.size()];
+        event.success = success;
+        event.wakeupReasons.swap(*wakeupReasons);
+        mSize++;
+        mMaxDepth = std::max(mMaxDepth, mSize);
+    }
+    mCondVar.notify_one();
+}
+
+void PostResumeWorker::run() {
+    Event event;
+    while (true) {
+        {
+            auto lock = std::unique_lock(mLock);
+            mCondVar.wait(lock, [this] { return mStopped || mSize > 0; });
+            if (mStopped) {
+                return;
+            }
+            Event& next = mEvents[mHead];
+            event.success = next.success;
+            event.wakeupReasons.swap(next.wakeupReasons);
+            mHead = (mHead + 1) % mEvents.size();
+            mSize--;
+        }
+
+        mHandler(event.success, event.wakeupReasons);
+
+        std::scoped_lock lock(mLock);
+        mProcessed++;
+    }
+}
+
+PostResumeStats PostResumeWorker::getStats() const {
+    std::scoped_lock lock(mLock);
+
+    PostResumeStats stats;
+    stats.capacity = mEvents.size();
+    stats.depth = mSize;
+    stats.maxDepth = mMaxDepth;
+    stats.processed = mProcessed;
+    stats.dropped = mDropped;
+    return stats;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
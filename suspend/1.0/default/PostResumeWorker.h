@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <utils/Mutex.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+struct PostResumeStats {
+    size_t capacity = 0;
+    // Number of events currently waiting to be processed
+    size_t depth = 0;
+    // Largest number of events that were ever waiting to be processed at once
+    size_t maxDepth = 0;
+    uint64_t processed = 0;
+    // Number of events dropped because the queue was full
+    uint64_t dropped = 0;
+};
+
+/*
+ * PostResumeWorker processes wakeup events on a dedicated thread so that the autosuspend loop is
+ * never gated on slow wakeup callbacks. Events are kept in a bounded queue; when it is full, the
+ * oldest pending event is dropped instead of blocking the caller.
+ * This class is thread safe.
+ */
+class PostResumeWorker {
+   public:
+    using Handler = std::function<void(bool success, std::vector<std::string>& wakeupReasons)>;
+
+    PostResumeWorker(size_t capacity, Handler handler);
+    // Stops the worker thread after it finishes processing the current event, if any. Pending
+    // events are discarded.
+    ~PostResumeWorker();
+    // Starts the worker thread. Must be called at most once.
+    void start();
+    // Queues a wakeup event without blocking. The contents of *wakeupReasons are swapped with a
+    // recycled vector so that steady-state queueing doesn't allocate.
+    void enqueue(bool success, std::vector<std::string>* wakeupReasons);
+    PostResumeStats getStats() const;
+
+   private:
+    struct Event {
+        bool success = false;
+        std::vector<std::string> wakeupReasons;
+    };
+
+    void run();
+
+    const Handler mHandler;
+    std::thread mThread;
+    mutable std::mutex mLock;
+    std::condition_variable mCondVar;
+    bool mStopped GUARDED_BY(mLock) = false;
+    // Ring buffer of pending events, preallocated to the queue capacity.
+    std::vector<Event> mEvents GUARDED_BY(mLock);
+    size_t mHead GUARDED_BY(mLock) = 0;
+    size_t mSize GUARDED_BY(mLock) = 0;
+    size_t mMaxDepth GUARDED_BY(mLock) = 0;
+    uint64_t mProcessed GUARDED_BY(mLock) = 0;
+    uint64_t mDropped GUARDED_BY(mLock) = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
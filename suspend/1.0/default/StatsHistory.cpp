@@ -0,0 +1,300 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StatsHistory.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Stats only go down when they start over, e.g. for a wake lock evicted and added back between
+// two samples.
+static int64_t getGrowth(int64_t previous, int64_t current) {
+    return current >= previous ? current - previous : current;
+}
+
+StatsHistory::StatsHistory(std::chrono::milliseconds samplingInterval, Sampler sampler,
+                           std::vector<Tier> tiers)
+    : kSamplingInterval(samplingInterval),
+      mSampler(std::move(sampler)),
+      kTiers(std::move(tiers)),
+      mIntervals(kTiers.size()) {}
+
+StatsHistory::~StatsHistory() {
+    {
+        std::scoped_lock lock(mLock);
+        mStopped = true;
+    }
+    mCondVar.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void StatsHistory::start() {
+    mThread = std::thread([this] { run(); });
+}
+
+void StatsHistory::onResume() {
+    // Notified under the lock so that the sampling thread can't miss it between checking the time
+    // and waiting.
+    std::scoped_lock lock(mLock);
+    mCondVar.notify_one();
+}
+
+TimestampType StatsHistory::getBoottimeNow() {
+    timespec boottime;
+    clock_gettime(CLOCK_BOOTTIME, &boottime);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::seconds{boottime.tv_sec} + std::chrono::nanoseconds{boottime.tv_nsec})
+        .count();
+}
+
+void StatsHistory::run() {
+    // Reused across samples, wakeLocks also holds the generation to ask for the next changes with.
+    WakeLockStatsDelta wakeLocks;
+    std::vector<WakeupInfo> wakeups;
+    while (true) {
+        wakeups.clear();
+        mSampler(wakeLocks.generation, &wakeLocks, &wakeups);
+        const TimestampType sampleTime = getBoottimeNow();
+        record(sampleTime, wakeLocks, wakeups);
+
+        // The wait stops while the device is suspended, unlike CLOCK_BOOTTIME, so the time left
+        // is checked again whenever it ends, including when onResume() cuts it short.
+        const TimestampType nextSampleTime = sampleTime + kSamplingInterval.count();
+        std::unique_lock<std::mutex> lock(mLock);
+        TimestampType timeLeft = nextSampleTime - getBoottimeNow();
+        while (!mStopped && timeLeft > 0) {
+            mCondVar.wait_for(lock, std::chrono::milliseconds(timeLeft));
+            timeLeft = nextSampleTime - getBoottimeNow();
+        }
+        if (mStopped) {
+            return;
+        }
+    }
+}
+
+void StatsHistory::record(TimestampType timeNow, const WakeLockStatsDelta& wakeLocks,
+                          const std::vector<WakeupInfo>& wakeups) {
+    Interval interval;
+    std::scoped_lock lock(mLock);
+    interval.start = mLastSampleTime;
+    interval.end = timeNow;
+
+    // A full delta holds all of the wake locks, the ones it doesn't hold are gone.
+    std::map<WakeLockKey, Growth> fullWakeLocks;
+    std::map<WakeLockKey, Growth>& lastWakeLocks = wakeLocks.full ? fullWakeLocks : mLastWakeLocks;
+    if (!wakeLocks.full) {
+        for (const WakeLockInfo& info : wakeLocks.removed) {
+            mLastWakeLocks.erase(WakeLockKey(info.isKernelWakelock, info.name, info.pid));
+        }
+    }
+    for (const WakeLockInfo& info : wakeLocks.changed) {
+        WakeLockKey key{info.isKernelWakelock, info.name, info.pid};
+        Growth previous;
+        if (auto it = mLastWakeLocks.find(key); it != mLastWakeLocks.end()) {
+            previous = it->second;
+        }
+        Growth growth{getGrowth(previous.activeCount, info.activeCount),
+                      getGrowth(previous.totalTime, info.totalTime)};
+        lastWakeLocks[key] = {info.activeCount, info.totalTime};
+        if (growth.activeCount > 0 || growth.totalTime > 0) {
+            interval.wakeLocks.emplace_back(std::move(key), growth);
+        }
+    }
+    if (wakeLocks.full) {
+        mLastWakeLocks.swap(fullWakeLocks);
+    }
+
+    std::unordered_map<std::string, int64_t> lastWakeups;
+    for (const WakeupInfo& info : wakeups) {
+        int64_t previous = 0;
+        if (auto it = mLastWakeups.find(info.name); it != mLastWakeups.end()) {
+            previous = it->second;
+        }
+        int64_t growth = getGrowth(previous, info.count);
+        if (growth > 0) {
+            WakeupInfo& wakeup = interval.wakeups.emplace_back();
+            wakeup.name = info.name;
+            wakeup.count = growth;
+        }
+        lastWakeups.emplace(info.name, info.count);
+    }
+    mLastWakeups.swap(lastWakeups);
+
+    mLastSampleTime = timeNow;
+    if (!mHasBaseline) {
+        mHasBaseline = true;
+        return;
+    }
+    capInterval(&interval);
+    addInterval(std::move(interval));
+}
+
+void StatsHistory::addInterval(Interval&& interval) {
+    mIntervals[0].push_back(std::move(interval));
+    for (size_t i = 0; i < kTiers.size(); i++) {
+        std::deque<Interval>& tier = mIntervals[i];
+        if (tier.size() <= kTiers[i].capacity) {
+            break;
+        }
+        if (i + 1 == kTiers.size()) {
+            tier.pop_front();
+            break;
+        }
+        // The oldest intervals of the tier, as many as make up an interval of the next one.
+        size_t count = std::max<size_t>(kTiers[i + 1].width / kTiers[i].width, 1);
+        count = std::min(count, tier.size());
+        mIntervals[i + 1].push_back(mergeIntervals(tier.begin(), tier.begin() + count));
+        tier.erase(tier.begin(), tier.begin() + count);
+    }
+}
+
+StatsHistory::Interval StatsHistory::mergeIntervals(std::deque<Interval>::iterator begin,
+                                                    std::deque<Interval>::iterator end) {
+    Interval merged;
+    merged.start = begin->start;
+    merged.end = (end - 1)->end;
+    std::map<WakeLockKey, Growth> wakeLocks;
+    std::map<std::string, int64_t> wakeups;
+    for (auto interval = begin; interval != end; interval++) {
+        for (auto& [key, growth] : interval->wakeLocks) {
+            Growth& sum = wakeLocks[std::move(key)];
+            sum.activeCount += growth.activeCount;
+            sum.totalTime += growth.totalTime;
+        }
+        for (WakeupInfo& wakeup : interval->wakeups) {
+            wakeups[std::move(wakeup.name)] += wakeup.count;
+        }
+        merged.otherWakeLocks.activeCount += interval->otherWakeLocks.activeCount;
+        merged.otherWakeLocks.totalTime += interval->otherWakeLocks.totalTime;
+        merged.otherWakeups += interval->otherWakeups;
+    }
+
+    merged.wakeLocks.reserve(wakeLocks.size());
+    for (auto& [key, growth] : wakeLocks) {
+        merged.wakeLocks.emplace_back(std::move(key), growth);
+    }
+    merged.wakeups.reserve(wakeups.size());
+    for (auto& [name, count] : wakeups) {
+        WakeupInfo& wakeup = merged.wakeups.emplace_back();
+        wakeup.name = std::move(name);
+        wakeup.count = count;
+    }
+    capInterval(&merged);
+    return merged;
+}
+
+/*
+ * Keeps the kMaxWakeLocks wake locks with the largest growth of total time, and the kMaxWakeups
+ * wakeups with the largest growth of count, adding up the growth of the others.
+ */
+void StatsHistory::capInterval(Interval* interval) {
+    auto& wakeLocks = interval->wakeLocks;
+    if (wakeLocks.size() > kMaxWakeLocks) {
+        std::nth_element(wakeLocks.begin(), wakeLocks.begin() + kMaxWakeLocks, wakeLocks.end(),
+                         [](const auto& a, const auto& b) {
+                             return std::tie(a.second.totalTime, a.second.activeCount) >
+                                    std::tie(b.second.totalTime, b.second.activeCount);
+                         });
+        for (auto it = wakeLocks.begin() + kMaxWakeLocks; it != wakeLocks.end(); it++) {
+            interval->otherWakeLocks.activeCount += it->second.activeCount;
+            interval->otherWakeLocks.totalTime += it->second.totalTime;
+        }
+        wakeLocks.erase(wakeLocks.begin() + kMaxWakeLocks, wakeLocks.end());
+    }
+
+    auto& wakeups = interval->wakeups;
+    if (wakeups.size() > kMaxWakeups) {
+        std::nth_element(
+            wakeups.begin(), wakeups.begin() + kMaxWakeups, wakeups.end(),
+            [](const WakeupInfo& a, const WakeupInfo& b) { return a.count > b.count; });
+        for (auto it = wakeups.begin() + kMaxWakeups; it != wakeups.end(); it++) {
+            interval->otherWakeups += it->count;
+        }
+        wakeups.erase(wakeups.begin() + kMaxWakeups, wakeups.end());
+    }
+}
+
+void StatsHistory::getWindow(TimestampType timeNow, TimestampType window,
+                             StatsWindow* statsWindow) const {
+    std::map<WakeLockKey, Growth> wakeLocks;
+    std::map<std::string, int64_t> wakeups;
+    Growth otherWakeLocks;
+    int64_t otherWakeups = 0;
+    {
+        std::scoped_lock lock(mLock);
+        statsWindow->startTime = statsWindow->endTime = mLastSampleTime;
+        for (const std::deque<Interval>& tier : mIntervals) {
+            for (const Interval& interval : tier) {
+                if (interval.end <= timeNow - window) {
+                    continue;
+                }
+                statsWindow->startTime = std::min(statsWindow->startTime, interval.start);
+                for (const auto& [key, growth] : interval.wakeLocks) {
+                    Growth& sum = wakeLocks[key];
+                    sum.activeCount += growth.activeCount;
+                    sum.totalTime += growth.totalTime;
+                }
+                for (const WakeupInfo& wakeup : interval.wakeups) {
+                    wakeups[wakeup.name] += wakeup.count;
+                }
+                otherWakeLocks.activeCount += interval.otherWakeLocks.activeCount;
+                otherWakeLocks.totalTime += interval.otherWakeLocks.totalTime;
+                otherWakeups += interval.otherWakeups;
+            }
+        }
+    }
+
+    statsWindow->wakeLocks.clear();
+    statsWindow->wakeLocks.reserve(wakeLocks.size());
+    for (auto& [key, growth] : wakeLocks) {
+        WakeLockInfo& info = statsWindow->wakeLocks.emplace_back();
+        info.isKernelWakelock = std::get<0>(key);
+        info.name = std::move(std::get<1>(key));
+        info.pid = std::get<2>(key);
+        info.activeCount = growth.activeCount;
+        info.totalTime = growth.totalTime;
+    }
+    std::sort(statsWindow->wakeLocks.begin(), statsWindow->wakeLocks.end(),
+              [](const WakeLockInfo& a, const WakeLockInfo& b) {
+                  return a.totalTime > b.totalTime;
+              });
+    statsWindow->wakeups.clear();
+    statsWindow->wakeups.reserve(wakeups.size());
+    for (auto& [name, count] : wakeups) {
+        WakeupInfo& wakeup = statsWindow->wakeups.emplace_back();
+        wakeup.name = std::move(name);
+        wakeup.count = count;
+    }
+    std::sort(statsWindow->wakeups.begin(), statsWindow->wakeups.end(),
+              [](const WakeupInfo& a, const WakeupInfo& b) { return a.count > b.count; });
+    statsWindow->otherWakeLockActiveCount = otherWakeLocks.activeCount;
+    statsWindow->otherWakeLockTotalTime = otherWakeLocks.totalTime;
+    statsWindow->otherWakeupCount = otherWakeups;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
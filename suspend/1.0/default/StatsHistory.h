@@ -0,0 +1,140 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/system/suspend/internal/StatsWindow.h>
+#include <android/system/suspend/internal/WakeLockStatsDelta.h>
+#include <android/system/suspend/internal/WakeupInfo.h>
+#include <utils/Mutex.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "WakeLockEntryList.h"
+
+using ::android::system::suspend::internal::StatsWindow;
+using ::android::system::suspend::internal::WakeupInfo;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * StatsHistory keeps how much the wake lock and wakeup stats grew in each recent interval, so that
+ * their growth over a recent window can be summed up without diffing two sets of stats.
+ *
+ * The stats are sampled every sampling interval. Intervals are kept in tiers of growing width, by
+ * default the last hour in 1 minute intervals, the 5 hours before in 10 minute intervals and the
+ * 18 hours before in 1 hour intervals. The oldest intervals of a full tier are merged into one of
+ * the next tier, and the last tier drops its oldest. Each interval keeps the kMaxWakeLocks wake
+ * locks and kMaxWakeups wakeups that grew the most, summing up the others, so that the 108
+ * intervals of the default tiers take at most about 1 MB, and usually much less.
+ *
+ * Times are in ms of CLOCK_BOOTTIME, as returned by getBoottimeNow(), which keeps counting while
+ * the device is suspended so that the intervals span the time spent suspended too.
+ * This class is thread safe.
+ */
+class StatsHistory {
+   public:
+    // Gets the wake lock stats changed since the generation of the previous call, and the wakeup
+    // stats.
+    using Sampler = std::function<void(int64_t sinceGeneration, WakeLockStatsDelta* wakeLocks,
+                                       std::vector<WakeupInfo>* wakeups)>;
+
+    // Intervals spanning width sampling intervals each, up to capacity of them.
+    struct Tier {
+        size_t width;
+        size_t capacity;
+    };
+
+    static constexpr size_t kMaxWakeLocks = 64;
+    static constexpr size_t kMaxWakeups = 16;
+
+    StatsHistory(std::chrono::milliseconds samplingInterval, Sampler sampler,
+                 std::vector<Tier> tiers = {{1, 60}, {10, 30}, {60, 18}});
+    // Stops the sampling thread.
+    ~StatsHistory();
+    // Starts the sampling thread, which takes a first sample right away. Must be called at most
+    // once.
+    void start();
+    // To be called after the device resumes, so that a sample due while it was suspended is taken
+    // right away.
+    void onResume();
+    // Current CLOCK_BOOTTIME in ms, the time base of the history.
+    static TimestampType getBoottimeNow();
+    // Records the stats sampled at timeNow. The first sample only sets the baseline.
+    void record(TimestampType timeNow, const WakeLockStatsDelta& wakeLocks,
+                const std::vector<WakeupInfo>& wakeups);
+    // Sums up the intervals that end within window of timeNow.
+    void getWindow(TimestampType timeNow, TimestampType window, StatsWindow* statsWindow) const;
+
+   private:
+    // Wake locks are told apart by type, name and pid.
+    using WakeLockKey = std::tuple<bool, std::string, int32_t>;
+
+    struct Growth {
+        int64_t activeCount = 0;
+        int64_t totalTime = 0;
+    };
+
+    struct Interval {
+        TimestampType start = 0;
+        TimestampType end = 0;
+        std::vector<std::pair<WakeLockKey, Growth>> wakeLocks;
+        std::vector<WakeupInfo> wakeups;
+        Growth otherWakeLocks;
+        int64_t otherWakeups = 0;
+    };
+
+    void addInterval(Interval&& interval) REQUIRES(mLock);
+    static Interval mergeIntervals(std::deque<Interval>::iterator begin,
+                                   std::deque<Interval>::iterator end);
+    static void capInterval(Interval* interval);
+    void run();
+
+    const std::chrono::milliseconds kSamplingInterval;
+    const Sampler mSampler;
+    const std::vector<Tier> kTiers;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCondVar;
+    bool mStopped GUARDED_BY(mLock) = false;
+    bool mHasBaseline GUARDED_BY(mLock) = false;
+    TimestampType mLastSampleTime GUARDED_BY(mLock) = 0;
+    // Stats of the last sample, the growth is computed from.
+    std::map<WakeLockKey, Growth> mLastWakeLocks GUARDED_BY(mLock);
+    std::unordered_map<std::string, int64_t> mLastWakeups GUARDED_BY(mLock);
+    // Intervals of each tier, oldest first.
+    std::vector<std::deque<Interval>> mIntervals GUARDED_BY(mLock);
+    std::thread mThread;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendBackoffPolicy.h"
+
+#include <algorithm>
+
+using namespace std::chrono_literals;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr const char* kBackoffPolicyTypeNames[] = {
+    "exponential",
+    "ewma",
+    "wakeup_reason",
+};
+
+const char* backoffPolicyTypeName(BackoffPolicyType type) {
+    return kBackoffPolicyTypeNames[static_cast<size_t>(type)];
+}
+
+std::unique_ptr<SuspendBackoffPolicy> createSuspendBackoffPolicy(const SleepTimeConfig& config) {
+    switch (config.backoffPolicy) {
+        case BackoffPolicyType::EWMA:
+            return std::make_unique<EwmaBackoffPolicy>(config);
+        case BackoffPolicyType::WAKEUP_REASON:
+            return std::make_unique<WakeupReasonAwareBackoffPolicy>(config);
+        case BackoffPolicyType::EXPONENTIAL:
+            break;
+    }
+    return std::make_unique<ExponentialBackoffPolicy>(config);
+}
+
+bool isBadSuspend(const SleepTimeConfig& config, const SuspendOutcome& outcome) {
+    bool shortSuspend = outcome.success && (outcome.suspendTime > 0ns) &&
+                        (outcome.suspendTime < config.shortSuspendThreshold);
+
+    return (config.failedSuspendBackoffEnabled && !outcome.success) ||
+           (config.shortSuspendBackoffEnabled && shortSuspend);
+}
+
+ExponentialBackoffPolicy::ExponentialBackoffPolicy(const SleepTimeConfig& config)
+    : kConfig(config), mSleepTime(config.baseSleepTime) {}
+
+BackoffDecision ExponentialBackoffPolicy::update(const SuspendOutcome& outcome) {
+    if (!isBadSuspend(kConfig, outcome)) {
+        mNumConsecutiveBadSuspends = 0;
+        mSleepTime = kConfig.baseSleepTime;
+        return {mSleepTime, BackoffEvent::NONE};
+    }
+
+    // Suspend attempt was bad (failed or short suspend)
+    BackoffEvent event = BackoffEvent::NONE;
+    if (mNumConsecutiveBadSuspends >= kConfig.backoffThreshold) {
+        event = mNumConsecutiveBadSuspends == kConfig.backoffThreshold
+                    ? BackoffEvent::NEW_BACKOFF
+                    : BackoffEvent::CONTINUE_BACKOFF;
+
+        mSleepTime = std::min(std::chrono::round<std::chrono::milliseconds>(
+                                  mSleepTime * kConfig.sleepTimeScaleFactor),
+                              kConfig.maxSleepTime);
+    }
+
+    mNumConsecutiveBadSuspends++;
+    return {mSleepTime, event};
+}
+
+EwmaBackoffPolicy::EwmaBackoffPolicy(const SleepTimeConfig& config, double alpha)
+    : kConfig(config), kAlpha(alpha), mSleepTime(config.baseSleepTime) {}
+
+BackoffDecision EwmaBackoffPolicy::update(const SuspendOutcome& outcome) {
+    double bad = isBadSuspend(kConfig, outcome) ? 1 : 0;
+    mBadSuspendRate = kAlpha * bad + (1 - kAlpha) * mBadSuspendRate;
+
+    // Compare in floating point first, B / (1 - p) overflows milliseconds as p approaches 1.
+    std::chrono::duration<double, std::milli> sleepTime = kConfig.baseSleepTime;
+    if (mBadSuspendRate * kConfig.maxSleepTime >= kConfig.maxSleepTime - kConfig.baseSleepTime) {
+        sleepTime = kConfig.maxSleepTime;
+    } else {
+        sleepTime /= 1 - mBadSuspendRate;
+    }
+
+    bool wasBackingOff = mSleepTime > kConfig.baseSleepTime;
+    mSleepTime = std::clamp(std::chrono::round<std::chrono::milliseconds>(sleepTime),
+                            kConfig.baseSleepTime, kConfig.maxSleepTime);
+
+    BackoffEvent event = BackoffEvent::NONE;
+    if (mSleepTime > kConfig.baseSleepTime) {
+        event = wasBackingOff ? BackoffEvent::CONTINUE_BACKOFF : BackoffEvent::NEW_BACKOFF;
+    }
+    return {mSleepTime, event};
+}
+
+WakeupReasonAwareBackoffPolicy::WakeupReasonAwareBackoffPolicy(const SleepTimeConfig& config)
+    : kConfig(config), mFallback(config) {}
+
+BackoffDecision WakeupReasonAwareBackoffPolicy::update(const SuspendOutcome& outcome) {
+    BackoffDecision decision = mFallback.update(outcome);
+    if (!outcome.success || !outcome.wakeupReasons || outcome.wakeupReasons->empty()) {
+        return decision;
+    }
+
+    mKey.clear();
+    for (const std::string& reason : *outcome.wakeupReasons) {
+        if (!mKey.empty()) mKey += ';';
+        mKey += reason;
+    }
+
+    auto it = mWakeupReasonStats.find(mKey);
+    if (it == mWakeupReasonStats.end()) {
+        if (mWakeupReasonStats.size() >= kMaxTrackedWakeupReasons) {
+            return decision;
+        }
+        it = mWakeupReasonStats.emplace(mKey, WakeupReasonStats{}).first;
+    }
+
+    // Running mean over the first kMinSamples suspends, moving average afterwards so that the
+    // policy adapts if a wakeup source changes behavior.
+    WakeupReasonStats& stats = it->second;
+    double suspendMillis = std::chrono::duration<double, std::milli>(outcome.suspendTime).count();
+    stats.samples = std::min(stats.samples + 1, kMinSamples);
+    stats.averageSuspendMillis += (suspendMillis - stats.averageSuspendMillis) / stats.samples;
+
+    if (stats.samples >= kMinSamples &&
+        stats.averageSuspendMillis < kConfig.shortSuspendThreshold.count()) {
+        decision.sleepTime = std::min(2 * decision.sleepTime, kConfig.maxSleepTime);
+    }
+    return decision;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
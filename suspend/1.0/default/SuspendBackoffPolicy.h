@@ -0,0 +1,190 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+enum class BackoffPolicyType {
+    // Scales the sleep time exponentially after a number of consecutive bad suspends
+    EXPONENTIAL,
+    // Scales the sleep time with a moving average of the recent bad suspend rate
+    EWMA,
+    // Exponential, but also skips attempts after wakeup reasons known to wake the device right away
+    WAKEUP_REASON,
+};
+
+const char* backoffPolicyTypeName(BackoffPolicyType type);
+
+struct SleepTimeConfig {
+    std::chrono::milliseconds baseSleepTime;
+    std::chrono::milliseconds maxSleepTime;
+    double sleepTimeScaleFactor;
+    uint32_t backoffThreshold;
+    std::chrono::milliseconds shortSuspendThreshold;
+    bool failedSuspendBackoffEnabled;
+    bool shortSuspendBackoffEnabled;
+    // If true, the sleep between suspend attempts is cut short as soon as the last native wake
+    // lock is released. Backoff sleep times are still honored.
+    bool eventDrivenAutosuspendEnabled;
+    BackoffPolicyType backoffPolicy;
+};
+
+// Used by the service for the properties that aren't set, and by the backoff simulator.
+constexpr SleepTimeConfig kDefaultSleepTimeConfig = {
+    .baseSleepTime = std::chrono::milliseconds(100),
+    .maxSleepTime = std::chrono::milliseconds(60000),
+    .sleepTimeScaleFactor = 2.0,
+    .backoffThreshold = 0,
+    .shortSuspendThreshold = std::chrono::milliseconds(0),
+    .failedSuspendBackoffEnabled = true,
+    .shortSuspendBackoffEnabled = false,
+    .eventDrivenAutosuspendEnabled = false,
+    .backoffPolicy = BackoffPolicyType::EXPONENTIAL,
+};
+
+// Result of a suspend attempt, as seen by a SuspendBackoffPolicy.
+struct SuspendOutcome {
+    bool success;
+    std::chrono::nanoseconds suspendTime;
+    // Wakeup reasons reported on resume, may be null if unknown.
+    const std::vector<std::string>* wakeupReasons;
+};
+
+enum class BackoffEvent {
+    NONE,
+    // The policy started backing off
+    NEW_BACKOFF,
+    // The policy was already backing off and keeps doing so
+    CONTINUE_BACKOFF,
+};
+
+struct BackoffDecision {
+    // Time to wait before the next suspend attempt
+    std::chrono::milliseconds sleepTime;
+    BackoffEvent event;
+};
+
+/*
+ * A SuspendBackoffPolicy decides how long the autosuspend loop waits between suspend attempts.
+ * Implementations are not thread safe; SystemSuspend only calls them from the autosuspend thread.
+ */
+class SuspendBackoffPolicy {
+   public:
+    virtual ~SuspendBackoffPolicy() = default;
+    virtual BackoffPolicyType type() const = 0;
+    // Returns how long to wait before the next suspend attempt given the outcome of the last one.
+    virtual BackoffDecision update(const SuspendOutcome& outcome) = 0;
+};
+
+std::unique_ptr<SuspendBackoffPolicy> createSuspendBackoffPolicy(const SleepTimeConfig& config);
+
+// Returns true if the suspend attempt counts as bad for backoff purposes under config.
+bool isBadSuspend(const SleepTimeConfig& config, const SuspendOutcome& outcome);
+
+/*
+ * Time (in milliseconds) between suspend attempts is described the formula
+ * t[n] = { B, 0 < n <= N
+ *        { min(B * (S**(n - N)), M), n > N
+ * where:
+ *   n is the number of consecutive bad suspend attempts,
+ *   B = baseSleepTime,
+ *   N = backoffThreshold,
+ *   S = sleepTimeScaleFactor,
+ *   M = maxSleepTime
+ *
+ * failedSuspendBackoffEnabled determines whether a failed suspend is counted as a bad suspend
+ *
+ * shortSuspendBackoffEnabled determines whether a suspend whose duration
+ * t < shortSuspendThreshold is counted as a bad suspend
+ */
+class ExponentialBackoffPolicy : public SuspendBackoffPolicy {
+   public:
+    explicit ExponentialBackoffPolicy(const SleepTimeConfig& config);
+    BackoffPolicyType type() const override { return BackoffPolicyType::EXPONENTIAL; }
+    BackoffDecision update(const SuspendOutcome& outcome) override;
+
+   private:
+    const SleepTimeConfig kConfig;
+    std::chrono::milliseconds mSleepTime;
+    uint32_t mNumConsecutiveBadSuspends = 0;
+};
+
+/*
+ * Tracks an exponentially weighted moving average p of the bad suspend rate and spaces attempts
+ * by B / (1 - p), capped at M: the expected wait until the next good suspend if attempts were
+ * independent. Reacts to a single bad suspend instead of waiting for N in a row, and relaxes
+ * gradually instead of dropping straight back to B after one good suspend.
+ */
+class EwmaBackoffPolicy : public SuspendBackoffPolicy {
+   public:
+    // Weight of the latest suspend attempt in the moving average
+    static constexpr double kDefaultAlpha = 0.25;
+
+    explicit EwmaBackoffPolicy(const SleepTimeConfig& config, double alpha = kDefaultAlpha);
+    BackoffPolicyType type() const override { return BackoffPolicyType::EWMA; }
+    BackoffDecision update(const SuspendOutcome& outcome) override;
+
+   private:
+    const SleepTimeConfig kConfig;
+    const double kAlpha;
+    double mBadSuspendRate = 0;
+    std::chrono::milliseconds mSleepTime;
+};
+
+/*
+ * Exponential backoff, plus per wakeup reason tracking of how long successful suspends that ended
+ * with that reason lasted. Once a reason is known to wake the device within shortSuspendThreshold,
+ * the next attempt after it is skipped, i.e. the wait is extended by one more sleep period, since
+ * the same source is likely to fire again right away.
+ */
+class WakeupReasonAwareBackoffPolicy : public SuspendBackoffPolicy {
+   public:
+    // Number of suspends a reason must have ended before its average duration is trusted
+    static constexpr uint32_t kMinSamples = 3;
+    // Number of distinct wakeup reasons tracked, suspends ending with other reasons are ignored
+    static constexpr size_t kMaxTrackedWakeupReasons = 64;
+
+    explicit WakeupReasonAwareBackoffPolicy(const SleepTimeConfig& config);
+    BackoffPolicyType type() const override { return BackoffPolicyType::WAKEUP_REASON; }
+    BackoffDecision update(const SuspendOutcome& outcome) override;
+
+   private:
+    struct WakeupReasonStats {
+        double averageSuspendMillis = 0;
+        uint32_t samples = 0;
+    };
+
+    const SleepTimeConfig kConfig;
+    ExponentialBackoffPolicy mFallback;
+    std::unordered_map<std::string, WakeupReasonStats> mWakeupReasonStats;
+    // Reused to build the lookup key from the wakeup reasons without allocating.
+    std::string mKey;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
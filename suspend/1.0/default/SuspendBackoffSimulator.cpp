@@ -0,0 +1,151 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendBackoffSimulator.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static std::string_view nextField(std::string_view* line) {
+    size_t start = line->find_first_not_of(" \t");
+    if (start == std::string_view::npos) {
+        *line = {};
+        return {};
+    }
+    line->remove_prefix(start);
+    size_t end = std::min(line->find_first_of(" \t"), line->size());
+    std::string_view field = line->substr(0, end);
+    line->remove_prefix(end);
+    return field;
+}
+
+static bool parseInt64(std::string_view field, int64_t* value) {
+    auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(), *value);
+    return ec == std::errc() && end == field.data() + field.size();
+}
+
+bool parseSuspendTraceEntry(std::string_view line, SuspendTraceEntry* entry) {
+    int64_t endTimeMillis, sleepTimeMillis;
+    if (!parseInt64(nextField(&line), &entry->startTimeMillis) ||
+        !parseInt64(nextField(&line), &endTimeMillis)) {
+        return false;
+    }
+
+    std::string_view result = nextField(&line);
+    if (result != "ok" && result != "failed") {
+        return false;
+    }
+    entry->success = result == "ok";
+
+    if (!parseInt64(nextField(&line), &entry->suspendTimeMillis) ||
+        !parseInt64(nextField(&line), &entry->suspendOverheadTimeMillis) ||
+        !parseInt64(nextField(&line), &sleepTimeMillis)) {
+        return false;
+    }
+
+    // The wakeup reasons are the rest of the line, joined with ';'. Reasons may contain spaces.
+    size_t start = line.find_first_not_of(" \t");
+    size_t end = line.find_last_not_of(" \t\r\n");
+    entry->wakeupReasons.clear();
+    if (start == std::string_view::npos) {
+        return true;
+    }
+    line = line.substr(start, end - start + 1);
+    while (true) {
+        size_t separator = line.find(';');
+        entry->wakeupReasons.emplace_back(line.substr(0, separator));
+        if (separator == std::string_view::npos) break;
+        line.remove_prefix(separator + 1);
+    }
+    return true;
+}
+
+SimulationResult simulateSuspendBackoff(const SleepTimeConfig& config, SuspendBackoffPolicy* policy,
+                                        const std::vector<SuspendTraceEntry>& trace) {
+    SimulationResult result;
+    if (trace.empty()) {
+        return result;
+    }
+
+    // Recorded start times are CLOCK_MONOTONIC, which stops while suspended. Add back the time
+    // suspended so far to lay the attempts out on the simulated timeline.
+    std::vector<int64_t> windowStart(trace.size());
+    int64_t recordedSuspendedMillis = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        windowStart[i] =
+            trace[i].startTimeMillis - trace[0].startTimeMillis + recordedSuspendedMillis;
+        if (trace[i].success) {
+            recordedSuspendedMillis += trace[i].suspendTimeMillis;
+        }
+    }
+    const SuspendTraceEntry& last = trace.back();
+    const int64_t endMillis = windowStart.back() + last.suspendOverheadTimeMillis +
+                              (last.success ? last.suspendTimeMillis : 0);
+
+    int64_t nowMillis = 0;
+    size_t window = 0;
+    while (nowMillis < endMillis) {
+        while (window + 1 < trace.size() && windowStart[window + 1] <= nowMillis) {
+            window++;
+        }
+        const SuspendTraceEntry& entry = trace[window];
+        const std::chrono::milliseconds suspendTime(entry.suspendTimeMillis);
+        const SuspendOutcome outcome = {
+            .success = entry.success,
+            .suspendTime = suspendTime,
+            .wakeupReasons = &entry.wakeupReasons,
+        };
+
+        result.attempts++;
+        bool shortSuspend = entry.success && entry.suspendTimeMillis > 0 &&
+                            suspendTime < config.shortSuspendThreshold;
+        if (!entry.success) {
+            result.failedAttempts++;
+            result.wastedOverheadMillis += entry.suspendOverheadTimeMillis;
+        } else if (shortSuspend) {
+            result.shortAttempts++;
+            result.wastedOverheadMillis += entry.suspendOverheadTimeMillis;
+        }
+
+        // Time past the end of the trace isn't accounted for, so that awake and suspended time add
+        // up to the same total for every policy.
+        int64_t overheadMillis = std::min(entry.suspendOverheadTimeMillis, endMillis - nowMillis);
+        result.awakeMillis += overheadMillis;
+        nowMillis += overheadMillis;
+        if (entry.success) {
+            int64_t suspendedMillis = std::min(entry.suspendTimeMillis, endMillis - nowMillis);
+            result.suspendedMillis += suspendedMillis;
+            nowMillis += suspendedMillis;
+        }
+
+        // Always make progress, even with a zero base sleep time.
+        int64_t sleepMillis = std::min<int64_t>(
+            std::max<int64_t>(policy->update(outcome).sleepTime.count(), 1), endMillis - nowMillis);
+        result.awakeMillis += sleepMillis;
+        nowMillis += sleepMillis;
+    }
+    return result;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
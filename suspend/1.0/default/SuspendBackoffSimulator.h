@@ -0,0 +1,69 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SuspendBackoffPolicy.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// A recorded suspend attempt, as printed by "dumpsys suspend_control_internal --history".
+struct SuspendTraceEntry {
+    // CLOCK_MONOTONIC time at which the attempt started
+    int64_t startTimeMillis;
+    bool success;
+    int64_t suspendTimeMillis;
+    int64_t suspendOverheadTimeMillis;
+    std::vector<std::string> wakeupReasons;
+};
+
+// Parses one row of the --history dump. Returns false for the header and malformed lines.
+bool parseSuspendTraceEntry(std::string_view line, SuspendTraceEntry* entry);
+
+struct SimulationResult {
+    uint64_t attempts = 0;
+    uint64_t failedAttempts = 0;
+    uint64_t shortAttempts = 0;
+    // Overhead of failed and short suspends
+    int64_t wastedOverheadMillis = 0;
+    // Time spent between suspend attempts and suspending/resuming
+    int64_t awakeMillis = 0;
+    int64_t suspendedMillis = 0;
+};
+
+/*
+ * Replays a trace of recorded suspend attempts through a backoff policy.
+ *
+ * The trace is laid out on a timeline that includes suspended time. Each recorded attempt is
+ * assumed to describe the outcome of any attempt made between its start and the start of the next
+ * recorded attempt. The simulation starts at the first recorded attempt, then alternates between
+ * waiting for the time returned by the policy and making an attempt whose outcome is looked up in
+ * the trace, until it runs past the end of the trace.
+ */
+SimulationResult simulateSuspendBackoff(const SleepTimeConfig& config, SuspendBackoffPolicy* policy,
+                                        const std::vector<SuspendTraceEntry>& trace);
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a suspend history captured with "dumpsys suspend_control_internal --history" through
+// each backoff policy, e.g.
+//   adb shell dumpsys suspend_control_internal --history > trace.txt
+//   suspend_backoff_simulator --short_suspend_threshold_millis=500 trace.txt
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "SuspendBackoffSimulator.h"
+
+using android::system::suspend::V1_0::BackoffPolicyType;
+using android::system::suspend::V1_0::backoffPolicyTypeName;
+using android::system::suspend::V1_0::createSuspendBackoffPolicy;
+using android::system::suspend::V1_0::kDefaultSleepTimeConfig;
+using android::system::suspend::V1_0::parseSuspendTraceEntry;
+using android::system::suspend::V1_0::SimulationResult;
+using android::system::suspend::V1_0::simulateSuspendBackoff;
+using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendTraceEntry;
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options] <history dump>\n"
+            "  --base_sleep_time_millis=N\n"
+            "  --max_sleep_time_millis=N\n"
+            "  --sleep_time_scale_factor=F\n"
+            "  --backoff_threshold_count=N\n"
+            "  --short_suspend_threshold_millis=N\n"
+            "  --no_failed_suspend_backoff\n"
+            "  --short_suspend_backoff\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    SleepTimeConfig config = kDefaultSleepTimeConfig;
+
+    static const struct option kOptions[] = {
+        {"base_sleep_time_millis", required_argument, nullptr, 'b'},
+        {"max_sleep_time_millis", required_argument, nullptr, 'm'},
+        {"sleep_time_scale_factor", required_argument, nullptr, 's'},
+        {"backoff_threshold_count", required_argument, nullptr, 't'},
+        {"short_suspend_threshold_millis", required_argument, nullptr, 'S'},
+        {"no_failed_suspend_backoff", no_argument, nullptr, 'F'},
+        {"short_suspend_backoff", no_argument, nullptr, 'B'},
+        {nullptr, 0, nullptr, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", kOptions, nullptr)) != -1) {
+        switch (opt) {
+            case 'b':
+                config.baseSleepTime = std::chrono::milliseconds(atoll(optarg));
+                break;
+            case 'm':
+                config.maxSleepTime = std::chrono::milliseconds(atoll(optarg));
+                break;
+            case 's':
+                config.sleepTimeScaleFactor = atof(optarg);
+                break;
+            case 't':
+                config.backoffThreshold = atoi(optarg);
+                break;
+            case 'S':
+                config.shortSuspendThreshold = std::chrono::milliseconds(atoll(optarg));
+                break;
+            case 'F':
+                config.failedSuspendBackoffEnabled = false;
+                break;
+            case 'B':
+                config.shortSuspendBackoffEnabled = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream input(argv[optind]);
+    if (!input) {
+        fprintf(stderr, "failed to open %s\n", argv[optind]);
+        return 1;
+    }
+    std::vector<SuspendTraceEntry> trace;
+    SuspendTraceEntry entry;
+    for (std::string line; std::getline(input, line);) {
+        if (parseSuspendTraceEntry(line, &entry)) {
+            trace.push_back(entry);
+        }
+    }
+    if (trace.empty()) {
+        fprintf(stderr, "no suspend attempts found in %s\n", argv[optind]);
+        return 1;
+    }
+
+    printf("%zu recorded suspend attempts\n", trace.size());
+    printf("%-14s %10s %10s %10s %14s %14s %14s\n", "POLICY", "ATTEMPTS", "FAILED", "SHORT",
+           "WASTED (ms)", "AWAKE (ms)", "SUSPENDED (ms)");
+    for (auto type : {BackoffPolicyType::EXPONENTIAL, BackoffPolicyType::EWMA,
+                      BackoffPolicyType::WAKEUP_REASON}) {
+        config.backoffPolicy = type;
+        auto policy = createSuspendBackoffPolicy(config);
+        SimulationResult result = simulateSuspendBackoff(config, policy.get(), trace);
+        printf("%-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %14" PRId64 " %14" PRId64
+               " %14" PRId64 "\n",
+               backoffPolicyTypeName(type), result.attempts, result.failedAttempts,
+               result.shortAttempts, result.wastedOverheadMillis, result.awakeMillis,
+               result.suspendedMillis);
+    }
+    return 0;
+}
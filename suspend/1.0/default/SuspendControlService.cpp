@@ -16,14 +16,22 @@
 
 #include "SuspendControlService.h"
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <binder/IPCThreadState.h>
+#include <inttypes.h>
 #include <signal.h>
 
+#include <algorithm>
+#include <chrono>
+
+#include "BinaryDump.h"
 #include "SystemSuspend.h"
 
 using ::android::base::Result;
 using ::android::base::StringPrintf;
+using ::android::base::WriteStringToFd;
 
 namespace android {
 namespace system {
@@ -34,6 +42,14 @@ static void register_sig_handler() {
     signal(SIGPIPE, SIG_IGN);
 }
 
+// Ages past a day are as good as any snapshot, and would overflow once added to a time point.
+static std::chrono::milliseconds toMaxKernelStatsAge(int64_t maxKernelStatsAgeMillis) {
+    constexpr int64_t kMaxKernelStatsAgeMillis =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::hours(24)).count();
+    return std::chrono::milliseconds(
+        std::clamp<int64_t>(maxKernelStatsAgeMillis, 0, kMaxKernelStatsAgeMillis));
+}
+
 template <typename T>
 binder::Status retOk(const T& value, T* ret_val) {
     *ret_val = value;
@@ -134,6 +150,31 @@ void SuspendControlService::notifyWakelock(const std::string& name, bool isAcqui
     }
 }
 
+// Batched version of notifyWakelock() that takes mWakelockCallbackLock once.
+void SuspendControlService::notifyWakelocks(const std::vector<std::string>& names,
+                                            bool isAcquired) {
+    auto callbackLock = std::unique_lock(mWakelockCallbackLock);
+    if (mWakelockCallbacks.empty()) {
+        return;
+    }
+    std::vector<sp<IWakelockCallback>> callbacksCopy;
+    for (const std::string& name : names) {
+        auto it = mWakelockCallbacks.find(name);
+        if (it != mWakelockCallbacks.end()) {
+            callbacksCopy.insert(callbacksCopy.end(), it->second.begin(), it->second.end());
+        }
+    }
+    callbackLock.unlock();
+
+    for (const auto& callback : callbacksCopy) {
+        if (isAcquired) {
+            callback->notifyAcquired().isOk();  // ignore errors
+        } else {
+            callback->notifyReleased().isOk();  // ignore errors
+        }
+    }
+}
+
 void SuspendControlService::notifyWakeup(bool success, std::vector<std::string>& wakeupReasons) {
     // A callback could potentially modify mCallbacks (e.g., via registerCallback). That must not
     // result in a deadlock. To that end, we make a copy of mCallbacks and release mCallbackLock
@@ -161,6 +202,69 @@ binder::Status SuspendControlServiceInternal::forceSuspend(bool* _aidl_return) {
     return retOk(suspendService != nullptr && suspendService->forceSuspend(), _aidl_return);
 }
 
+binder::Status SuspendControlServiceInternal::acquireWakeLocks(
+    const std::vector<std::string>& names, sp<IWakeLockBatch>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    *_aidl_return =
+        suspendService->acquireWakeLocks(names, IPCThreadState::self()->getCallingPid());
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::acquireWakeLockToken(const sp<IBinder>& client,
+                                                                  const std::string& name,
+                                                                  int64_t* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+    if (!client) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("Null client"));
+    }
+
+    IPCThreadState* ipc = IPCThreadState::self();
+    status_t status = suspendService->acquireWakeLockToken(
+        client, this, name, ipc->getCallingPid(), ipc->getCallingUid(), _aidl_return);
+    if (status != NO_ERROR) {
+        LOG(ERROR) << __func__ << " Cannot link to death: " << status;
+        return binder::Status::fromStatusT(status);
+    }
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::releaseWakeLockToken(int64_t token) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    uid_t uid = IPCThreadState::self()->getCallingUid();
+    status_t status = suspendService->releaseWakeLockToken(token, uid, this);
+    if (status == PERMISSION_DENIED) {
+        LOG(WARNING) << __func__ << " Wake lock token " << token << " not held by uid " << uid;
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_SECURITY,
+                                                 String8("Wake lock token held by another uid"));
+    }
+    if (status != NO_ERROR) {
+        LOG(WARNING) << __func__ << " Unknown wake lock token: " << token;
+    }
+    return binder::Status::ok();
+}
+
+void SuspendControlServiceInternal::binderDied(const wp<IBinder>& who) {
+    const auto suspendService = mSuspend.promote();
+    if (suspendService) {
+        suspendService->releaseWakeLockTokens(who.unsafe_get());
+    }
+}
+
 binder::Status SuspendControlServiceInternal::getSuspendStats(SuspendInfo* _aidl_return) {
     const auto suspendService = mSuspend.promote();
     if (!suspendService) {
@@ -186,6 +290,97 @@ binder::Status SuspendControlServiceInternal::getWakeLockStats(
     return binder::Status::ok();
 }
 
+binder::Status SuspendControlServiceInternal::getWakeLockStatsWithMaxAge(
+    int64_t maxKernelStatsAgeMillis, std::vector<WakeLockInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+    if (maxKernelStatsAgeMillis < 0) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("Negative max age"));
+    }
+
+    suspendService->updateStatsNow();
+    suspendService->getStatsList().getWakeLockStats(toMaxKernelStatsAge(maxKernelStatsAgeMillis),
+                                                    _aidl_return);
+
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getWakeLockStatsDelta(
+    int64_t sinceGeneration, WakeLockStatsDelta* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->updateStatsNow();
+    suspendService->getStatsList().getWakeLockStatsDelta(sinceGeneration, _aidl_return);
+
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getTopWakeLockStats(
+    int32_t metric, int32_t k, int64_t maxKernelStatsAgeMillis,
+    std::vector<WakeLockInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+    if (metric < 0 || metric >= static_cast<int32_t>(kNumWakeLockMetrics)) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("Unknown metric"));
+    }
+    if (k < 0 || k > static_cast<int32_t>(kMaxTopWakeLocks)) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("k out of range"));
+    }
+    if (maxKernelStatsAgeMillis < 0) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("Negative max age"));
+    }
+
+    suspendService->updateStatsNow();
+    suspendService->getStatsList().getTopWakeLockStats(
+        static_cast<WakeLockMetric>(metric), k, toMaxKernelStatsAge(maxKernelStatsAgeMillis),
+        _aidl_return);
+
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getWakeLockHoldTimes(
+    std::vector<WakeLockHoldTimes>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getStatsList().getWakeLockHoldTimes(_aidl_return);
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getStatsWindow(int64_t windowMillis,
+                                                            StatsWindow* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+    if (windowMillis < 0) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_ILLEGAL_ARGUMENT,
+                                                 String8("Negative window"));
+    }
+
+    suspendService->getStatsHistory().getWindow(StatsHistory::getBoottimeNow(), windowMillis,
+                                                _aidl_return);
+    return binder::Status::ok();
+}
+
 binder::Status SuspendControlServiceInternal::getWakeupStats(
     std::vector<WakeupInfo>* _aidl_return) {
     const auto suspendService = mSuspend.promote();
@@ -198,19 +393,155 @@ binder::Status SuspendControlServiceInternal::getWakeupStats(
     return binder::Status::ok();
 }
 
+binder::Status SuspendControlServiceInternal::getSuspendLatencyStats(
+    std::vector<SuspendPhaseLatency>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getSuspendLatencyStats(_aidl_return);
+    return binder::Status::ok();
+}
+
+binder::Status SuspendControlServiceInternal::getSuspendHistory(
+    std::vector<SuspendAttemptInfo>* _aidl_return) {
+    const auto suspendService = mSuspend.promote();
+    if (!suspendService) {
+        return binder::Status::fromExceptionCode(binder::Status::Exception::EX_NULL_POINTER,
+                                                 String8("Null reference to suspendService"));
+    }
+
+    suspendService->getSuspendHistory(_aidl_return);
+    return binder::Status::ok();
+}
+
 static std::string dumpUsage() {
     return "\nUsage: adb shell dumpsys suspend_control_internal [option]\n\n"
            "   Options:\n"
            "       --wakelocks        : returns wakelock stats.\n"
+           "       --histograms       : with --wakelocks, also returns how many times each\n"
+           "                            native wakelock was held for how long.\n"
            "       --wakeups          : returns wakeup stats.\n"
            "       --kernel_suspends  : returns suspend success/error stats from the kernel\n"
            "       --suspend_controls : returns suspend control stats\n"
+           "       --latency          : returns suspend attempt latency percentiles\n"
+           "       --history          : returns the most recent suspend attempts\n"
+           "       --binary           : returns the wakelock, wakeup, kernel suspend and suspend\n"
+           "                            control stats asked for in a compact binary format.\n"
            "       --all or -a        : returns all stats.\n"
            "       --help or -h       : prints this message.\n\n"
            "   Note: All stats are returned  if no or (an\n"
            "         invalid) option is specified.\n\n";
 }
 
+static void addStat(std::vector<DumpedStat>* stats, const char* name, int64_t value) {
+    DumpedStat& stat = stats->emplace_back();
+    stat.name = name;
+    stat.value = value;
+}
+
+static void addStringStat(std::vector<DumpedStat>* stats, const char* name, std::string value) {
+    DumpedStat& stat = stats->emplace_back();
+    stat.name = name;
+    stat.isString = true;
+    stat.stringValue = std::move(value);
+}
+
+/*
+ * Writes the wakelock, wakeup, kernel suspend and suspend control stats, as selected by the
+ * --wakelocks, --wakeups, --kernel_suspends and --suspend_controls options, in the format of
+ * BinaryDump.h.
+ */
+static void dumpBinary(int fd, bool wakeLocks, bool wakeups, bool kernelSuspends,
+                       bool suspendControls, SystemSuspend* suspendService) {
+    BinaryDump dump;
+
+    if (wakeLocks) {
+        suspendService->updateStatsNow();
+        std::vector<WakeLockInfo> wlStats;
+        suspendService->getStatsList().getWakeLockStats(&wlStats);
+        dump.wakeLocks.reserve(wlStats.size());
+        for (WakeLockInfo& info : wlStats) {
+            DumpedWakeLock& wakeLock = dump.wakeLocks.emplace_back();
+            wakeLock.name = std::move(info.name);
+            wakeLock.isKernelWakelock = info.isKernelWakelock;
+            wakeLock.isActive = info.isActive;
+            wakeLock.pid = info.pid;
+            wakeLock.activeCount = info.activeCount;
+            wakeLock.lastChange = info.lastChange;
+            wakeLock.maxTime = info.maxTime;
+            wakeLock.totalTime = info.totalTime;
+            wakeLock.activeTime = info.activeTime;
+            wakeLock.eventCount = info.eventCount;
+            wakeLock.expireCount = info.expireCount;
+            wakeLock.preventSuspendTime = info.preventSuspendTime;
+            wakeLock.wakeupCount = info.wakeupCount;
+        }
+    }
+
+    if (wakeups) {
+        std::vector<WakeupInfo> wakeupStats;
+        suspendService->getWakeupList().getWakeupStats(&wakeupStats);
+        dump.wakeups.reserve(wakeupStats.size());
+        for (WakeupInfo& info : wakeupStats) {
+            dump.wakeups.push_back({std::move(info.name), info.count});
+        }
+    }
+
+    if (kernelSuspends) {
+        Result<SuspendStats> res = suspendService->getSuspendStats();
+        if (res.ok()) {
+            const SuspendStats& stats = res.value();
+            std::vector<DumpedStat>* out = &dump.kernelSuspendStats;
+            addStat(out, "success", stats.success);
+            addStat(out, "fail", stats.fail);
+            addStat(out, "failed_freeze", stats.failedFreeze);
+            addStat(out, "failed_prepare", stats.failedPrepare);
+            addStat(out, "failed_suspend", stats.failedSuspend);
+            addStat(out, "failed_suspend_late", stats.failedSuspendLate);
+            addStat(out, "failed_suspend_noirq", stats.failedSuspendNoirq);
+            addStat(out, "failed_resume", stats.failedResume);
+            addStat(out, "failed_resume_early", stats.failedResumeEarly);
+            addStat(out, "failed_resume_noirq", stats.failedResumeNoirq);
+            addStringStat(out, "last_failed_dev", stats.lastFailedDev);
+            addStat(out, "last_failed_errno", stats.lastFailedErrno);
+            addStringStat(out, "last_failed_step", stats.lastFailedStep);
+        } else {
+            LOG(ERROR) << "SuspendControlService: " << res.error().message();
+        }
+    }
+
+    if (suspendControls) {
+        SuspendInfo info;
+        suspendService->getSuspendInfo(&info);
+        PostResumeStats postResume = suspendService->getPostResumeStats();
+        std::vector<DumpedStat>* out = &dump.suspendInfo;
+        addStat(out, "suspend_attempts", info.suspendAttemptCount);
+        addStat(out, "failed_suspends", info.failedSuspendCount);
+        addStat(out, "short_suspends", info.shortSuspendCount);
+        addStat(out, "total_suspend_time_ms", info.suspendTimeMillis);
+        addStat(out, "short_suspend_time_ms", info.shortSuspendTimeMillis);
+        addStat(out, "suspend_overhead_ms", info.suspendOverheadTimeMillis);
+        addStat(out, "failed_suspend_overhead_ms", info.failedSuspendOverheadTimeMillis);
+        addStringStat(out, "backoff_policy",
+                      backoffPolicyTypeName(suspendService->getBackoffPolicy()));
+        addStat(out, "new_backoffs", info.newBackoffCount);
+        addStat(out, "backoff_continuations", info.backoffContinueCount);
+        addStat(out, "total_sleep_time_between_suspends_ms", info.sleepTimeMillis);
+        addStat(out, "post_resume_queue_depth", postResume.depth);
+        addStat(out, "post_resume_queue_capacity", postResume.capacity);
+        addStat(out, "post_resume_queue_max_depth", postResume.maxDepth);
+        addStat(out, "post_resume_wakeups_processed", postResume.processed);
+        addStat(out, "post_resume_wakeups_dropped", postResume.dropped);
+    }
+
+    if (!WriteStringToFd(encodeBinaryDump(dump), fd)) {
+        PLOG(ERROR) << "SuspendControlService: Error writing binary dump";
+    }
+}
+
 status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& args) {
     register_sig_handler();
 
@@ -224,9 +555,13 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         OPT_WAKEUPS = 1 << 1,
         OPT_KERNEL_SUSPENDS = 1 << 2,
         OPT_SUSPEND_CONTROLS = 1 << 3,
+        OPT_LATENCY = 1 << 4,
+        OPT_HISTORY = 1 << 5,
         OPT_ALL = ~0,
     };
     int opts = 0;
+    bool binary = false;
+    bool histograms = false;
 
     if (args.empty()) {
         opts = OPT_ALL;
@@ -240,6 +575,14 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
                 opts |= OPT_KERNEL_SUSPENDS;
             } else if (arg == String16("--suspend_controls")) {
                 opts |= OPT_SUSPEND_CONTROLS;
+            } else if (arg == String16("--latency")) {
+                opts |= OPT_LATENCY;
+            } else if (arg == String16("--history")) {
+                opts |= OPT_HISTORY;
+            } else if (arg == String16("--binary")) {
+                binary = true;
+            } else if (arg == String16("--histograms")) {
+                histograms = true;
             } else if (arg == String16("-a") || arg == String16("--all")) {
                 opts = OPT_ALL;
             } else if (arg == String16("-h") || arg == String16("--help")) {
@@ -250,11 +593,25 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         }
     }
 
+    if (binary) {
+        // Binary dumps cover all of their sections unless some were asked for.
+        if (opts == 0) {
+            opts = OPT_ALL;
+        }
+        dumpBinary(fd, opts & OPT_WAKELOCKS, opts & OPT_WAKEUPS, opts & OPT_KERNEL_SUSPENDS,
+                   opts & OPT_SUSPEND_CONTROLS, suspendService.get());
+        return OK;
+    }
+
     if (opts & OPT_WAKELOCKS) {
         suspendService->updateStatsNow();
-        std::stringstream wlStats;
-        wlStats << suspendService->getStatsList();
-        dprintf(fd, "\n%s\n", wlStats.str().c_str());
+        dprintf(fd, "\n");
+        suspendService->getStatsList().dump(fd);
+        dprintf(fd, "\n");
+        if (histograms) {
+            suspendService->getStatsList().dumpHoldTimes(fd);
+            dprintf(fd, "\n");
+        }
     }
 
     if (opts & OPT_WAKEUPS) {
@@ -315,13 +672,54 @@ status_t SuspendControlServiceInternal::dump(int fd, const Vector<String16>& arg
         suspendInfo << "suspend overhead: " << info.suspendOverheadTimeMillis << " ms" << std::endl;
         suspendInfo << "failed suspend overhead: " << info.failedSuspendOverheadTimeMillis << " ms"
                     << std::endl;
+        suspendInfo << "backoff policy: "
+                    << backoffPolicyTypeName(suspendService->getBackoffPolicy()) << std::endl;
         suspendInfo << "new backoffs: " << info.newBackoffCount << std::endl;
         suspendInfo << "backoff continuations: " << info.backoffContinueCount << std::endl;
         suspendInfo << "total sleep time between suspends: " << info.sleepTimeMillis << " ms"
                     << std::endl;
+
+        PostResumeStats postResume = suspendService->getPostResumeStats();
+        suspendInfo << "post-resume queue depth: " << postResume.depth << "/"
+                    << postResume.capacity << std::endl;
+        suspendInfo << "post-resume queue max depth: " << postResume.maxDepth << std::endl;
+        suspendInfo << "post-resume wakeups processed: " << postResume.processed << std::endl;
+        suspendInfo << "post-resume wakeups dropped: " << postResume.dropped << std::endl;
         dprintf(fd, "Suspend Info:\n%s\n", suspendInfo.str().c_str());
     }
 
+    if (opts & OPT_LATENCY) {
+        std::vector<SuspendPhaseLatency> latencies;
+        suspendService->getSuspendLatencyStats(&latencies);
+        std::string suspendLatency = StringPrintf("%-20s %10s %12s %12s %12s %12s\n", "PHASE",
+                                                  "COUNT", "P50 (us)", "P95 (us)", "P99 (us)",
+                                                  "MAX (us)");
+        for (const auto& l : latencies) {
+            suspendLatency += StringPrintf("%-20s %10" PRId64 " %12" PRId64 " %12" PRId64
+                                           " %12" PRId64 " %12" PRId64 "\n",
+                                           l.phase.c_str(), l.count, l.p50Micros, l.p95Micros,
+                                           l.p99Micros, l.maxMicros);
+        }
+        dprintf(fd, "Suspend Latency:\n%s\n", suspendLatency.c_str());
+    }
+
+    if (opts & OPT_HISTORY) {
+        std::vector<SuspendAttemptInfo> history;
+        suspendService->getSuspendHistory(&history);
+        std::string suspendHistory =
+            StringPrintf("%14s %14s %7s %13s %13s %13s  %s\n", "START (ms)", "END (ms)", "RESULT",
+                         "SUSPEND (ms)", "OVERHEAD (ms)", "SLEEP (ms)", "WAKEUP REASON");
+        for (const auto& a : history) {
+            suspendHistory += StringPrintf("%14" PRId64 " %14" PRId64 " %7s %13" PRId64
+                                           " %13" PRId64 " %13" PRId64 "  %s\n",
+                                           a.startTimeMillis, a.endTimeMillis,
+                                           a.success ? "ok" : "failed", a.suspendTimeMillis,
+                                           a.suspendOverheadTimeMillis, a.sleepTimeMillis,
+                                           a.wakeupReason.c_str());
+        }
+        dprintf(fd, "Suspend History:\n%s\n", suspendHistory.c_str());
+    }
+
     return OK;
 }
 
@@ -19,16 +19,28 @@
 
 #include <android/system/suspend/BnSuspendControlService.h>
 #include <android/system/suspend/internal/BnSuspendControlServiceInternal.h>
+#include <android/system/suspend/internal/IWakeLockBatch.h>
+#include <android/system/suspend/internal/StatsWindow.h>
+#include <android/system/suspend/internal/SuspendAttemptInfo.h>
 #include <android/system/suspend/internal/SuspendInfo.h>
+#include <android/system/suspend/internal/SuspendPhaseLatency.h>
+#include <android/system/suspend/internal/WakeLockHoldTimes.h>
 #include <android/system/suspend/internal/WakeLockInfo.h>
+#include <android/system/suspend/internal/WakeLockStatsDelta.h>
 #include <android/system/suspend/internal/WakeupInfo.h>
 
 using ::android::system::suspend::BnSuspendControlService;
 using ::android::system::suspend::ISuspendCallback;
 using ::android::system::suspend::IWakelockCallback;
 using ::android::system::suspend::internal::BnSuspendControlServiceInternal;
+using ::android::system::suspend::internal::IWakeLockBatch;
+using ::android::system::suspend::internal::StatsWindow;
+using ::android::system::suspend::internal::SuspendAttemptInfo;
 using ::android::system::suspend::internal::SuspendInfo;
+using ::android::system::suspend::internal::SuspendPhaseLatency;
+using ::android::system::suspend::internal::WakeLockHoldTimes;
 using ::android::system::suspend::internal::WakeLockInfo;
+using ::android::system::suspend::internal::WakeLockStatsDelta;
 using ::android::system::suspend::internal::WakeupInfo;
 
 namespace android {
@@ -52,6 +64,7 @@ class SuspendControlService : public BnSuspendControlService,
     void binderDied(const wp<IBinder>& who) override;
 
     void notifyWakelock(const std::string& name, bool isAcquired);
+    void notifyWakelocks(const std::vector<std::string>& names, bool isAcquired);
     void notifyWakeup(bool success, std::vector<std::string>& wakeupReasons);
 
    private:
@@ -74,11 +87,28 @@ class SuspendControlServiceInternal : public BnSuspendControlServiceInternal,
 
     binder::Status enableAutosuspend(bool* _aidl_return) override;
     binder::Status forceSuspend(bool* _aidl_return) override;
+    binder::Status acquireWakeLocks(const std::vector<std::string>& names,
+                                    sp<IWakeLockBatch>* _aidl_return) override;
+    binder::Status acquireWakeLockToken(const sp<IBinder>& client, const std::string& name,
+                                        int64_t* _aidl_return) override;
+    binder::Status releaseWakeLockToken(int64_t token) override;
     binder::Status getSuspendStats(SuspendInfo* _aidl_return) override;
     binder::Status getWakeLockStats(std::vector<WakeLockInfo>* _aidl_return) override;
+    binder::Status getWakeLockStatsWithMaxAge(int64_t maxKernelStatsAgeMillis,
+                                              std::vector<WakeLockInfo>* _aidl_return) override;
+    binder::Status getWakeLockStatsDelta(int64_t sinceGeneration,
+                                         WakeLockStatsDelta* _aidl_return) override;
+    binder::Status getTopWakeLockStats(int32_t metric, int32_t k, int64_t maxKernelStatsAgeMillis,
+                                       std::vector<WakeLockInfo>* _aidl_return) override;
+    binder::Status getWakeLockHoldTimes(std::vector<WakeLockHoldTimes>* _aidl_return) override;
+    binder::Status getStatsWindow(int64_t windowMillis, StatsWindow* _aidl_return) override;
     binder::Status getWakeupStats(std::vector<WakeupInfo>* _aidl_return) override;
+    binder::Status getSuspendLatencyStats(
+        std::vector<SuspendPhaseLatency>* _aidl_return) override;
+    binder::Status getSuspendHistory(std::vector<SuspendAttemptInfo>* _aidl_return) override;
 
-    void binderDied([[maybe_unused]] const wp<IBinder>& who) override {}
+    // Releases the wake locks acquired by a dead client with acquireWakeLockToken().
+    void binderDied(const wp<IBinder>& who) override;
 
     void setSuspendService(const wp<SystemSuspend>& suspend);
     status_t dump(int fd, const Vector<String16>& args) override;
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendCounter.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using namespace std::chrono_literals;
+
+void SuspendCounter::increment() {
+    uint32_t state = mState.fetch_add(1);
+    while (state & kSuspending) {
+        // Back out and wait for the suspend attempt to end. Backing out may bring the count back to
+        // zero, which is reported like any other release.
+        decrement();
+        state = mState.load();
+        while (state & kSuspending) {
+            waitForChange(state, nullptr);
+            state = mState.load();
+        }
+        state = mState.fetch_add(1);
+    }
+}
+
+void SuspendCounter::decrement() {
+    uint32_t state = mState.load(std::memory_order_relaxed);
+    uint32_t newState;
+    do {
+        newState = state - 1;
+        if ((newState & kCountMask) == 0) {
+            newState = (newState | kReleased) & ~kWaiters;
+        }
+    } while (!mState.compare_exchange_weak(state, newState));
+
+    if ((state & kWaiters) && !(newState & kWaiters)) {
+        wakeWaiters();
+    }
+}
+
+uint32_t SuspendCounter::count() const {
+    return mState.load() & kCountMask;
+}
+
+void SuspendCounter::beginSuspend(bool force) {
+    uint32_t state = mState.load();
+    while (true) {
+        if ((state & kSuspending) || (!force && (state & kCountMask) != 0)) {
+            waitForChange(state, nullptr);
+            state = mState.load();
+        } else if (mState.compare_exchange_weak(state, state | kSuspending)) {
+            return;
+        }
+    }
+}
+
+void SuspendCounter::endSuspend() {
+    if (mState.fetch_and(~(kSuspending | kWaiters)) & kWaiters) {
+        wakeWaiters();
+    }
+}
+
+void SuspendCounter::waitForRelease(std::chrono::steady_clock::time_point deadline) {
+    mState.fetch_and(~kReleased);
+    while (true) {
+        uint32_t state = mState.load();
+        if ((state & kReleased) && (state & kCountMask) == 0) {
+            return;
+        }
+
+        auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= 0ns) {
+            return;
+        }
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(remaining);
+        const struct timespec timeout = {
+            .tv_sec = static_cast<time_t>(seconds.count()),
+            .tv_nsec = static_cast<long>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds).count()),
+        };
+        waitForChange(state, &timeout);
+    }
+}
+
+// Only the changes made by decrement() when the count drops to zero and by endSuspend() wake
+// waiters up; any other change just makes the futex wait return early.
+void SuspendCounter::waitForChange(uint32_t state, const struct timespec* timeout) {
+    if (!(state & kWaiters)) {
+        if (!mState.compare_exchange_strong(state, state | kWaiters)) {
+            return;
+        }
+        state |= kWaiters;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mState), FUTEX_WAIT_PRIVATE, state, timeout,
+            nullptr, 0);
+}
+
+void SuspendCounter::wakeWaiters() {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mState), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+            nullptr, 0);
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
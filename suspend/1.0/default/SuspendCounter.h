@@ -0,0 +1,77 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * SuspendCounter counts the native wake locks held and hands off between them and the autosuspend
+ * loop, without a mutex.
+ *
+ * The count and the handoff flags share a single atomic word, which is also used as a futex. When
+ * no suspend attempt is in progress, increment() and decrement() are a single atomic operation.
+ * Between beginSuspend() and endSuspend(), i.e. from the check that no wake lock is held until the
+ * write to /sys/power/state returns, increment() blocks so that a wake lock can't be acquired after
+ * the check and before the system suspends. decrement() never blocks.
+ *
+ * increment() and decrement() are thread safe. Only one thread at a time may call beginSuspend()
+ * with force == false or waitForRelease(), i.e. the autosuspend thread.
+ */
+class SuspendCounter {
+   public:
+    void increment();
+    void decrement();
+    uint32_t count() const;
+
+    // Blocks until no wake lock is held, unless force is true, and no other suspend attempt is in
+    // progress. Then blocks increment() until endSuspend() is called.
+    void beginSuspend(bool force = false);
+    void endSuspend();
+
+    // Blocks until the last wake lock held is released after this call, or until deadline.
+    void waitForRelease(std::chrono::steady_clock::time_point deadline);
+
+   private:
+    // Set between beginSuspend() and endSuspend()
+    static constexpr uint32_t kSuspending = 1u << 31;
+    // Set when a thread is sleeping on the futex, so that the state changes it waits for wake it
+    static constexpr uint32_t kWaiters = 1u << 30;
+    // Set when the count drops to zero, cleared by waitForRelease()
+    static constexpr uint32_t kReleased = 1u << 29;
+    static constexpr uint32_t kCountMask = kReleased - 1;
+
+    // Sleeps until the state changes from state, or timeout. Spurious wakeups are possible.
+    void waitForChange(uint32_t state, const struct timespec* timeout);
+    void wakeWaiters();
+
+    std::atomic<uint32_t> mState{0};
+    static_assert(sizeof(mState) == sizeof(uint32_t), "futex word must be 32 bits");
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
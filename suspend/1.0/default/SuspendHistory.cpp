@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SuspendHistory.h"
+
+#include <algorithm>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr char kOtherWakeupReason[] = "other";
+
+SuspendHistory::SuspendHistory(size_t capacity, size_t maxWakeupReasons)
+    : mCapacity(std::max<size_t>(capacity, 1)),
+      mMaxWakeupReasons(std::max<size_t>(maxWakeupReasons, 1)),
+      mSlots(new Slot[mCapacity]),
+      mWakeupReasonNames(new std::string[mMaxWakeupReasons]) {
+    mWakeupReasonIds.reserve(mMaxWakeupReasons);
+    mWakeupReasonNames[kOtherWakeupReasonId] = kOtherWakeupReason;
+    mNumWakeupReasons = 1;
+}
+
+uint32_t SuspendHistory::internWakeupReason(const std::vector<std::string>& wakeupReasons) {
+    // Same key as WakeupList. The buffer is reused so that known reasons don't allocate.
+    mJoinBuffer.clear();
+    for (const std::string& reason : wakeupReasons) {
+        if (!mJoinBuffer.empty()) mJoinBuffer += ';';
+        mJoinBuffer += reason;
+    }
+
+    auto it = mWakeupReasonIds.find(mJoinBuffer);
+    if (it != mWakeupReasonIds.end()) {
+        return it->second;
+    }
+
+    if (mNumWakeupReasons == mMaxWakeupReasons) {
+        return kOtherWakeupReasonId;
+    }
+    uint32_t id = mNumWakeupReasons++;
+    mWakeupReasonNames[id] = mJoinBuffer;
+    mWakeupReasonIds.emplace(mJoinBuffer, id);
+    return id;
+}
+
+void SuspendHistory::record(const SuspendAttempt& attempt) {
+    uint64_t index = mNextIndex.load(std::memory_order_relaxed);
+    Slot& slot = mSlots[index % mCapacity];
+
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.startTimeMillis.store(attempt.startTimeMillis, std::memory_order_relaxed);
+    slot.endTimeMillis.store(attempt.endTimeMillis, std::memory_order_relaxed);
+    slot.success.store(attempt.success, std::memory_order_relaxed);
+    slot.suspendTimeMillis.store(attempt.suspendTimeMillis, std::memory_order_relaxed);
+    slot.suspendOverheadTimeMillis.store(attempt.suspendOverheadTimeMillis,
+                                         std::memory_order_relaxed);
+    slot.sleepTimeMillis.store(attempt.sleepTimeMillis, std::memory_order_relaxed);
+    slot.wakeupReasonId.store(attempt.wakeupReasonId, std::memory_order_relaxed);
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+
+    mNextIndex.store(index + 1, std::memory_order_release);
+}
+
+/*
+ * Reads the attempt with the given index. Returns false if the writer has overwritten the slot
+ * with a newer attempt.
+ */
+bool SuspendHistory::readSlot(uint64_t index, SuspendAttempt* attempt) const {
+    const Slot& slot = mSlots[index % mCapacity];
+    const uint64_t expectedSeq = 2 * index + 2;
+
+    while (true) {
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq > expectedSeq) {
+            return false;
+        }
+        if (seq != expectedSeq) {
+            // The writer is (re)writing this slot, or hasn't published it yet.
+            continue;
+        }
+
+        attempt->startTimeMillis = slot.startTimeMillis.load(std::memory_order_relaxed);
+        attempt->endTimeMillis = slot.endTimeMillis.load(std::memory_order_relaxed);
+        attempt->success = slot.success.load(std::memory_order_relaxed);
+        attempt->suspendTimeMillis = slot.suspendTimeMillis.load(std::memory_order_relaxed);
+        attempt->suspendOverheadTimeMillis =
+            slot.suspendOverheadTimeMillis.load(std::memory_order_relaxed);
+        attempt->sleepTimeMillis = slot.sleepTimeMillis.load(std::memory_order_relaxed);
+        attempt->wakeupReasonId = slot.wakeupReasonId.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq) {
+            return true;
+        }
+    }
+}
+
+void SuspendHistory::getHistory(std::vector<SuspendAttemptInfo>* history) const {
+    uint64_t end = mNextIndex.load(std::memory_order_acquire);
+    uint64_t begin = end > mCapacity ? end - mCapacity : 0;
+
+    std::vector<SuspendAttempt> attempts;
+    attempts.reserve(end - begin);
+    for (uint64_t index = begin; index < end; index++) {
+        SuspendAttempt attempt;
+        if (readSlot(index, &attempt)) {
+            attempts.push_back(attempt);
+        }
+    }
+
+    // Wakeup reasons are interned before the attempts using them are recorded, so the names of the
+    // ids read above are published already.
+    for (const SuspendAttempt& attempt : attempts) {
+        SuspendAttemptInfo info;
+        info.startTimeMillis = attempt.startTimeMillis;
+        info.endTimeMillis = attempt.endTimeMillis;
+        info.success = attempt.success;
+        info.suspendTimeMillis = attempt.suspendTimeMillis;
+        info.suspendOverheadTimeMillis = attempt.suspendOverheadTimeMillis;
+        info.sleepTimeMillis = attempt.sleepTimeMillis;
+        info.wakeupReason = mWakeupReasonNames[attempt.wakeupReasonId];
+        history->push_back(std::move(info));
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
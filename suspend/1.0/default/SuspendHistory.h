@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <android/system/suspend/internal/SuspendAttemptInfo.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using ::android::system::suspend::internal::SuspendAttemptInfo;
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+struct SuspendAttempt {
+    int64_t startTimeMillis;
+    int64_t endTimeMillis;
+    bool success;
+    int64_t suspendTimeMillis;
+    int64_t suspendOverheadTimeMillis;
+    int64_t sleepTimeMillis;
+    // Id returned by SuspendHistory::internWakeupReason()
+    uint32_t wakeupReasonId;
+};
+
+/*
+ * SuspendHistory keeps the last N suspend attempts in a preallocated ring buffer.
+ *
+ * There must be a single writer thread, calling internWakeupReason() and record(). Readers may call
+ * getHistory() from any thread. Each slot is protected by a sequence counter so that readers never
+ * block the writer: a reader retries a slot that is written concurrently and skips it if the writer
+ * has lapped it.
+ */
+class SuspendHistory {
+   public:
+    // Id of the wakeup reason reported once maxWakeupReasons distinct reasons have been interned.
+    static constexpr uint32_t kOtherWakeupReasonId = 0;
+
+    SuspendHistory(size_t capacity, size_t maxWakeupReasons);
+
+    // Returns a stable id for the given wakeup reasons. Writer thread only.
+    uint32_t internWakeupReason(const std::vector<std::string>& wakeupReasons);
+    // Writer thread only.
+    void record(const SuspendAttempt& attempt);
+    // Appends the recorded attempts to history, oldest first.
+    void getHistory(std::vector<SuspendAttemptInfo>* history) const;
+
+   private:
+    struct Slot {
+        // 2 * (index + 1) once the attempt with the given index has been written, odd while the
+        // slot is being written.
+        std::atomic<uint64_t> seq{0};
+        std::atomic<int64_t> startTimeMillis{0};
+        std::atomic<int64_t> endTimeMillis{0};
+        std::atomic<bool> success{false};
+        std::atomic<int64_t> suspendTimeMillis{0};
+        std::atomic<int64_t> suspendOverheadTimeMillis{0};
+        std::atomic<int64_t> sleepTimeMillis{0};
+        std::atomic<uint32_t> wakeupReasonId{0};
+    };
+
+    bool readSlot(uint64_t index, SuspendAttempt* attempt) const;
+
+    const size_t mCapacity;
+    const size_t mMaxWakeupReasons;
+    std::unique_ptr<Slot[]> mSlots;
+    // Number of attempts recorded so far
+    std::atomic<uint64_t> mNextIndex{0};
+
+    // Only accessed by the writer thread.
+    std::string mJoinBuffer;
+    std::unordered_map<std::string, uint32_t> mWakeupReasonIds;
+    uint32_t mNumWakeupReasons = 0;
+
+    // Indexed by wakeup reason id, preallocated to mMaxWakeupReasons. Append only: a name is set
+    // once, before the first attempt with its id is recorded, which publishes it to readers.
+    std::unique_ptr<std::string[]> mWakeupReasonNames;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysfsReader.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <charconv>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+static constexpr int kNanosDigits = 9;
+
+std::string_view SysfsReader::read(int fd) {
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, mBuffer.data(), mBuffer.size(), 0));
+    if (n < 0 && errno == ESPIPE) {
+        // Not seekable, e.g. the socketpairs used in place of sysfs nodes in tests. Fall back to
+        // a single read so that we don't block waiting for EOF.
+        n = TEMP_FAILURE_RETRY(::read(fd, mBuffer.data(), mBuffer.size()));
+    }
+    if (n < 0) return {};
+    return {mBuffer.data(), static_cast<size_t>(n)};
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+    return s;
+}
+
+/*
+ * Parses a non-negative "<seconds>[.<fraction>]" token from the front of *s and advances *s past
+ * it. Digits beyond nanosecond precision are ignored.
+ */
+static bool parseSeconds(std::string_view* s, std::chrono::nanoseconds* out) {
+    while (!s->empty() && std::isspace(static_cast<unsigned char>(s->front()))) s->remove_prefix(1);
+
+    const char* end = s->data() + s->size();
+    uint64_t seconds = 0;
+    auto [ptr, ec] = std::from_chars(s->data(), end, seconds);
+    if (ec != std::errc()) return false;
+
+    int64_t nanos = 0;
+    if (ptr != end && *ptr == '.') {
+        int digits = 0;
+        for (++ptr; ptr != end && std::isdigit(static_cast<unsigned char>(*ptr)); ++ptr) {
+            if (digits < kNanosDigits) {
+                nanos = nanos * 10 + (*ptr - '0');
+                digits++;
+            }
+        }
+        for (; digits < kNanosDigits; digits++) nanos *= 10;
+    }
+
+    s->remove_prefix(ptr - s->data());
+    *out = std::chrono::seconds(seconds) + std::chrono::nanoseconds(nanos);
+    return true;
+}
+
+bool parseSuspendTime(std::string_view content, std::chrono::nanoseconds* suspendOverhead,
+                      std::chrono::nanoseconds* suspendTime) {
+    return parseSeconds(&content, suspendOverhead) && parseSeconds(&content, suspendTime);
+}
+
+void parseWakeupReasons(std::string_view content, std::vector<std::string>* reasons) {
+    size_t count = 0;
+    while (!content.empty()) {
+        size_t eol = content.find('\n');
+        std::string_view line = trim(content.substr(0, eol));
+        content.remove_prefix(eol == std::string_view::npos ? content.size() : eol + 1);
+
+        // Only include non-empty reason lines
+        if (line.empty()) continue;
+        if (count < reasons->size()) {
+            (*reasons)[count].assign(line.data(), line.size());
+        } else {
+            reasons->emplace_back(line);
+        }
+        count++;
+    }
+    reasons->resize(count);
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * SysfsReader reads small sysfs attributes into a preallocated buffer so that repeated reads of the
+ * same nodes (e.g. from the autosuspend loop) don't allocate.
+ * This class is not thread safe; each thread should use its own reader.
+ */
+class SysfsReader {
+   public:
+    // sysfs attributes are at most one page long.
+    static constexpr size_t kBufferSize = 4096;
+
+    // Reads the contents of fd from offset 0. The returned view is valid until the next call to
+    // read(). Returns an empty view on error, with errno set.
+    std::string_view read(int fd);
+
+   private:
+    std::array<char, kBufferSize> mBuffer;
+};
+
+// Parses "<overhead> <time>" as found in /sys/kernel/wakeup_reasons/last_suspend_time, both in
+// seconds with an optional fractional part. Returns false if content is malformed.
+bool parseSuspendTime(std::string_view content, std::chrono::nanoseconds* suspendOverhead,
+                      std::chrono::nanoseconds* suspendTime);
+
+// Splits content into trimmed, non-empty lines. Elements already in reasons are reused so that
+// parsing the same reasons again doesn't allocate.
+void parseWakeupReasons(std::string_view content, std::vector<std::string>* reasons);
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
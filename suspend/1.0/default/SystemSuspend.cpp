@@ -19,7 +19,6 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
-#include <android-base/strings.h>
 #include <fcntl.h>
 #include <hidl/Status.h>
 #include <hwbinder/IPCThreadState.h>
@@ -31,6 +30,7 @@
 
 using ::android::base::Error;
 using ::android::base::ReadFdToString;
+using ::android::base::WriteFully;
 using ::android::base::WriteStringToFd;
 using ::android::hardware::Void;
 using ::std::string;
@@ -51,6 +51,20 @@ static const char kSleepState[] = "mem";
 static constexpr char kSysPowerWakeLock[] = "/sys/power/wake_lock";
 static constexpr char kSysPowerWakeUnlock[] = "/sys/power/wake_unlock";
 static constexpr char kUnknownWakeup[] = "unknown";
+// Maximum number of wakeups waiting to be processed by the post-resume worker
+static constexpr size_t kPostResumeQueueCapacity = 32;
+// Number of most recent suspend attempts kept in mSuspendHistory
+static constexpr size_t kSuspendHistoryCapacity = 128;
+// Number of distinct wakeup reasons mSuspendHistory tracks, others are recorded as "other"
+static constexpr size_t kMaxSuspendHistoryWakeupReasons = 64;
+// Interval at which mStatsHistory samples the wake lock and wakeup stats
+static constexpr std::chrono::milliseconds kStatsHistorySamplingInterval = 1min;
+static constexpr const char* kSuspendPhaseNames[NUM_SUSPEND_PHASES] = {
+    "wait_for_wakelocks",
+    "write_wakeup_count",
+    "write_state",
+    "post_resume",
+};
 
 // This function assumes that data in fd is small enough that it can be read in one go.
 // We use this function instead of the ones available in libbase because it doesn't block
@@ -66,66 +80,54 @@ static inline int getCallingPid() {
     return ::android::hardware::IPCThreadState::self()->getCallingPid();
 }
 
-static std::vector<std::string> readWakeupReasons(int fd) {
-    std::vector<std::string> wakeupReasons;
-    std::string reasonlines;
-
-    lseek(fd, 0, SEEK_SET);
-    if (!ReadFdToString(fd, &reasonlines) || reasonlines.empty()) {
+static void readWakeupReasons(SysfsReader& reader, int fd,
+                              std::vector<std::string>* wakeupReasons) {
+    std::string_view reasonlines = reader.read(fd);
+    if (reasonlines.empty()) {
         PLOG(ERROR) << "failed to read wakeup reasons";
         // Return unknown wakeup reason if we fail to read
-        return {kUnknownWakeup};
+        wakeupReasons->resize(1);
+        (*wakeupReasons)[0] = kUnknownWakeup;
+        return;
     }
 
-    std::stringstream ss(reasonlines);
-    for (std::string reasonline; std::getline(ss, reasonline);) {
-        reasonline = ::android::base::Trim(reasonline);
-
-        // Only include non-empty reason lines
-        if (!reasonline.empty()) {
-            wakeupReasons.push_back(reasonline);
-        }
-    }
+    parseWakeupReasons(reasonlines, wakeupReasons);
 
     // Empty wakeup reason found. Record as unknown wakeup
-    if (wakeupReasons.empty()) {
-        wakeupReasons.push_back(kUnknownWakeup);
+    if (wakeupReasons->empty()) {
+        wakeupReasons->emplace_back(kUnknownWakeup);
     }
-
-    return wakeupReasons;
 }
 
 // reads the suspend overhead and suspend time
 // Returns 0s if reading the sysfs node fails (unlikely)
-static struct SuspendTime readSuspendTime(int fd) {
-    std::string content;
-
-    lseek(fd, 0, SEEK_SET);
-    if (!ReadFdToString(fd, &content)) {
+static struct SuspendTime readSuspendTime(SysfsReader& reader, int fd) {
+    std::string_view content = reader.read(fd);
+    if (content.empty()) {
         LOG(ERROR) << "failed to read suspend time";
         return {0ns, 0ns};
     }
 
-    double suspendOverhead, suspendTime;
-    std::stringstream ss(content);
-    if (!(ss >> suspendOverhead) || !(ss >> suspendTime)) {
+    SuspendTime suspendTime;
+    if (!parseSuspendTime(content, &suspendTime.suspendOverhead, &suspendTime.suspendTime)) {
         LOG(ERROR) << "failed to parse suspend time " << content;
         return {0ns, 0ns};
     }
 
-    return {std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::duration<double>(suspendOverhead)),
-            std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::duration<double>(suspendTime))};
+    return suspendTime;
 }
 
 WakeLock::WakeLock(SystemSuspend* systemSuspend, const string& name, int pid)
-    : mReleased(), mSystemSuspend(systemSuspend), mName(name), mPid(pid) {
+    : mReleased(),
+      mSystemSuspend(systemSuspend),
+      mName(name),
+      mStatsKey(systemSuspend->getStatsList().addKey(name, pid)) {
     mSystemSuspend->incSuspendCounter(mName);
 }
 
 WakeLock::~WakeLock() {
     releaseOnce();
+    mSystemSuspend->getStatsList().removeKey(mStatsKey);
 }
 
 Return<void> WakeLock::release() {
@@ -136,7 +138,44 @@ Return<void> WakeLock::release() {
 void WakeLock::releaseOnce() {
     std::call_once(mReleased, [this]() {
         mSystemSuspend->decSuspendCounter(mName);
-        mSystemSuspend->updateWakeLockStatOnRelease(mName, mPid, getTimeNow());
+        mSystemSuspend->updateWakeLockStatOnRelease(mName, mStatsKey, getTimeNow());
+    });
+}
+
+WakeLockBatch::WakeLockBatch(SystemSuspend* systemSuspend, std::vector<std::string> names,
+                             int pid)
+    : mReleased(), mSystemSuspend(systemSuspend), mNames(std::move(names)) {
+    mStatsKeys.reserve(mNames.size());
+    for (const std::string& name : mNames) {
+        mSystemSuspend->incSuspendCounter(name);
+        mStatsKeys.push_back(mSystemSuspend->getStatsList().addKey(name, pid));
+    }
+}
+
+WakeLockBatch::~WakeLockBatch() {
+    releaseOnce();
+    for (const WakeLockStatsKey& statsKey : mStatsKeys) {
+        mSystemSuspend->getStatsList().removeKey(statsKey);
+    }
+}
+
+binder::Status WakeLockBatch::release() {
+    releaseOnce();
+    return binder::Status::ok();
+}
+
+// Oneway, the caller doesn't wait for this.
+binder::Status WakeLockBatch::releaseAsync() {
+    releaseOnce();
+    return binder::Status::ok();
+}
+
+void WakeLockBatch::releaseOnce() {
+    std::call_once(mReleased, [this]() {
+        for (const std::string& name : mNames) {
+            mSystemSuspend->decSuspendCounter(name);
+        }
+        mSystemSuspend->updateWakeLockStatsOnRelease(mNames, mStatsKeys, getTimeNow());
     });
 }
 
@@ -146,23 +185,39 @@ SystemSuspend::SystemSuspend(unique_fd wakeupCountFd, unique_fd stateFd, unique_
                              const SleepTimeConfig& sleepTimeConfig,
                              const sp<SuspendControlService>& controlService,
                              const sp<SuspendControlServiceInternal>& controlServiceInternal,
-                             bool useSuspendCounter)
-    : mSuspendCounter(0),
-      mWakeupCountFd(std::move(wakeupCountFd)),
+                             bool useSuspendCounter,
+                             std::chrono::milliseconds kernelWakelockRefreshInterval)
+    : mWakeupCountFd(std::move(wakeupCountFd)),
       mStateFd(std::move(stateFd)),
       mSuspendStatsFd(std::move(suspendStatsFd)),
       mSuspendTimeFd(std::move(suspendTimeFd)),
+      mSuspendHistory(kSuspendHistoryCapacity, kMaxSuspendHistoryWakeupReasons),
       kSleepTimeConfig(sleepTimeConfig),
       mSleepTime(sleepTimeConfig.baseSleepTime),
-      mNumConsecutiveBadSuspends(0),
+      mBackoffPolicy(createSuspendBackoffPolicy(sleepTimeConfig)),
       mControlService(controlService),
       mControlServiceInternal(controlServiceInternal),
-      mStatsList(maxStatsEntries, std::move(kernelWakelockStatsFd)),
+      mStatsList(maxStatsEntries, std::move(kernelWakelockStatsFd), kernelWakelockRefreshInterval),
       mWakeupList(maxStatsEntries),
       mUseSuspendCounter(useSuspendCounter),
       mWakeLockFd(-1),
       mWakeUnlockFd(-1),
-      mWakeupReasonsFd(std::move(wakeupReasonsFd)) {
+      mWakeupReasonsFd(std::move(wakeupReasonsFd)),
+      mPostResumeWorker(kPostResumeQueueCapacity,
+                        [this](bool success, std::vector<std::string>& wakeupReasons) {
+                            mWakeupList.update(wakeupReasons);
+                            mControlService->notifyWakeup(success, wakeupReasons);
+                        }),
+      mStatsHistory(kStatsHistorySamplingInterval,
+                    [this](int64_t sinceGeneration, WakeLockStatsDelta* wakeLocks,
+                           std::vector<WakeupInfo>* wakeups) {
+                        mStatsList.updateNow();
+                        // Kernel wakelock stats as old as a sampling interval are as good as
+                        // fresh ones, reuse the snapshot of a poller if there is one.
+                        mStatsList.getWakeLockStatsDelta(kStatsHistorySamplingInterval,
+                                                         sinceGeneration, wakeLocks);
+                        mWakeupList.getWakeupStats(wakeups);
+                    }) {
     mControlServiceInternal->setSuspendService(this);
 
     if (!mUseSuspendCounter) {
@@ -193,9 +248,11 @@ bool SystemSuspend::forceSuspend() {
     //  or reset mSuspendCounter, it just ignores them.  When the system
     //  returns from suspend, the wakelocks and SuspendCounter will not have
     //  changed.
-    auto counterLock = std::unique_lock(mCounterLock);
+    mSuspendCounter.beginSuspend(true /* force */);
+    mStatsList.pauseKernelStatsRefresh();
     bool success = WriteStringToFd(kSleepState, mStateFd);
-    counterLock.unlock();
+    mStatsList.resumeKernelStatsRefresh();
+    mSuspendCounter.endSuspend();
 
     if (!success) {
         PLOG(VERBOSE) << "error writing to /sys/power/state for forceSuspend";
@@ -207,16 +264,68 @@ Return<sp<IWakeLock>> SystemSuspend::acquireWakeLock(WakeLockType /* type */,
                                                      const hidl_string& name) {
     auto pid = getCallingPid();
     auto timeNow = getTimeNow();
-    IWakeLock* wl = new WakeLock{this, name, pid};
+    WakeLock* wl = new WakeLock{this, name, pid};
     mControlService->notifyWakelock(name, true);
-    mStatsList.updateOnAcquire(name, pid, timeNow);
+    mStatsList.updateOnAcquire(wl->getStatsKey(), timeNow);
     return wl;
 }
 
+// Stats and callbacks are updated once for the whole batch.
+sp<IWakeLockBatch> SystemSuspend::acquireWakeLocks(const std::vector<std::string>& names,
+                                                   int pid) {
+    auto timeNow = getTimeNow();
+    sp<WakeLockBatch> batch = new WakeLockBatch{this, names, pid};
+    mControlService->notifyWakelocks(names, true);
+    mStatsList.updateOnAcquire(batch->getStatsKeys(), timeNow);
+    return batch;
+}
+
+status_t SystemSuspend::acquireWakeLockToken(const sp<IBinder>& client,
+                                             const sp<IBinder::DeathRecipient>& recipient,
+                                             const std::string& name, int pid, uid_t uid,
+                                             int64_t* token) {
+    auto timeNow = getTimeNow();
+    incSuspendCounter(name);
+    WakeLockStatsKey statsKey = mStatsList.addKey(name, pid);
+    status_t status =
+        mWakeLockTokens.acquire(client, recipient, {name, pid, uid, statsKey}, token);
+    if (status != NO_ERROR) {
+        mStatsList.removeKey(statsKey);
+        decSuspendCounter(name);
+        return status;
+    }
+    mControlService->notifyWakelock(name, true);
+    mStatsList.updateOnAcquire(statsKey, timeNow);
+    return NO_ERROR;
+}
+
+status_t SystemSuspend::releaseWakeLockToken(int64_t token, uid_t uid,
+                                             const sp<IBinder::DeathRecipient>& recipient) {
+    WakeLockTokenTable::Entry entry;
+    status_t status = mWakeLockTokens.release(token, uid, recipient, &entry);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    decSuspendCounter(entry.name);
+    updateWakeLockStatOnRelease(entry.name, entry.statsKey, getTimeNow());
+    mStatsList.removeKey(entry.statsKey);
+    return NO_ERROR;
+}
+
+void SystemSuspend::releaseWakeLockTokens(const IBinder* client) {
+    auto timeNow = getTimeNow();
+    for (const auto& entry : mWakeLockTokens.releaseClient(client)) {
+        decSuspendCounter(entry.name);
+        updateWakeLockStatOnRelease(entry.name, entry.statsKey, timeNow);
+        mStatsList.removeKey(entry.statsKey);
+    }
+}
+
+// Kernel wake locks are not serialized with suspend attempts here, the kernel aborts the attempt
+// if one is acquired after /sys/power/wakeup_count is written.
 void SystemSuspend::incSuspendCounter(const string& name) {
-    auto l = std::lock_guard(mCounterLock);
     if (mUseSuspendCounter) {
-        mSuspendCounter++;
+        mSuspendCounter.increment();
     } else {
         if (!WriteStringToFd(name, mWakeLockFd)) {
             PLOG(ERROR) << "error writing " << name << " to " << kSysPowerWakeLock;
@@ -225,11 +334,8 @@ void SystemSuspend::incSuspendCounter(const string& name) {
 }
 
 void SystemSuspend::decSuspendCounter(const string& name) {
-    auto l = std::lock_guard(mCounterLock);
     if (mUseSuspendCounter) {
-        if (--mSuspendCounter == 0) {
-            mCounterCondVar.notify_one();
-        }
+        mSuspendCounter.decrement();
     } else {
         if (!WriteStringToFd(name, mWakeUnlockFd)) {
             PLOG(ERROR) << "error writing " << name << " to " << kSysPowerWakeUnlock;
@@ -248,47 +354,100 @@ unique_fd SystemSuspend::reopenFileUsingFd(const int fd, const int permission) {
     return tempFd;
 }
 
+/**
+ * Blocks the suspend thread until the next suspend attempt may be made.
+ *
+ * By default the thread unconditionally sleeps for mSleepTime. In event-driven mode, the sleep is
+ * cut short as soon as the last native wake lock acquired in the meantime is released. While
+ * backing off (mSleepTime above the base sleep time), the full deadline is always honored.
+ */
+void SystemSuspend::waitForNextSuspendAttempt() {
+    bool backingOff = mSleepTime > kSleepTimeConfig.baseSleepTime;
+    if (!kSleepTimeConfig.eventDrivenAutosuspendEnabled || !mUseSuspendCounter || backingOff) {
+        std::this_thread::sleep_for(mSleepTime);
+        return;
+    }
+
+    mSuspendCounter.waitForRelease(std::chrono::steady_clock::now() + mSleepTime);
+}
+
 void SystemSuspend::initAutosuspend() {
+    mPostResumeWorker.start();
+    mStatsHistory.start();
     std::thread autosuspendThread([this] {
+        // Buffers are reused across iterations so that the steady-state loop doesn't allocate.
+        SysfsReader reader;
+        std::vector<std::string> wakeupReasons;
+
         while (true) {
-            std::this_thread::sleep_for(mSleepTime);
-            lseek(mWakeupCountFd, 0, SEEK_SET);
-            const string wakeupCount = readFd(mWakeupCountFd);
+            waitForNextSuspendAttempt();
+            const std::string_view wakeupCount = reader.read(mWakeupCountFd);
             if (wakeupCount.empty()) {
                 PLOG(ERROR) << "error reading from /sys/power/wakeup_count";
                 continue;
             }
 
-            auto counterLock = std::unique_lock(mCounterLock);
-            mCounterCondVar.wait(counterLock, [this] { return mSuspendCounter == 0; });
-            // The mutex is locked and *MUST* remain locked until we write to /sys/power/state.
-            // Otherwise, a WakeLock might be acquired after we check mSuspendCounter and before we
-            // write to /sys/power/state.
+            const auto waitStart = std::chrono::steady_clock::now();
+            // Wake locks *MUST* be blocked until we write to /sys/power/state. Otherwise, a
+            // WakeLock might be acquired after we check mSuspendCounter and before we write to
+            // /sys/power/state.
+            mSuspendCounter.beginSuspend();
+            const auto waitEnd = std::chrono::steady_clock::now();
 
-            if (!WriteStringToFd(wakeupCount, mWakeupCountFd)) {
+            if (!WriteFully(mWakeupCountFd, wakeupCount.data(), wakeupCount.size())) {
                 PLOG(VERBOSE) << "error writing from /sys/power/wakeup_count";
+                mSuspendCounter.endSuspend();
+                recordSuspendLatency(WAIT_FOR_WAKE_LOCKS, waitEnd - waitStart);
+                recordSuspendLatency(WRITE_WAKEUP_COUNT,
+                                     std::chrono::steady_clock::now() - waitEnd);
                 continue;
             }
+            const auto wakeupCountWritten = std::chrono::steady_clock::now();
+            const TimestampType attemptStart = getTimeNow();
+            mStatsList.pauseKernelStatsRefresh();
             bool success = WriteStringToFd(kSleepState, mStateFd);
-            counterLock.unlock();
+            mStatsList.resumeKernelStatsRefresh();
+            mStatsHistory.onResume();
+            mSuspendCounter.endSuspend();
+            const auto stateWritten = std::chrono::steady_clock::now();
+            const TimestampType attemptEnd = getTimeNow();
 
             if (!success) {
                 PLOG(VERBOSE) << "error writing to /sys/power/state";
             }
 
-            struct SuspendTime suspendTime = readSuspendTime(mSuspendTimeFd);
-            updateSleepTime(success, suspendTime);
-
-            std::vector<std::string> wakeupReasons = readWakeupReasons(mWakeupReasonsFd);
-            if (wakeupReasons == std::vector<std::string>({kUnknownWakeup})) {
+            struct SuspendTime suspendTime = readSuspendTime(reader, mSuspendTimeFd);
+            readWakeupReasons(reader, mWakeupReasonsFd, &wakeupReasons);
+            if (wakeupReasons.size() == 1 && wakeupReasons[0] == kUnknownWakeup) {
                 LOG(INFO) << "Unknown/empty wakeup reason. Re-opening wakeup_reason file.";
 
                 mWakeupReasonsFd =
                     std::move(reopenFileUsingFd(mWakeupReasonsFd.get(), O_CLOEXEC | O_RDONLY));
             }
-            mWakeupList.update(wakeupReasons);
-
-            mControlService->notifyWakeup(success, wakeupReasons);
+            updateSleepTime(success, suspendTime, wakeupReasons);
+
+            mSuspendHistory.record({
+                .startTimeMillis = attemptStart,
+                .endTimeMillis = attemptEnd,
+                .success = success,
+                .suspendTimeMillis =
+                    std::chrono::round<std::chrono::milliseconds>(suspendTime.suspendTime).count(),
+                .suspendOverheadTimeMillis =
+                    std::chrono::round<std::chrono::milliseconds>(suspendTime.suspendOverhead)
+                        .count(),
+                .sleepTimeMillis = mSleepTime.count(),
+                .wakeupReasonId = mSuspendHistory.internWakeupReason(wakeupReasons),
+            });
+            recordSuspendLatency(WAIT_FOR_WAKE_LOCKS, waitEnd - waitStart);
+            recordSuspendLatency(WRITE_WAKEUP_COUNT, wakeupCountWritten - waitEnd);
+            recordSuspendLatency(WRITE_STATE, stateWritten - wakeupCountWritten);
+            recordSuspendLatency(POST_RESUME, std::chrono::steady_clock::now() - stateWritten);
+
+            // Updating wakeup stats and notifying callbacks can be slow, don't let it delay the
+            // next suspend attempt. The wakeup reasons have to be read here though, as they are
+            // overwritten by the next resume. Queued last so that everything recorded for this
+            // attempt is visible once the worker has processed it.
+            mPostResumeWorker.enqueue(success, &wakeupReasons);
         }
     });
     autosuspendThread.detach();
@@ -296,23 +455,11 @@ void SystemSuspend::initAutosuspend() {
 }
 
 /**
- * Updates sleep time depending on the result of suspend attempt.
- * Time (in milliseconds) between suspend attempts is described the formula
- * t[n] = { B, 0 < n <= N
- *        { min(B * (S**(n - N)), M), n > N
- * where:
- *   n is the number of consecutive bad suspend attempts,
- *   B = kBaseSleepTime,
- *   N = kSuspendBackoffThreshold,
- *   S = kSleepTimeScaleFactor,
- *   M = kMaxSleepTime
- *
- * kFailedSuspendBackoffEnabled determines whether a failed suspend is counted as a bad suspend
- *
- * kShortSuspendBackoffEnabled determines whether a suspend whose duration
- * t < kShortSuspendThreshold is counted as a bad suspend
+ * Updates sleep time depending on the result of suspend attempt, as decided by mBackoffPolicy.
+ * The suspend stats are accounted for here so that they are comparable across policies.
  */
-void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& suspendTime) {
+void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& suspendTime,
+                                    const std::vector<std::string>& wakeupReasons) {
     std::scoped_lock lock(mSuspendInfoLock);
     mSuspendInfo.suspendAttemptCount++;
     mSuspendInfo.sleepTimeMillis +=
@@ -321,9 +468,6 @@ void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& susp
     bool shortSuspend = success && (suspendTime.suspendTime > 0ns) &&
                         (suspendTime.suspendTime < kSleepTimeConfig.shortSuspendThreshold);
 
-    bool badSuspend = (kSleepTimeConfig.failedSuspendBackoffEnabled && !success) ||
-                      (kSleepTimeConfig.shortSuspendBackoffEnabled && shortSuspend);
-
     auto suspendTimeMillis =
         std::chrono::round<std::chrono::milliseconds>(suspendTime.suspendTime).count();
     auto suspendOverheadMillis =
@@ -342,35 +486,34 @@ void SystemSuspend::updateSleepTime(bool success, const struct SuspendTime& susp
         mSuspendInfo.shortSuspendTimeMillis += suspendTimeMillis;
     }
 
-    if (!badSuspend) {
-        mNumConsecutiveBadSuspends = 0;
-        mSleepTime = kSleepTimeConfig.baseSleepTime;
-        return;
-    }
-
-    // Suspend attempt was bad (failed or short suspend)
-    if (mNumConsecutiveBadSuspends >= kSleepTimeConfig.backoffThreshold) {
-        if (mNumConsecutiveBadSuspends == kSleepTimeConfig.backoffThreshold) {
-            mSuspendInfo.newBackoffCount++;
-        } else {
-            mSuspendInfo.backoffContinueCount++;
-        }
-
-        mSleepTime = std::min(std::chrono::round<std::chrono::milliseconds>(
-                                  mSleepTime * kSleepTimeConfig.sleepTimeScaleFactor),
-                              kSleepTimeConfig.maxSleepTime);
+    BackoffDecision decision = mBackoffPolicy->update({
+        .success = success,
+        .suspendTime = suspendTime.suspendTime,
+        .wakeupReasons = &wakeupReasons,
+    });
+    if (decision.event == BackoffEvent::NEW_BACKOFF) {
+        mSuspendInfo.newBackoffCount++;
+    } else if (decision.event == BackoffEvent::CONTINUE_BACKOFF) {
+        mSuspendInfo.backoffContinueCount++;
     }
-
-    mNumConsecutiveBadSuspends++;
+    mSleepTime = decision.sleepTime;
 }
 
-void SystemSuspend::updateWakeLockStatOnRelease(const std::string& name, int pid,
+void SystemSuspend::updateWakeLockStatOnRelease(const std::string& name,
+                                                const WakeLockStatsKey& statsKey,
                                                 TimestampType timeNow) {
     mControlService->notifyWakelock(name, false);
-    mStatsList.updateOnRelease(name, pid, timeNow);
+    mStatsList.updateOnRelease(statsKey, timeNow);
+}
+
+void SystemSuspend::updateWakeLockStatsOnRelease(const std::vector<std::string>& names,
+                                                 const std::vector<WakeLockStatsKey>& statsKeys,
+                                                 TimestampType timeNow) {
+    mControlService->notifyWakelocks(names, false);
+    mStatsList.updateOnRelease(statsKeys, timeNow);
 }
 
-const WakeLockEntryList& SystemSuspend::getStatsList() const {
+WakeLockEntryList& SystemSuspend::getStatsList() {
     return mStatsList;
 }
 
@@ -384,10 +527,44 @@ void SystemSuspend::getSuspendInfo(SuspendInfo* info) {
     *info = mSuspendInfo;
 }
 
+void SystemSuspend::recordSuspendLatency(SuspendPhase phase,
+                                         std::chrono::steady_clock::duration latency) {
+    std::scoped_lock lock(mSuspendLatencyLock);
+    mSuspendLatency[phase].record(std::chrono::duration_cast<std::chrono::microseconds>(latency));
+}
+
+void SystemSuspend::getSuspendLatencyStats(std::vector<SuspendPhaseLatency>* latencies) {
+    std::scoped_lock lock(mSuspendLatencyLock);
+
+    for (size_t phase = 0; phase < NUM_SUSPEND_PHASES; phase++) {
+        const LatencyHistogram& histogram = mSuspendLatency[phase];
+        SuspendPhaseLatency latency;
+        latency.phase = kSuspendPhaseNames[phase];
+        latency.count = histogram.count();
+        latency.p50Micros = histogram.percentileMicros(50);
+        latency.p95Micros = histogram.percentileMicros(95);
+        latency.p99Micros = histogram.percentileMicros(99);
+        latency.maxMicros = histogram.maxMicros();
+        latencies->push_back(latency);
+    }
+}
+
+PostResumeStats SystemSuspend::getPostResumeStats() const {
+    return mPostResumeWorker.getStats();
+}
+
+void SystemSuspend::getSuspendHistory(std::vector<SuspendAttemptInfo>* history) const {
+    mSuspendHistory.getHistory(history);
+}
+
 const WakeupList& SystemSuspend::getWakeupList() const {
     return mWakeupList;
 }
 
+const StatsHistory& SystemSuspend::getStatsHistory() const {
+    return mStatsHistory;
+}
+
 /**
  * Returns suspend stats.
  */
@@ -466,6 +643,10 @@ std::chrono::milliseconds SystemSuspend::getSleepTime() const {
     return mSleepTime;
 }
 
+BackoffPolicyType SystemSuspend::getBackoffPolicy() const {
+    return kSleepTimeConfig.backoffPolicy;
+}
+
 }  // namespace V1_0
 }  // namespace suspend
 }  // namespace system
@@ -20,16 +20,27 @@
 #include <android-base/result.h>
 #include <android-base/unique_fd.h>
 #include <android/system/suspend/1.0/ISystemSuspend.h>
+#include <android/system/suspend/internal/BnWakeLockBatch.h>
 #include <android/system/suspend/internal/SuspendInfo.h>
+#include <android/system/suspend/internal/SuspendPhaseLatency.h>
 #include <hidl/HidlTransportSupport.h>
 
+#include <array>
 #include <atomic>
-#include <condition_variable>
 #include <mutex>
 #include <string>
+#include <vector>
 
+#include "LatencyHistogram.h"
+#include "PostResumeWorker.h"
+#include "StatsHistory.h"
+#include "SuspendBackoffPolicy.h"
 #include "SuspendControlService.h"
+#include "SuspendCounter.h"
+#include "SuspendHistory.h"
+#include "SysfsReader.h"
 #include "WakeLockEntryList.h"
+#include "WakeLockTokenTable.h"
 #include "WakeupList.h"
 
 namespace android {
@@ -42,7 +53,10 @@ using ::android::base::unique_fd;
 using ::android::hardware::hidl_string;
 using ::android::hardware::interfacesEqual;
 using ::android::hardware::Return;
+using ::android::system::suspend::internal::BnWakeLockBatch;
+using ::android::system::suspend::internal::IWakeLockBatch;
 using ::android::system::suspend::internal::SuspendInfo;
+using ::android::system::suspend::internal::SuspendPhaseLatency;
 
 using namespace std::chrono_literals;
 
@@ -64,14 +78,17 @@ struct SuspendStats {
     std::string lastFailedStep;
 };
 
-struct SleepTimeConfig {
-    std::chrono::milliseconds baseSleepTime;
-    std::chrono::milliseconds maxSleepTime;
-    double sleepTimeScaleFactor;
-    uint32_t backoffThreshold;
-    std::chrono::milliseconds shortSuspendThreshold;
-    bool failedSuspendBackoffEnabled;
-    bool shortSuspendBackoffEnabled;
+// Phases of a suspend attempt made by the autosuspend loop, timed for latency stats.
+enum SuspendPhase : size_t {
+    // Waiting for all native wake locks to be released
+    WAIT_FOR_WAKE_LOCKS,
+    // Writing /sys/power/wakeup_count
+    WRITE_WAKEUP_COUNT,
+    // Writing /sys/power/state, i.e. suspending and resuming
+    WRITE_STATE,
+    // Reading the suspend time and wakeup reasons and queueing the wakeup for PostResumeWorker
+    POST_RESUME,
+    NUM_SUSPEND_PHASES,
 };
 
 std::string readFd(int fd);
@@ -82,6 +99,8 @@ class WakeLock : public IWakeLock {
     ~WakeLock();
 
     Return<void> release();
+    // Stats key, made once for both the acquire and the release stats updates.
+    const WakeLockStatsKey& getStatsKey() const { return mStatsKey; }
 
    private:
     inline void releaseOnce();
@@ -89,7 +108,26 @@ class WakeLock : public IWakeLock {
 
     SystemSuspend* mSystemSuspend;
     std::string mName;
-    int mPid;
+    WakeLockStatsKey mStatsKey;
+};
+
+// Wake locks acquired together through ISuspendControlServiceInternal::acquireWakeLocks().
+class WakeLockBatch : public BnWakeLockBatch {
+   public:
+    WakeLockBatch(SystemSuspend* systemSuspend, std::vector<std::string> names, int pid);
+    ~WakeLockBatch();
+
+    binder::Status release() override;
+    binder::Status releaseAsync() override;
+    const std::vector<WakeLockStatsKey>& getStatsKeys() const { return mStatsKeys; }
+
+   private:
+    void releaseOnce();
+    std::once_flag mReleased;
+
+    SystemSuspend* mSystemSuspend;
+    const std::vector<std::string> mNames;
+    std::vector<WakeLockStatsKey> mStatsKeys;
 };
 
 class SystemSuspend : public ISystemSuspend {
@@ -100,28 +138,44 @@ class SystemSuspend : public ISystemSuspend {
                   const SleepTimeConfig& sleepTimeConfig,
                   const sp<SuspendControlService>& controlService,
                   const sp<SuspendControlServiceInternal>& controlServiceInternal,
-                  bool useSuspendCounter = true);
+                  bool useSuspendCounter = true,
+                  std::chrono::milliseconds kernelWakelockRefreshInterval = 0ms);
     Return<sp<IWakeLock>> acquireWakeLock(WakeLockType type, const hidl_string& name) override;
+    sp<IWakeLockBatch> acquireWakeLocks(const std::vector<std::string>& names, int pid);
+    status_t acquireWakeLockToken(const sp<IBinder>& client,
+                                  const sp<IBinder::DeathRecipient>& recipient,
+                                  const std::string& name, int pid, uid_t uid, int64_t* token);
+    status_t releaseWakeLockToken(int64_t token, uid_t uid,
+                                  const sp<IBinder::DeathRecipient>& recipient);
+    void releaseWakeLockTokens(const IBinder* client);
     void incSuspendCounter(const std::string& name);
     void decSuspendCounter(const std::string& name);
     bool enableAutosuspend();
     bool forceSuspend();
 
     const WakeupList& getWakeupList() const;
-    const WakeLockEntryList& getStatsList() const;
-    void updateWakeLockStatOnRelease(const std::string& name, int pid, TimestampType timeNow);
+    const StatsHistory& getStatsHistory() const;
+    WakeLockEntryList& getStatsList();
+    void updateWakeLockStatOnRelease(const std::string& name, const WakeLockStatsKey& statsKey,
+                                     TimestampType timeNow);
+    void updateWakeLockStatsOnRelease(const std::vector<std::string>& names,
+                                      const std::vector<WakeLockStatsKey>& statsKeys,
+                                      TimestampType timeNow);
     void updateStatsNow();
     Result<SuspendStats> getSuspendStats();
     void getSuspendInfo(SuspendInfo* info);
+    void getSuspendLatencyStats(std::vector<SuspendPhaseLatency>* latencies);
+    PostResumeStats getPostResumeStats() const;
+    void getSuspendHistory(std::vector<SuspendAttemptInfo>* history) const;
     std::chrono::milliseconds getSleepTime() const;
+    BackoffPolicyType getBackoffPolicy() const;
     unique_fd reopenFileUsingFd(const int fd, int permission);
 
    private:
     void initAutosuspend();
+    void waitForNextSuspendAttempt();
 
-    std::mutex mCounterLock;
-    std::condition_variable mCounterCondVar;
-    uint32_t mSuspendCounter;
+    SuspendCounter mSuspendCounter;
     unique_fd mWakeupCountFd;
     unique_fd mStateFd;
 
@@ -131,19 +185,29 @@ class SystemSuspend : public ISystemSuspend {
     std::mutex mSuspendInfoLock;
     SuspendInfo mSuspendInfo;
 
+    // Only written to by the autosuspend thread.
+    SuspendHistory mSuspendHistory;
+
+    std::mutex mSuspendLatencyLock;
+    std::array<LatencyHistogram, NUM_SUSPEND_PHASES> mSuspendLatency;
+    void recordSuspendLatency(SuspendPhase phase, std::chrono::steady_clock::duration latency);
+
     const SleepTimeConfig kSleepTimeConfig;
 
     // Amount of thread sleep time between consecutive iterations of the suspend loop
     std::chrono::milliseconds mSleepTime;
-    int32_t mNumConsecutiveBadSuspends;
+    // Only used by the autosuspend thread.
+    std::unique_ptr<SuspendBackoffPolicy> mBackoffPolicy;
 
     // Updates thread sleep time and suspend stats depending on the result of suspend attempt
-    void updateSleepTime(bool success, const struct SuspendTime& suspendTime);
+    void updateSleepTime(bool success, const struct SuspendTime& suspendTime,
+                         const std::vector<std::string>& wakeupReasons);
 
     sp<SuspendControlService> mControlService;
     sp<SuspendControlServiceInternal> mControlServiceInternal;
 
     WakeLockEntryList mStatsList;
+    WakeLockTokenTable mWakeLockTokens;
     WakeupList mWakeupList;
 
     // If true, use mSuspendCounter to keep track of native wake locks. Otherwise, rely on
@@ -155,6 +219,13 @@ class SystemSuspend : public ISystemSuspend {
     unique_fd mWakeupReasonsFd;
 
     std::atomic_flag mAutosuspendEnabled = ATOMIC_FLAG_INIT;
+
+    // Updates mWakeupList and notifies wakeup callbacks off the autosuspend thread. Declared after
+    // the members it uses so that its thread is stopped before they are destroyed.
+    PostResumeWorker mPostResumeWorker;
+    // Samples mStatsList and mWakeupList on its own thread, declared after them for the same
+    // reason.
+    StatsHistory mStatsHistory;
 };
 
 }  // namespace V1_0
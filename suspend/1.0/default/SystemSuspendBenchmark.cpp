@@ -14,19 +14,58 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
+#include <android-base/strings.h>
 #include <android/system/suspend/1.0/ISystemSuspend.h>
 #include <android/system/suspend/internal/ISuspendControlServiceInternal.h>
 #include <benchmark/benchmark.h>
 #include <binder/IServiceManager.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+
+#include "SysfsReader.h"
 
 using android::IBinder;
+using android::base::ReadFdToString;
+using android::base::TemporaryFile;
+using android::base::WriteStringToFile;
 using android::sp;
 using android::system::suspend::internal::ISuspendControlServiceInternal;
 using android::system::suspend::internal::WakeLockInfo;
 using android::system::suspend::V1_0::ISystemSuspend;
 using android::system::suspend::V1_0::IWakeLock;
+using android::system::suspend::V1_0::parseSuspendTime;
+using android::system::suspend::V1_0::parseWakeupReasons;
+using android::system::suspend::V1_0::SysfsReader;
 using android::system::suspend::V1_0::WakeLockType;
 
+// Counts heap allocations so that benchmarks can report allocations per iteration.
+static std::atomic<size_t> gAllocationCount{0};
+
+void* operator new(size_t size) {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size);
+    if (p == nullptr) abort();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+static void reportAllocations(benchmark::State& state, size_t allocationsAtStart) {
+    state.counters["allocs_per_iter"] =
+        benchmark::Counter(gAllocationCount.load() - allocationsAtStart,
+                           benchmark::Counter::kAvgIterations);
+}
+
+static constexpr char kSuspendTime[] = "0.012345678 10.500000000\n";
+static constexpr char kWakeupReasons[] = "170 qpnp_rtc_alarm\n208 wlan_wake_irq_handler\n";
+
 static void BM_acquireWakeLock(benchmark::State& state) {
     static sp<ISystemSuspend> suspendService = ISystemSuspend::getService();
 
@@ -49,4 +88,71 @@ static void BM_getWakeLockStats(benchmark::State& state) {
 }
 BENCHMARK(BM_getWakeLockStats);
 
+// Reads last_suspend_time and last_resume_reason the way the autosuspend loop used to: with
+// ReadFdToString, std::stringstream and a fresh vector of reasons per iteration.
+static void BM_readSuspendSysfsLegacy(benchmark::State& state) {
+    TemporaryFile suspendTimeFile;
+    TemporaryFile wakeupReasonsFile;
+    WriteStringToFile(kSuspendTime, suspendTimeFile.path);
+    WriteStringToFile(kWakeupReasons, wakeupReasonsFile.path);
+    int suspendTimeFd = open(suspendTimeFile.path, O_CLOEXEC | O_RDONLY);
+    int wakeupReasonsFd = open(wakeupReasonsFile.path, O_CLOEXEC | O_RDONLY);
+
+    size_t allocationsAtStart = gAllocationCount.load();
+    for (auto _ : state) {
+        std::string content;
+        lseek(suspendTimeFd, 0, SEEK_SET);
+        ReadFdToString(suspendTimeFd, &content);
+        double suspendOverhead, suspendTime;
+        std::stringstream timeStream(content);
+        timeStream >> suspendOverhead >> suspendTime;
+        benchmark::DoNotOptimize(suspendTime);
+
+        std::vector<std::string> wakeupReasons;
+        std::string reasonlines;
+        lseek(wakeupReasonsFd, 0, SEEK_SET);
+        ReadFdToString(wakeupReasonsFd, &reasonlines);
+        std::stringstream reasonStream(reasonlines);
+        for (std::string reasonline; std::getline(reasonStream, reasonline);) {
+            reasonline = android::base::Trim(reasonline);
+            if (!reasonline.empty()) {
+                wakeupReasons.push_back(reasonline);
+            }
+        }
+        benchmark::DoNotOptimize(wakeupReasons);
+    }
+    reportAllocations(state, allocationsAtStart);
+
+    close(suspendTimeFd);
+    close(wakeupReasonsFd);
+}
+BENCHMARK(BM_readSuspendSysfsLegacy);
+
+// Reads the same nodes with SysfsReader, as the autosuspend loop does now.
+static void BM_readSuspendSysfs(benchmark::State& state) {
+    TemporaryFile suspendTimeFile;
+    TemporaryFile wakeupReasonsFile;
+    WriteStringToFile(kSuspendTime, suspendTimeFile.path);
+    WriteStringToFile(kWakeupReasons, wakeupReasonsFile.path);
+    int suspendTimeFd = open(suspendTimeFile.path, O_CLOEXEC | O_RDONLY);
+    int wakeupReasonsFd = open(wakeupReasonsFile.path, O_CLOEXEC | O_RDONLY);
+
+    SysfsReader reader;
+    std::vector<std::string> wakeupReasons;
+    size_t allocationsAtStart = gAllocationCount.load();
+    for (auto _ : state) {
+        std::chrono::nanoseconds suspendOverhead, suspendTime;
+        parseSuspendTime(reader.read(suspendTimeFd), &suspendOverhead, &suspendTime);
+        benchmark::DoNotOptimize(suspendTime);
+
+        parseWakeupReasons(reader.read(wakeupReasonsFd), &wakeupReasons);
+        benchmark::DoNotOptimize(wakeupReasons);
+    }
+    reportAllocations(state, allocationsAtStart);
+
+    close(suspendTimeFd);
+    close(wakeupReasonsFd);
+}
+BENCHMARK(BM_readSuspendSysfs);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,683 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the autosuspend loop of SystemSuspend against FakeKernel. Unlike SystemSuspendBenchmark,
+// this needs neither root, sysfs nor a running suspend service.
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <binder/Binder.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "FakeKernel.h"
+#include "KernelWakelockStatsReader.h"
+#include "SuspendControlService.h"
+#include "SuspendCounter.h"
+#include "SystemSuspend.h"
+#include "WakeLockEntryList.h"
+
+using android::BBinder;
+using android::IBinder;
+using android::sp;
+using android::base::unique_fd;
+using android::system::suspend::internal::IWakeLockBatch;
+using android::system::suspend::internal::WakeLockInfo;
+using android::system::suspend::internal::WakeLockStatsDelta;
+using android::system::suspend::V1_0::BackoffPolicyType;
+using android::system::suspend::V1_0::FakeKernel;
+using android::system::suspend::V1_0::FakeKernelConfig;
+using android::system::suspend::V1_0::FakeKernelStats;
+using android::system::suspend::V1_0::IWakeLock;
+using android::system::suspend::V1_0::KernelWakelockStatsReader;
+using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendControlService;
+using android::system::suspend::V1_0::SuspendControlServiceInternal;
+using android::system::suspend::V1_0::SuspendCounter;
+using android::system::suspend::V1_0::SystemSuspend;
+using android::system::suspend::V1_0::WakeLockEntryList;
+using android::system::suspend::V1_0::WakeLockMetric;
+using android::system::suspend::V1_0::WakeLockStatsKey;
+using android::system::suspend::V1_0::WakeLockType;
+
+using namespace std::chrono_literals;
+
+// Suspend as fast as the fake kernel allows.
+static constexpr SleepTimeConfig kSleepTimeConfig = {
+    .baseSleepTime = 0ms,
+    .maxSleepTime = 0ms,
+    .sleepTimeScaleFactor = 1.0,
+    .backoffThreshold = 0,
+    .shortSuspendThreshold = 0ms,
+    .failedSuspendBackoffEnabled = false,
+    .shortSuspendBackoffEnabled = false,
+    .eventDrivenAutosuspendEnabled = false,
+    .backoffPolicy = BackoffPolicyType::EXPONENTIAL,
+};
+static constexpr size_t kMaxStatsEntries = 100;
+static constexpr auto kAttemptTimeout = 10s;
+
+/*
+ * The autosuspend thread can't be stopped, so a single loop is shared by all benchmarks. It is
+ * kept idle with a wakelock while no benchmark is running.
+ */
+class SuspendLoop {
+   public:
+    SuspendLoop() : mKernel(FakeKernelConfig{}, 0) {
+        sp<SuspendControlService> controlService = new SuspendControlService();
+        sp<SuspendControlServiceInternal> controlServiceInternal =
+            new SuspendControlServiceInternal();
+        mSuspend = new SystemSuspend(
+            mKernel.takeWakeupCountFd(), mKernel.takeStateFd(), mKernel.openSuspendStatsFd(),
+            kMaxStatsEntries, mKernel.openKernelWakelockStatsFd(), mKernel.openWakeupReasonsFd(),
+            mKernel.openSuspendTimeFd(), kSleepTimeConfig, controlService, controlServiceInternal);
+        pause();
+        if (!mSuspend->enableAutosuspend()) {
+            LOG(FATAL) << "Failed to enable autosuspend";
+        }
+    }
+
+    static SuspendLoop& get() {
+        static SuspendLoop* loop = new SuspendLoop();
+        return *loop;
+    }
+
+    FakeKernel& kernel() { return mKernel; }
+    SystemSuspend& suspend() { return *mSuspend; }
+
+    // Lets the loop run with the given kernel behaviour and waits for one suspend attempt per
+    // iteration.
+    void run(benchmark::State& state, const FakeKernelConfig& config) {
+        mKernel.setConfig(config);
+        FakeKernelStats start = mKernel.getStats();
+        uint64_t attempts = start.attempts;
+        resume();
+        for (auto _ : state) {
+            if (!mKernel.waitForAttempts(++attempts, kAttemptTimeout)) {
+                state.SkipWithError("Timed out waiting for a suspend attempt");
+                break;
+            }
+        }
+        pause();
+
+        FakeKernelStats end = mKernel.getStats();
+        state.SetItemsProcessed(state.iterations());
+        state.counters["aborted"] = benchmark::Counter(end.aborted - start.aborted);
+    }
+
+    // Lets the loop run while at least one thread of a multi-threaded benchmark needs it to.
+    void addRunner(const FakeKernelConfig& config) {
+        std::scoped_lock lock(mRunnersLock);
+        if (mRunners++ == 0) {
+            mKernel.setConfig(config);
+            resume();
+        }
+    }
+
+    void removeRunner() {
+        std::scoped_lock lock(mRunnersLock);
+        if (--mRunners == 0) {
+            pause();
+        }
+    }
+
+   private:
+    void pause() {
+        mPauseLock = mSuspend->acquireWakeLock(WakeLockType::PARTIAL, "SuspendLoopBenchmark");
+    }
+
+    void resume() {
+        mPauseLock->release();
+        mPauseLock.clear();
+    }
+
+    FakeKernel mKernel;
+    sp<SystemSuspend> mSuspend;
+    sp<IWakeLock> mPauseLock;
+    std::mutex mRunnersLock;
+    int mRunners = 0;
+};
+
+// Suspend attempts per second for a given time spent in the write to /sys/power/state, in us.
+static void BM_suspendLoop(benchmark::State& state) {
+    FakeKernelConfig config;
+    config.suspendLatency = std::chrono::microseconds(state.range(0));
+    SuspendLoop::get().run(state, config);
+}
+BENCHMARK(BM_suspendLoop)->Arg(0)->Arg(100)->Arg(1000)->UseRealTime();
+
+// Every Nth suspend attempt is aborted by the kernel.
+static void BM_suspendLoopWithAborts(benchmark::State& state) {
+    FakeKernelConfig config;
+    config.failEvery = state.range(0);
+    SuspendLoop::get().run(state, config);
+}
+BENCHMARK(BM_suspendLoopWithAborts)->Arg(1)->Arg(2)->Arg(10)->UseRealTime();
+
+// Each suspend reports one of N distinct wakeup reasons.
+static void BM_suspendLoopWithWakeupReasons(benchmark::State& state) {
+    FakeKernelConfig config;
+    config.wakeupReasons.clear();
+    for (int64_t i = 0; i < state.range(0); i++) {
+        config.wakeupReasons.push_back(std::to_string(100 + i) + " fake_irq_" + std::to_string(i));
+    }
+    SuspendLoop::get().run(state, config);
+}
+BENCHMARK(BM_suspendLoopWithWakeupReasons)->Arg(1)->Arg(100)->Arg(1000)->UseRealTime();
+
+// Acquires and releases a native wake lock from several threads at once. With arg 1, the loop
+// keeps attempting to suspend meanwhile, each attempt blocking acquisitions while it's in
+// progress.
+static void BM_suspendCounterContention(benchmark::State& state) {
+    SuspendLoop& loop = SuspendLoop::get();
+    const bool suspending = state.range(0);
+    if (suspending) {
+        FakeKernelConfig config;
+        config.suspendLatency = 100us;
+        loop.addRunner(config);
+    }
+    for (auto _ : state) {
+        loop.suspend().incSuspendCounter("SuspendCounterBenchmark");
+        loop.suspend().decSuspendCounter("SuspendCounterBenchmark");
+    }
+    if (suspending) {
+        loop.removeRunner();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_suspendCounterContention)
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+/*
+ * The counter SystemSuspend used before SuspendCounter, for comparison: a mutex held by the
+ * autosuspend loop from the check that no wake lock is held until the write to /sys/power/state
+ * returns, which also serializes increments and decrements.
+ */
+class MutexSuspendCounter {
+   public:
+    void increment() {
+        std::scoped_lock lock(mLock);
+        mCount++;
+    }
+
+    void decrement() {
+        std::scoped_lock lock(mLock);
+        if (--mCount == 0) {
+            mCondVar.notify_one();
+        }
+    }
+
+    void beginSuspend() {
+        mSuspendLock = std::unique_lock(mLock);
+        mCondVar.wait(mSuspendLock, [this] { return mCount == 0; });
+    }
+
+    void endSuspend() { mSuspendLock.unlock(); }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCondVar;
+    uint32_t mCount = 0;
+    // Only used by the suspending thread
+    std::unique_lock<std::mutex> mSuspendLock;
+};
+
+/*
+ * Same as BM_suspendCounterContention for a bare counter, so that SuspendCounter can be compared
+ * with MutexSuspendCounter. With arg 1, a thread keeps simulating suspend attempts taking 100us.
+ */
+template <typename Counter>
+static void BM_suspendCounter(benchmark::State& state) {
+    static Counter* counter;
+    static std::atomic<bool> stopSuspending;
+    static std::thread suspender;
+    const bool suspending = state.range(0);
+    if (state.thread_index() == 0) {
+        counter = new Counter();
+        if (suspending) {
+            stopSuspending = false;
+            suspender = std::thread([] {
+                while (!stopSuspending) {
+                    counter->beginSuspend();
+                    std::this_thread::sleep_for(100us);
+                    counter->endSuspend();
+                }
+            });
+        }
+    }
+    for (auto _ : state) {
+        counter->increment();
+        counter->decrement();
+    }
+    if (state.thread_index() == 0) {
+        if (suspending) {
+            stopSuspending = true;
+            suspender.join();
+        }
+        delete counter;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_suspendCounter, SuspendCounter)
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_suspendCounter, MutexSuspendCounter)
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+static std::vector<std::string> makeWakeLockNames(size_t count) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < count; i++) {
+        names.push_back("BenchmarkWakeLock" + std::to_string(i));
+    }
+    return names;
+}
+
+// Acquires and releases N wake locks one at a time.
+static void BM_acquireWakeLocksIndividually(benchmark::State& state) {
+    SystemSuspend& suspend = SuspendLoop::get().suspend();
+    const std::vector<std::string> names = makeWakeLockNames(state.range(0));
+    std::vector<sp<IWakeLock>> wakeLocks(names.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < names.size(); i++) {
+            wakeLocks[i] = suspend.acquireWakeLock(WakeLockType::PARTIAL, names[i]);
+        }
+        for (auto& wakeLock : wakeLocks) {
+            wakeLock->release();
+            wakeLock.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_acquireWakeLocksIndividually)->Arg(1)->Arg(8)->Arg(32);
+
+// Acquires and releases N wake locks as a batch.
+static void BM_acquireWakeLockBatch(benchmark::State& state) {
+    SystemSuspend& suspend = SuspendLoop::get().suspend();
+    const std::vector<std::string> names = makeWakeLockNames(state.range(0));
+    for (auto _ : state) {
+        sp<IWakeLockBatch> batch = suspend.acquireWakeLocks(names, getpid());
+        batch->release();
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_acquireWakeLockBatch)->Arg(1)->Arg(8)->Arg(32);
+
+// Acquires and releases N wake locks by token.
+static void BM_acquireWakeLockTokens(benchmark::State& state) {
+    SystemSuspend& suspend = SuspendLoop::get().suspend();
+    const std::vector<std::string> names = makeWakeLockNames(state.range(0));
+    sp<IBinder> client = new BBinder();
+    std::vector<int64_t> tokens(names.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < names.size(); i++) {
+            suspend.acquireWakeLockToken(client, nullptr, names[i], getpid(), getuid(), &tokens[i]);
+        }
+        for (int64_t token : tokens) {
+            suspend.releaseWakeLockToken(token, getuid(), nullptr);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_acquireWakeLockTokens)->Arg(1)->Arg(8)->Arg(32);
+
+// Collects wakelock stats with N wakeup sources under /sys/class/wakeup.
+static void BM_getWakeLockStatsWithKernelWakeupSources(benchmark::State& state) {
+    SuspendLoop& loop = SuspendLoop::get();
+    loop.kernel().setNumWakeupSources(state.range(0));
+
+    std::vector<WakeLockInfo> wlStats;
+    for (auto _ : state) {
+        wlStats.clear();
+        loop.suspend().updateStatsNow();
+        loop.suspend().getStatsList().getWakeLockStats(&wlStats);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+
+    loop.kernel().setNumWakeupSources(0);
+}
+BENCHMARK(BM_getWakeLockStatsWithKernelWakeupSources)->Arg(10)->Arg(100)->Arg(500)->Arg(1000);
+
+// Reads the stats of 500 wakeup sources with N threads.
+static void BM_readKernelWakelockStats(benchmark::State& state) {
+    SuspendLoop& loop = SuspendLoop::get();
+    loop.kernel().setNumWakeupSources(500);
+    KernelWakelockStatsReader reader(loop.kernel().openKernelWakelockStatsFd(), state.range(0));
+
+    std::vector<WakeLockInfo> wlStats;
+    for (auto _ : state) {
+        wlStats.clear();
+        reader.getStats(&wlStats);
+    }
+    state.SetItemsProcessed(state.iterations() * wlStats.size());
+
+    loop.kernel().setNumWakeupSources(0);
+}
+BENCHMARK(BM_readKernelWakelockStats)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+// Polls wakelock stats with 500 wakeup sources, accepting kernel wakelock stats up to N ms old.
+static void BM_getWakeLockStatsWithMaxAge(benchmark::State& state) {
+    SuspendLoop& loop = SuspendLoop::get();
+    loop.kernel().setNumWakeupSources(500);
+
+    std::vector<WakeLockInfo> wlStats;
+    for (auto _ : state) {
+        wlStats.clear();
+        loop.suspend().updateStatsNow();
+        loop.suspend().getStatsList().getWakeLockStats(std::chrono::milliseconds(state.range(0)),
+                                                       &wlStats);
+    }
+
+    loop.kernel().setNumWakeupSources(0);
+}
+BENCHMARK(BM_getWakeLockStatsWithMaxAge)->Arg(0)->Arg(1000);
+
+// Capacity of the native wake lock stats of the service, and number of wake lock updates folded
+// into them per iteration of the benchmarks below.
+static constexpr size_t kStatsCapacity = 1000;
+static constexpr size_t kStatsBatchSize = 100;
+
+// Makes the stats keys of held wake locks, as the service does when they are created.
+static std::vector<WakeLockStatsKey> makeStatsKeys(WakeLockEntryList* list,
+                                                   const std::vector<std::string>& names) {
+    std::vector<WakeLockStatsKey> keys;
+    for (const std::string& name : names) {
+        keys.push_back(list->addKey(name, getpid()));
+    }
+    return keys;
+}
+
+// Acquires and releases wake locks whose stats are already in a full stats list.
+static void BM_wakeLockStatsHit(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    const std::vector<WakeLockStatsKey> keys = makeStatsKeys(&list, names);
+    for (const WakeLockStatsKey& key : keys) {
+        list.updateOnAcquire(key, 0);
+    }
+    list.updateNow();
+
+    size_t next = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < kStatsBatchSize; i++) {
+            const WakeLockStatsKey& key = keys[next++ % keys.size()];
+            list.updateOnAcquire(key, 0);
+            list.updateOnRelease(key, 0);
+        }
+        list.updateNow();
+    }
+    state.SetItemsProcessed(state.iterations() * kStatsBatchSize);
+}
+BENCHMARK(BM_wakeLockStatsHit);
+
+// Acquires wake locks without stats into an empty stats list until it is full.
+static void BM_wakeLockStatsMiss(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto list = std::make_unique<WakeLockEntryList>(kStatsCapacity, unique_fd());
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < names.size(); i++) {
+            list->updateOnAcquire(names[i], getpid(), 0);
+            if (i % kStatsBatchSize == kStatsBatchSize - 1) {
+                list->updateNow();
+            }
+        }
+        list->updateNow();
+
+        state.PauseTiming();
+        list.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_wakeLockStatsMiss);
+
+// Acquires wake locks without stats into a full stats list, each evicting the LRU stat.
+static void BM_wakeLockStatsEviction(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(2 * kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    size_t next = 0;
+    for (; next < kStatsCapacity; next++) {
+        list.updateOnAcquire(names[next], getpid(), 0);
+    }
+    list.updateNow();
+
+    // The list always holds the kStatsCapacity names preceding next.
+    for (auto _ : state) {
+        for (size_t i = 0; i < kStatsBatchSize; i++) {
+            list.updateOnAcquire(names[next++ % names.size()], getpid(), 0);
+        }
+        list.updateNow();
+    }
+    state.SetItemsProcessed(state.iterations() * kStatsBatchSize);
+}
+BENCHMARK(BM_wakeLockStatsEviction);
+
+// Updates the active times of a full stats list in which N wake locks are active.
+static void BM_wakeLockStatsUpdateNow(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    for (size_t i = 0; i < names.size(); i++) {
+        list.updateOnAcquire(names[i], getpid(), 0);
+        if (i >= static_cast<size_t>(state.range(0))) {
+            list.updateOnRelease(names[i], getpid(), 0);
+        }
+    }
+    list.updateNow();
+
+    for (auto _ : state) {
+        list.updateNow();
+    }
+}
+BENCHMARK(BM_wakeLockStatsUpdateNow)->Arg(0)->Arg(10)->Arg(kStatsCapacity);
+
+// Polls the stats of a full stats list in which 10 wake locks were acquired and released since the
+// previous poll, with arg 1 only asking for the stats changed since.
+static void BM_wakeLockStatsDelta(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    const std::vector<WakeLockStatsKey> keys = makeStatsKeys(&list, names);
+    for (const WakeLockStatsKey& key : keys) {
+        list.updateOnAcquire(key, 0);
+        list.updateOnRelease(key, 0);
+    }
+
+    WakeLockStatsDelta delta;
+    size_t next = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < 10; i++) {
+            const WakeLockStatsKey& key = keys[next++ % keys.size()];
+            list.updateOnAcquire(key, 0);
+            list.updateOnRelease(key, 0);
+        }
+        list.getWakeLockStatsDelta(state.range(0) ? delta.generation : 0, &delta);
+    }
+}
+BENCHMARK(BM_wakeLockStatsDelta)->Arg(0)->Arg(1);
+
+// Gets the 20 wake locks with the largest total time out of a full stats list in which 10 wake
+// locks were held since the previous call, with arg 0 by sorting all of the stats as callers had
+// to, and with arg 1 from the rankings kept by the list.
+static void BM_wakeLockStatsTop(benchmark::State& state) {
+    constexpr size_t kTop = 20;
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    const std::vector<WakeLockStatsKey> keys = makeStatsKeys(&list, names);
+    for (size_t i = 0; i < keys.size(); i++) {
+        list.updateOnAcquire(keys[i], 0);
+        list.updateOnRelease(keys[i], i);
+    }
+
+    std::vector<WakeLockInfo> wlStats;
+    size_t next = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < 10; i++) {
+            const WakeLockStatsKey& key = keys[next++ % keys.size()];
+            list.updateOnAcquire(key, 0);
+            list.updateOnRelease(key, next % 100);
+        }
+        wlStats.clear();
+        if (state.range(0)) {
+            list.getTopWakeLockStats(WakeLockMetric::TOTAL_TIME, kTop, 0ms, &wlStats);
+        } else {
+            list.getWakeLockStats(&wlStats);
+            std::partial_sort(wlStats.begin(), wlStats.begin() + kTop, wlStats.end(),
+                              [](const WakeLockInfo& a, const WakeLockInfo& b) {
+                                  return a.totalTime > b.totalTime;
+                              });
+            wlStats.resize(kTop);
+        }
+    }
+}
+BENCHMARK(BM_wakeLockStatsTop)->Arg(0)->Arg(1);
+
+// Dumps the stats of a full stats list.
+static void BM_wakeLockStatsDump(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    for (const std::string& name : names) {
+        list.updateOnAcquire(name, getpid(), 0);
+    }
+    unique_fd devNull{TEMP_FAILURE_RETRY(open("/dev/null", O_WRONLY | O_CLOEXEC))};
+
+    for (auto _ : state) {
+        list.dump(devNull);
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_wakeLockStatsDump);
+
+// Folds an acquire and a release into a full stats list while, with arg 1, another thread keeps
+// copying the whole list out.
+static void BM_wakeLockStatsUpdateWithConcurrentReads(benchmark::State& state) {
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    WakeLockEntryList list(kStatsCapacity, unique_fd());
+    const std::vector<WakeLockStatsKey> keys = makeStatsKeys(&list, names);
+    for (const WakeLockStatsKey& key : keys) {
+        list.updateOnAcquire(key, 0);
+        list.updateOnRelease(key, 0);
+    }
+    list.updateNow();
+
+    std::atomic<bool> done = false;
+    std::thread reader;
+    if (state.range(0)) {
+        reader = std::thread([&] {
+            std::vector<WakeLockInfo> wlStats;
+            while (!done) {
+                wlStats.clear();
+                list.getWakeLockStats(&wlStats);
+            }
+        });
+    }
+
+    // Each iteration blocks for as long as it waits for the reader to release the stats lock, so
+    // the tail latency matters more than the mean.
+    std::vector<int64_t> latencies;
+    latencies.reserve(1 << 20);
+    size_t next = 0;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        const WakeLockStatsKey& key = keys[next++ % keys.size()];
+        list.updateOnAcquire(key, 0);
+        list.updateOnRelease(key, 0);
+        list.updateNow();
+        if (latencies.size() < latencies.capacity()) {
+            latencies.push_back((std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    if (!latencies.empty()) {
+        auto p999 = latencies.begin() + latencies.size() * 999 / 1000;
+        std::nth_element(latencies.begin(), p999, latencies.end());
+        state.counters["p99.9_ns"] = *p999;
+    }
+
+    done = true;
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+BENCHMARK(BM_wakeLockStatsUpdateWithConcurrentReads)->Arg(0)->Arg(1)->UseRealTime();
+
+// Hashes kStatsCapacity stats keys, and reports how often they collide in a stats index of the
+// service size. With arg 0 all keys have distinct names and the same pid, with arg 1 the same name
+// and distinct pids, with arg 2 a few names held by a few pids each.
+static void BM_wakeLockStatsKeyHash(benchmark::State& state) {
+    std::vector<std::pair<std::string, int>> keys;
+    const std::vector<std::string> names = makeWakeLockNames(kStatsCapacity);
+    for (size_t i = 0; i < kStatsCapacity; i++) {
+        switch (state.range(0)) {
+            case 0:
+                keys.emplace_back(names[i], 1000);
+                break;
+            case 1:
+                keys.emplace_back(names[0], 1000 + i);
+                break;
+            default:
+                keys.emplace_back(names[i % 32], 1000 + i / 32);
+                break;
+        }
+    }
+
+    // Same sizing as WakeLockEntryList: the smallest power of two at least twice the capacity.
+    size_t numBuckets = 1;
+    while (numBuckets < 2 * kStatsCapacity) {
+        numBuckets <<= 1;
+    }
+    std::vector<bool> used(numBuckets);
+    size_t collisions = 0;
+    size_t probes = 0;
+    for (const auto& [name, pid] : keys) {
+        size_t bucket = WakeLockEntryList::hashKey(name, pid) & (numBuckets - 1);
+        collisions += used[bucket];
+        for (; used[bucket]; bucket = (bucket + 1) & (numBuckets - 1)) {
+            probes++;
+        }
+        used[bucket] = true;
+    }
+
+    for (auto _ : state) {
+        for (const auto& [name, pid] : keys) {
+            benchmark::DoNotOptimize(WakeLockEntryList::hashKey(name, pid));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["collision_rate"] = static_cast<double>(collisions) / keys.size();
+    state.counters["extra_probes"] = static_cast<double>(probes) / keys.size();
+}
+BENCHMARK(BM_wakeLockStatsKeyHash)->Arg(0)->Arg(1)->Arg(2);
+
+BENCHMARK_MAIN();
@@ -17,9 +17,11 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/result.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <android/system/suspend/BnSuspendCallback.h>
 #include <android/system/suspend/BnWakelockCallback.h>
+#include <binder/Binder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <binder/ProcessState.h>
@@ -32,6 +34,8 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <csignal>
@@ -39,14 +43,31 @@
 #include <future>
 #include <string>
 #include <thread>
-
+#include <tuple>
+#include <vector>
+
+#include "BinaryDump.h"
+#include "DumpWriter.h"
+#include "FakeKernel.h"
+#include "KernelWakelockStatsCache.h"
+#include "KernelWakelockStatsReader.h"
+#include "StatsHistory.h"
+#include "SuspendBackoffSimulator.h"
 #include "SuspendControlService.h"
 #include "SystemSuspend.h"
+#include "WakeLockEntryList.h"
+#include "WakeLockEventQueue.h"
+#include "WakeLockRanking.h"
 #include "WakeupList.h"
 
+using android::BBinder;
+using android::IBinder;
 using android::sp;
+using android::base::ReadFdToString;
+using android::base::ReadFileToString;
 using android::base::Result;
 using android::base::Socketpair;
+using android::base::Split;
 using android::base::unique_fd;
 using android::base::WriteStringToFd;
 using android::base::WriteStringToFile;
@@ -58,19 +79,56 @@ using android::system::suspend::BnSuspendCallback;
 using android::system::suspend::BnWakelockCallback;
 using android::system::suspend::ISuspendControlService;
 using android::system::suspend::internal::ISuspendControlServiceInternal;
+using android::system::suspend::internal::IWakeLockBatch;
+using android::system::suspend::internal::SuspendAttemptInfo;
+using android::system::suspend::internal::SuspendPhaseLatency;
 using android::system::suspend::internal::WakeLockInfo;
+using android::system::suspend::internal::WakeLockStatsDelta;
 using android::system::suspend::internal::WakeupInfo;
+using android::system::suspend::V1_0::BackoffEvent;
+using android::system::suspend::V1_0::BackoffPolicyType;
+using android::system::suspend::V1_0::BinaryDump;
+using android::system::suspend::V1_0::decodeBinaryDump;
+using android::system::suspend::V1_0::DumpedWakeLock;
+using android::system::suspend::V1_0::DumpWriter;
+using android::system::suspend::V1_0::EwmaBackoffPolicy;
+using android::system::suspend::V1_0::ExponentialBackoffPolicy;
+using android::system::suspend::V1_0::FakeKernel;
+using android::system::suspend::V1_0::FakeKernelConfig;
+using android::system::suspend::V1_0::FakeKernelStats;
 using android::system::suspend::V1_0::getTimeNow;
 using android::system::suspend::V1_0::ISystemSuspend;
+using android::system::suspend::V1_0::KernelWakelockStatsCache;
+using android::system::suspend::V1_0::KernelWakelockStatsReader;
 using android::system::suspend::V1_0::IWakeLock;
+using android::system::suspend::V1_0::LatencyHistogram;
+using android::system::suspend::V1_0::parseSuspendTime;
+using android::system::suspend::V1_0::parseSuspendTraceEntry;
+using android::system::suspend::V1_0::parseWakeupReasons;
+using android::system::suspend::V1_0::PostResumeStats;
+using android::system::suspend::V1_0::PostResumeWorker;
 using android::system::suspend::V1_0::readFd;
+using android::system::suspend::V1_0::SimulationResult;
+using android::system::suspend::V1_0::simulateSuspendBackoff;
 using android::system::suspend::V1_0::SleepTimeConfig;
+using android::system::suspend::V1_0::SuspendAttempt;
 using android::system::suspend::V1_0::SuspendControlService;
 using android::system::suspend::V1_0::SuspendControlServiceInternal;
+using android::system::suspend::V1_0::SuspendCounter;
+using android::system::suspend::V1_0::SuspendHistory;
+using android::system::suspend::V1_0::SuspendOutcome;
 using android::system::suspend::V1_0::SuspendStats;
+using android::system::suspend::V1_0::SuspendTraceEntry;
+using android::system::suspend::V1_0::SysfsReader;
 using android::system::suspend::V1_0::SystemSuspend;
 using android::system::suspend::V1_0::TimestampType;
+using android::system::suspend::V1_0::WakeLockEntryList;
+using android::system::suspend::V1_0::WakeLockEvent;
+using android::system::suspend::V1_0::WakeLockEventQueue;
+using android::system::suspend::V1_0::WakeLockStatsKey;
+using android::system::suspend::V1_0::WakeLockTokenTable;
 using android::system::suspend::V1_0::WakeLockType;
+using android::system::suspend::V1_0::WakeupReasonAwareBackoffPolicy;
 using android::system::suspend::V1_0::WakeupList;
 using namespace std::chrono_literals;
 
@@ -1009,6 +1067,86 @@ TEST_F(SystemSuspendSameThreadTest, GetNativeWakeLockStats) {
     ASSERT_EQ(nwlInfo.wakeupCount, 0);
 }
 
+// Test that wake locks acquired in a batch are accounted for like individual ones and released
+// together.
+TEST_F(SystemSuspendSameThreadTest, AcquireWakeLockBatch) {
+    bool retval = false;
+    MockWakelockCallbackImpl impl;
+    sp<MockWakelockCallback> cb = new MockWakelockCallback(&impl);
+    controlService->registerWakelockCallback(cb, "BatchLock1", &retval);
+    ASSERT_TRUE(retval);
+    EXPECT_CALL(impl, notifyAcquired).Times(1);
+    EXPECT_CALL(impl, notifyReleased).Times(1);
+
+    sp<IWakeLockBatch> batch;
+    ASSERT_TRUE(
+        controlServiceInternal->acquireWakeLocks({"BatchLock0", "BatchLock1"}, &batch).isOk());
+    ASSERT_NE(batch, nullptr);
+
+    // Only the most recently acquired wake lock fits in the stats.
+    std::vector<WakeLockInfo> wlStats = getWakelockStats();
+    ASSERT_EQ(wlStats.size(), 1);
+    WakeLockInfo nwlInfo;
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "BatchLock1", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, true);
+    ASSERT_EQ(nwlInfo.pid, getpid());
+
+    ASSERT_TRUE(batch->release().isOk());
+    ASSERT_TRUE(batch->release().isOk());
+    wlStats = getWakelockStats();
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "BatchLock1", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, false);
+
+    cb->disable();
+}
+
+// Test that a batch released asynchronously is released once, even if release() follows.
+TEST_F(SystemSuspendSameThreadTest, ReleaseWakeLockBatchAsync) {
+    bool retval = false;
+    MockWakelockCallbackImpl impl;
+    sp<MockWakelockCallback> cb = new MockWakelockCallback(&impl);
+    controlService->registerWakelockCallback(cb, "AsyncBatchLock", &retval);
+    ASSERT_TRUE(retval);
+    EXPECT_CALL(impl, notifyAcquired).Times(1);
+    EXPECT_CALL(impl, notifyReleased).Times(1);
+
+    sp<IWakeLockBatch> batch;
+    ASSERT_TRUE(controlServiceInternal->acquireWakeLocks({"AsyncBatchLock"}, &batch).isOk());
+    ASSERT_TRUE(batch->releaseAsync().isOk());
+    ASSERT_TRUE(batch->release().isOk());
+
+    std::vector<WakeLockInfo> wlStats = getWakelockStats();
+    WakeLockInfo nwlInfo;
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "AsyncBatchLock", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, false);
+
+    cb->disable();
+}
+
+// Test that token wake locks are accounted for like binder ones, and released when their client
+// dies.
+TEST_F(SystemSuspendSameThreadTest, AcquireWakeLockToken) {
+    sp<IBinder> client = new BBinder();
+    int64_t token;
+    ASSERT_TRUE(controlServiceInternal->acquireWakeLockToken(client, "TokenLock", &token).isOk());
+    std::vector<WakeLockInfo> wlStats = getWakelockStats();
+    WakeLockInfo nwlInfo;
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "TokenLock", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, true);
+    ASSERT_EQ(nwlInfo.pid, getpid());
+
+    ASSERT_TRUE(controlServiceInternal->releaseWakeLockToken(token).isOk());
+    wlStats = getWakelockStats();
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "TokenLock", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, false);
+
+    ASSERT_TRUE(controlServiceInternal->acquireWakeLockToken(client, "TokenLock", &token).isOk());
+    static_cast<SuspendControlServiceInternal*>(controlServiceInternal.get())->binderDied(client);
+    wlStats = getWakelockStats();
+    ASSERT_TRUE(findWakeLockInfoByName(wlStats, "TokenLock", &nwlInfo));
+    ASSERT_EQ(nwlInfo.isActive, false);
+}
+
 // Test that getWakeLockStats has correct information about Kernel WakeLocks.
 TEST_F(SystemSuspendSameThreadTest, GetKernelWakeLockStats) {
     std::string fakeKwlName1 = "fakeKwl1";
@@ -1057,6 +1195,91 @@ TEST_F(SystemSuspendSameThreadTest, GetKernelWakeLockStats) {
     ASSERT_EQ(kwlInfo2.wakeupCount, 42);
 }
 
+// Test that getWakeLockStatsWithMaxAge serves kernel wakelock stats from a snapshot recent enough.
+TEST_F(SystemSuspendSameThreadTest, GetWakeLockStatsWithMaxAge) {
+    addKernelWakelock("fakeKwl1");
+
+    std::vector<WakeLockInfo> wlStats;
+    ASSERT_TRUE(controlServiceInternal->getWakeLockStatsWithMaxAge(60000, &wlStats).isOk());
+    ASSERT_EQ(wlStats.size(), 1);
+
+    addKernelWakelock("fakeKwl2");
+    wlStats.clear();
+    ASSERT_TRUE(controlServiceInternal->getWakeLockStatsWithMaxAge(60000, &wlStats).isOk());
+    ASSERT_EQ(wlStats.size(), 1);
+    wlStats.clear();
+    ASSERT_TRUE(controlServiceInternal->getWakeLockStatsWithMaxAge(0, &wlStats).isOk());
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_EQ(getWakelockStats().size(), 2);
+
+    ASSERT_FALSE(controlServiceInternal->getWakeLockStatsWithMaxAge(-1, &wlStats).isOk());
+}
+
+// Test that getWakeLockStatsDelta only returns the wake locks changed since the generation passed.
+TEST_F(SystemSuspendSameThreadTest, GetWakeLockStatsDelta) {
+    WakeLockStatsDelta delta;
+    {
+        sp<IWakeLock> fakeLock = acquireWakeLock("fakeNwl1");
+        ASSERT_TRUE(controlServiceInternal->getWakeLockStatsDelta(0, &delta).isOk());
+        ASSERT_TRUE(delta.full);
+        ASSERT_EQ(delta.changed.size(), 1);
+    }
+
+    sp<IWakeLock> fakeLock = acquireWakeLock("fakeNwl2");
+    ASSERT_TRUE(controlServiceInternal->getWakeLockStatsDelta(delta.generation, &delta).isOk());
+    ASSERT_FALSE(delta.full);
+    // fakeNwl1 was released, fakeNwl2 acquired.
+    ASSERT_EQ(delta.changed.size(), 2);
+    ASSERT_TRUE(delta.removed.empty());
+}
+
+// Test that binary dumps hold the stats asked for.
+TEST_F(SystemSuspendSameThreadTest, DumpBinary) {
+    addKernelWakelock("fakeKwl");
+    sp<IWakeLock> fakeLock = acquireWakeLock("fakeNwl");
+
+    TemporaryFile file;
+    Vector<String16> args;
+    args.push_back(String16("--binary"));
+    args.push_back(String16("--wakelocks"));
+    ASSERT_EQ(IInterface::asBinder(controlServiceInternal)->dump(file.fd, args), OK);
+
+    std::string data;
+    ASSERT_TRUE(ReadFileToString(file.path, &data));
+    BinaryDump dump;
+    ASSERT_TRUE(decodeBinaryDump(data, &dump));
+    ASSERT_EQ(dump.wakeLocks.size(), 2);
+    std::sort(dump.wakeLocks.begin(), dump.wakeLocks.end(),
+              [](const DumpedWakeLock& a, const DumpedWakeLock& b) { return a.name < b.name; });
+    ASSERT_EQ(dump.wakeLocks[0].name, "fakeKwl");
+    ASSERT_TRUE(dump.wakeLocks[0].isKernelWakelock);
+    ASSERT_EQ(dump.wakeLocks[1].name, "fakeNwl");
+    ASSERT_FALSE(dump.wakeLocks[1].isKernelWakelock);
+    ASSERT_TRUE(dump.wakeLocks[1].isActive);
+    ASSERT_EQ(dump.wakeLocks[1].pid, getpid());
+    ASSERT_TRUE(dump.wakeups.empty());
+    ASSERT_TRUE(dump.suspendInfo.empty());
+}
+
+// Test that hold time histograms are only dumped along with the wakelock stats when asked for.
+TEST_F(SystemSuspendSameThreadTest, DumpHistograms) {
+    acquireWakeLock("fakeNwl");
+
+    TemporaryFile file;
+    Vector<String16> args;
+    args.push_back(String16("--wakelocks"));
+    ASSERT_EQ(IInterface::asBinder(controlServiceInternal)->dump(file.fd, args), OK);
+    args.push_back(String16("--histograms"));
+    ASSERT_EQ(IInterface::asBinder(controlServiceInternal)->dump(file.fd, args), OK);
+
+    std::string dump;
+    ASSERT_TRUE(ReadFileToString(file.path, &dump));
+    size_t holdTimes = dump.find("WAKELOCK HOLD TIMES");
+    ASSERT_NE(holdTimes, std::string::npos);
+    ASSERT_EQ(dump.find("WAKELOCK HOLD TIMES", holdTimes + 1), std::string::npos);
+    ASSERT_NE(dump.find(" | fakeNwl ", holdTimes), std::string::npos);
+}
+
 // Test that getWakeLockStats has correct information about Native AND Kernel WakeLocks.
 TEST_F(SystemSuspendSameThreadTest, GetNativeAndKernelWakeLockStats) {
     std::string fakeNwlName = "fakeNwl";
@@ -1211,7 +1434,7 @@ class SuspendWakeupTest : public ::testing::Test {
                                     unique_fd(-1) /*suspendStatsFd*/, 100 /* maxStatsEntries */,
                                     unique_fd(-1) /* kernelWakelockStatsFd */,
                                     std::move(wakeupReasonsFd), std::move(suspendTimeFd),
-                                    kSleepTimeConfig, suspendControl, suspendControlInternal);
+                                    getSleepTimeConfig(), suspendControl, suspendControlInternal);
 
         // Start auto-suspend.
         bool enabled = false;
@@ -1221,6 +1444,8 @@ class SuspendWakeupTest : public ::testing::Test {
 
     virtual void TearDown() override {}
 
+    virtual SleepTimeConfig getSleepTimeConfig() const { return kSleepTimeConfig; }
+
     void wakeup(std::string wakeupReason) {
         ASSERT_TRUE(WriteStringToFile(wakeupReason, wakeupReasonsFile.path));
         checkLoop(1);
@@ -1239,6 +1464,17 @@ class SuspendWakeupTest : public ::testing::Test {
             // before it is updated in autoSuspend
             while (!isReadBlocked(wakeupCountTestFd)) {
             }
+            suspendAttempts++;
+        }
+        waitForPostResume();
+    }
+
+    // Wakeup stats are updated on the post-resume worker, wait until it has processed every
+    // suspend attempt.
+    void waitForPostResume() {
+        SystemSuspend* s = static_cast<SystemSuspend*>(suspend.get());
+        while (s->getPostResumeStats().processed < suspendAttempts) {
+            std::this_thread::sleep_for(1ms);
         }
     }
 
@@ -1286,6 +1522,7 @@ class SuspendWakeupTest : public ::testing::Test {
     sp<SuspendControlService> suspendControl;
     sp<SuspendControlServiceInternal> suspendControlInternal;
     sp<ISystemSuspend> suspend;
+    uint64_t suspendAttempts = 0;
 
     const SleepTimeConfig kSleepTimeConfig = {
         .baseSleepTime = 100ms,
@@ -1409,6 +1646,68 @@ TEST_F(SuspendWakeupTest, GetMultipleWakeupReasonStats) {
     ASSERT_EQ(wStats[3].count, 1);
 }
 
+TEST_F(SuspendWakeupTest, SuspendLatencyStats) {
+    suspendFor(std::chrono::milliseconds(kLongSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 3);
+
+    std::vector<SuspendPhaseLatency> latencies;
+    ASSERT_TRUE(suspendControlInternal->getSuspendLatencyStats(&latencies).isOk());
+    ASSERT_EQ(latencies.size(), 4);
+    for (const auto& latency : latencies) {
+        ASSERT_FALSE(latency.phase.empty());
+        ASSERT_EQ(latency.count, 3);
+        ASSERT_LE(latency.p50Micros, latency.p95Micros);
+        ASSERT_LE(latency.p95Micros, latency.p99Micros);
+        ASSERT_LE(latency.p99Micros, latency.maxMicros);
+    }
+}
+
+TEST_F(SuspendWakeupTest, SuspendHistory) {
+    wakeup("abc");
+    suspendFor(std::chrono::milliseconds(kLongSuspendMillis),
+               std::chrono::milliseconds(kSuspendOverheadMillis), 1);
+
+    std::vector<SuspendAttemptInfo> history;
+    ASSERT_TRUE(suspendControlInternal->getSuspendHistory(&history).isOk());
+    ASSERT_EQ(history.size(), 2);
+    ASSERT_TRUE(history[0].success);
+    ASSERT_EQ(history[0].wakeupReason, "abc");
+    ASSERT_LE(history[0].startTimeMillis, history[0].endTimeMillis);
+    ASSERT_LE(history[0].endTimeMillis, history[1].startTimeMillis);
+    ASSERT_EQ(history[1].suspendTimeMillis, kLongSuspendMillis);
+    ASSERT_EQ(history[1].suspendOverheadTimeMillis, kSuspendOverheadMillis);
+    ASSERT_EQ(history[1].sleepTimeMillis, kSleepTimeConfig.baseSleepTime.count());
+}
+
+class EventDrivenSuspendWakeupTest : public SuspendWakeupTest {
+   public:
+    SleepTimeConfig getSleepTimeConfig() const override {
+        SleepTimeConfig config = kSleepTimeConfig;
+        config.baseSleepTime = kEventDrivenSleepTime;
+        config.eventDrivenAutosuspendEnabled = true;
+        return config;
+    }
+
+    const std::chrono::milliseconds kEventDrivenSleepTime = 1000ms;
+};
+
+// Tests that in event-driven mode the next suspend attempt is made as soon as the last wake lock
+// is released, without waiting for the rest of the sleep time.
+TEST_F(EventDrivenSuspendWakeupTest, SuspendOnLastWakeLockRelease) {
+    checkLoop(1);
+
+    SystemSuspend* s = static_cast<SystemSuspend*>(suspend.get());
+    s->incSuspendCounter("TestLock");
+    std::this_thread::sleep_for(100ms);
+    std::string wakeupCount = std::to_string(rand());
+    ASSERT_TRUE(WriteStringToFd(wakeupCount, wakeupCountTestFd));
+    s->decSuspendCounter("TestLock");
+
+    ASSERT_FALSE(isReadBlocked(stateTestFd, kEventDrivenSleepTime.count() / 2));
+    ASSERT_EQ(readFd(wakeupCountTestFd), wakeupCount);
+    ASSERT_EQ(readFd(stateTestFd), "mem");
+}
+
 TEST(WakeupListTest, TestEmpty) {
     WakeupList wakeupList(3);
 
@@ -1515,6 +1814,1493 @@ TEST(WakeupListTest, TestLRUEvict) {
     ASSERT_EQ(wakeups[2].count, 2);
 }
 
+TEST(LatencyHistogramTest, TestEmpty) {
+    LatencyHistogram histogram;
+
+    ASSERT_EQ(histogram.count(), 0);
+    ASSERT_EQ(histogram.percentileMicros(50), 0);
+    ASSERT_EQ(histogram.maxMicros(), 0);
+}
+
+TEST(LatencyHistogramTest, TestBuckets) {
+    for (size_t i = 0; i < LatencyHistogram::kNumBuckets; i++) {
+        uint64_t upperBound = LatencyHistogram::bucketUpperBound(i);
+        ASSERT_EQ(LatencyHistogram::bucketIndex(upperBound), i);
+        if (i > 0) {
+            ASSERT_GT(upperBound, LatencyHistogram::bucketUpperBound(i - 1));
+        }
+    }
+    ASSERT_EQ(LatencyHistogram::bucketIndex(UINT64_MAX), LatencyHistogram::kNumBuckets - 1);
+}
+
+TEST(LatencyHistogramTest, TestPercentiles) {
+    LatencyHistogram histogram;
+    for (int i = 1; i <= 100; i++) {
+        histogram.record(std::chrono::milliseconds(i));
+    }
+
+    ASSERT_EQ(histogram.count(), 100);
+    ASSERT_EQ(histogram.maxMicros(), 100000);
+    // Percentiles are upper bounds within 1 / kSubBuckets of the actual value.
+    for (double percentile : {50.0, 95.0, 99.0}) {
+        uint64_t expected = percentile * 1000;
+        ASSERT_GE(histogram.percentileMicros(percentile), expected);
+        ASSERT_LE(histogram.percentileMicros(percentile),
+                  expected + expected / LatencyHistogram::kSubBuckets);
+    }
+    ASSERT_EQ(histogram.percentileMicros(100), 100000);
+}
+
+TEST(PostResumeWorkerTest, TestProcessInOrder) {
+    std::mutex lock;
+    std::vector<std::string> handled;
+    PostResumeWorker worker(4, [&](bool, std::vector<std::string>& wakeupReasons) {
+        std::scoped_lock l(lock);
+        handled.push_back(wakeupReasons[0]);
+    });
+    worker.start();
+
+    for (std::string reason : {"a", "b", "c"}) {
+        std::vector<std::string> wakeupReasons = {reason};
+        worker.enqueue(true, &wakeupReasons);
+    }
+    while (worker.getStats().processed < 3) {
+        std::this_thread::sleep_for(1ms);
+    }
+
+    std::scoped_lock l(lock);
+    ASSERT_EQ(handled, std::vector<std::string>({"a", "b", "c"}));
+    ASSERT_EQ(worker.getStats().dropped, 0);
+}
+
+TEST(PostResumeWorkerTest, TestDropOldestWhenFull) {
+    constexpr size_t kCapacity = 2;
+    std::promise<void> started;
+    std::promise<void> unblock;
+    std::shared_future<void> unblocked = unblock.get_future().share();
+    std::vector<std::string> handled;
+    PostResumeWorker worker(kCapacity, [&](bool, std::vector<std::string>& wakeupReasons) {
+        if (handled.empty()) {
+            started.set_value();
+            unblocked.wait();
+        }
+        handled.push_back(wakeupReasons[0]);
+    });
+    worker.start();
+
+    // The worker is busy with the first event, the following ones overflow the queue.
+    std::vector<std::string> wakeupReasons = {"0"};
+    worker.enqueue(true, &wakeupReasons);
+    started.get_future().wait();
+    for (std::string reason : {"1", "2", "3"}) {
+        wakeupReasons = {reason};
+        worker.enqueue(true, &wakeupReasons);
+    }
+
+    PostResumeStats stats = worker.getStats();
+    ASSERT_EQ(stats.capacity, kCapacity);
+    ASSERT_EQ(stats.depth, kCapacity);
+    ASSERT_EQ(stats.maxDepth, kCapacity);
+    ASSERT_EQ(stats.dropped, 1);
+
+    unblock.set_value();
+    while (worker.getStats().processed < 3) {
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_EQ(handled, std::vector<std::string>({"0", "2", "3"}));
+}
+
+TEST(SuspendCounterTest, TestIncrementDecrement) {
+    SuspendCounter counter;
+    counter.increment();
+    counter.increment();
+    ASSERT_EQ(counter.count(), 2u);
+    counter.decrement();
+    counter.decrement();
+    ASSERT_EQ(counter.count(), 0u);
+}
+
+TEST(SuspendCounterTest, TestBeginSuspendWaitsForRelease) {
+    SuspendCounter counter;
+    counter.increment();
+
+    auto suspending = std::async(std::launch::async, [&] { counter.beginSuspend(); });
+    ASSERT_EQ(suspending.wait_for(100ms), std::future_status::timeout);
+    counter.decrement();
+    ASSERT_EQ(suspending.wait_for(1s), std::future_status::ready);
+    counter.endSuspend();
+}
+
+TEST(SuspendCounterTest, TestIncrementBlocksWhileSuspending) {
+    SuspendCounter counter;
+    counter.beginSuspend();
+
+    auto acquired = std::async(std::launch::async, [&] { counter.increment(); });
+    ASSERT_EQ(acquired.wait_for(100ms), std::future_status::timeout);
+    // Releases don't block, and neither does a forced suspend wait for wake locks.
+    counter.endSuspend();
+    ASSERT_EQ(acquired.wait_for(1s), std::future_status::ready);
+    counter.beginSuspend(true /* force */);
+    counter.decrement();
+    counter.endSuspend();
+    ASSERT_EQ(counter.count(), 0u);
+}
+
+TEST(SuspendCounterTest, TestWaitForRelease) {
+    SuspendCounter counter;
+
+    // Times out if no wake lock is released in the meantime.
+    auto start = std::chrono::steady_clock::now();
+    counter.waitForRelease(start + 100ms);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, 100ms);
+
+    counter.increment();
+    auto released = std::async(std::launch::async, [&] {
+        counter.waitForRelease(std::chrono::steady_clock::now() + 10s);
+    });
+    ASSERT_EQ(released.wait_for(100ms), std::future_status::timeout);
+    counter.decrement();
+    ASSERT_EQ(released.wait_for(1s), std::future_status::ready);
+}
+
+TEST(SuspendCounterTest, TestConcurrentSuspendAttempts) {
+    constexpr int kNumThreads = 4;
+    constexpr int kNumIterations = 10000;
+    SuspendCounter counter;
+    std::atomic<bool> stop = false;
+    std::atomic<int> held = 0;
+    std::atomic<int> violations = 0;
+
+    std::thread suspendThread([&] {
+        while (!stop) {
+            counter.beginSuspend();
+            if (held != 0) violations++;
+            counter.endSuspend();
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; i++) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < kNumIterations; j++) {
+                counter.increment();
+                held++;
+                held--;
+                counter.decrement();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stop = true;
+    suspendThread.join();
+
+    ASSERT_EQ(violations, 0);
+    ASSERT_EQ(counter.count(), 0u);
+}
+
+TEST(WakeLockTokenTableTest, TestAcquireRelease) {
+    WakeLockTokenTable table;
+    sp<IBinder> client = new BBinder();
+    int64_t token1, token2;
+    ASSERT_EQ(table.acquire(client, nullptr, {"lock1", 1, 1000}, &token1), NO_ERROR);
+    ASSERT_EQ(table.acquire(client, nullptr, {"lock2", 1, 1000}, &token2), NO_ERROR);
+    ASSERT_NE(token1, token2);
+    ASSERT_GT(token1, 0);
+    ASSERT_EQ(table.size(), 2u);
+
+    WakeLockTokenTable::Entry entry;
+    ASSERT_EQ(table.release(token1, 1000, nullptr, &entry), NO_ERROR);
+    ASSERT_EQ(entry.name, "lock1");
+    ASSERT_EQ(table.release(token1, 1000, nullptr, &entry), BAD_VALUE);
+
+    ASSERT_EQ(table.release(token2, 1000, nullptr, &entry), NO_ERROR);
+    ASSERT_EQ(entry.name, "lock2");
+    ASSERT_EQ(table.size(), 0u);
+}
+
+TEST(WakeLockTokenTableTest, TestStaleTokenAfterSlotReuse) {
+    WakeLockTokenTable table;
+    sp<IBinder> client = new BBinder();
+    int64_t staleToken;
+    ASSERT_EQ(table.acquire(client, nullptr, {"lock1", 1, 1000}, &staleToken), NO_ERROR);
+    WakeLockTokenTable::Entry entry;
+    ASSERT_EQ(table.release(staleToken, 1000, nullptr, &entry), NO_ERROR);
+
+    // The slot is reused, but the stale token must not release the new wake lock.
+    int64_t token;
+    ASSERT_EQ(table.acquire(client, nullptr, {"lock2", 1, 1000}, &token), NO_ERROR);
+    ASSERT_EQ(static_cast<uint32_t>(token), static_cast<uint32_t>(staleToken));
+    ASSERT_EQ(table.release(staleToken, 1000, nullptr, &entry), BAD_VALUE);
+    ASSERT_EQ(table.release(-1, 1000, nullptr, &entry), BAD_VALUE);
+    ASSERT_EQ(table.size(), 1u);
+}
+
+TEST(WakeLockTokenTableTest, TestReleaseByOtherUid) {
+    WakeLockTokenTable table;
+    sp<IBinder> client = new BBinder();
+    int64_t token;
+    ASSERT_EQ(table.acquire(client, nullptr, {"lock1", 1, 1000}, &token), NO_ERROR);
+
+    WakeLockTokenTable::Entry entry;
+    ASSERT_EQ(table.release(token, 2000, nullptr, &entry), PERMISSION_DENIED);
+    ASSERT_EQ(table.size(), 1u);
+    ASSERT_EQ(table.release(token, 1000, nullptr, &entry), NO_ERROR);
+    ASSERT_EQ(entry.uid, 1000u);
+}
+
+TEST(WakeLockTokenTableTest, TestReleaseClient) {
+    WakeLockTokenTable table;
+    sp<IBinder> client1 = new BBinder();
+    sp<IBinder> client2 = new BBinder();
+    int64_t token;
+    ASSERT_EQ(table.acquire(client1, nullptr, {"lock1", 1, 1000}, &token), NO_ERROR);
+    ASSERT_EQ(table.acquire(client2, nullptr, {"lock2", 2, 1000}, &token), NO_ERROR);
+    int64_t otherToken;
+    ASSERT_EQ(table.acquire(client1, nullptr, {"lock3", 1, 1000}, &otherToken), NO_ERROR);
+
+    std::vector<WakeLockTokenTable::Entry> entries = table.releaseClient(client1.get());
+    ASSERT_EQ(entries.size(), 2u);
+    ASSERT_EQ(entries[0].name, "lock1");
+    ASSERT_EQ(entries[1].name, "lock3");
+    ASSERT_TRUE(table.releaseClient(client1.get()).empty());
+    ASSERT_EQ(table.size(), 1u);
+
+    WakeLockTokenTable::Entry entry;
+    ASSERT_EQ(table.release(token, 1000, nullptr, &entry), NO_ERROR);
+    ASSERT_EQ(entry.pid, 2);
+}
+
+TEST(WakeLockEventQueueTest, TestPushDrain) {
+    WakeLockEventQueue queue;
+    std::vector<WakeLockEvent> events;
+    queue.drain(&events);
+    ASSERT_TRUE(events.empty());
+
+    // Wrap around the queue a few times.
+    for (size_t i = 0; i < 3 * WakeLockEventQueue::kCapacity; i++) {
+        ASSERT_TRUE(
+            queue.push({{nullptr, 1}, static_cast<TimestampType>(i), WakeLockEvent::ACQUIRE}));
+        if (i % 7 == 6) {
+            queue.drain(&events);
+        }
+    }
+    queue.drain(&events);
+    ASSERT_EQ(events.size(), 3 * WakeLockEventQueue::kCapacity);
+    for (size_t i = 0; i < events.size(); i++) {
+        ASSERT_EQ(events[i].timeNow, static_cast<TimestampType>(i));
+    }
+}
+
+TEST(WakeLockEventQueueTest, TestFull) {
+    WakeLockEventQueue queue;
+    for (size_t i = 0; i < WakeLockEventQueue::kCapacity; i++) {
+        ASSERT_TRUE(queue.push({{nullptr, 1}, 0, WakeLockEvent::ACQUIRE}));
+    }
+    ASSERT_FALSE(queue.push({{nullptr, 1}, 0, WakeLockEvent::RELEASE}));
+
+    std::vector<WakeLockEvent> events;
+    queue.drain(&events);
+    ASSERT_EQ(events.size(), WakeLockEventQueue::kCapacity);
+    ASSERT_TRUE(queue.push({{nullptr, 1}, 0, WakeLockEvent::RELEASE}));
+}
+
+// Checks that concurrent producers lose no event and that each producer's events stay in order.
+TEST(WakeLockEventQueueTest, TestConcurrentProducers) {
+    constexpr int kNumThreads = 4;
+    constexpr int kNumEvents = 10000;
+    WakeLockEventQueue queue;
+    std::vector<std::thread> producers;
+    for (int pid = 0; pid < kNumThreads; pid++) {
+        producers.emplace_back([&queue, pid] {
+            for (int i = 0; i < kNumEvents; i++) {
+                while (!queue.push({{0, pid}, i, WakeLockEvent::ACQUIRE})) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<TimestampType> next(kNumThreads, 0);
+    std::vector<WakeLockEvent> events;
+    int numEvents = 0;
+    while (numEvents < kNumThreads * kNumEvents) {
+        queue.drain(&events);
+        for (const WakeLockEvent& event : events) {
+            ASSERT_EQ(event.timeNow, next[event.key.pid]++);
+        }
+        numEvents += events.size();
+        events.clear();
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+}
+
+static std::vector<std::string> getNativeWakeLockNames(WakeLockEntryList* list) {
+    std::vector<WakeLockInfo> wlStats;
+    list->getWakeLockStats(&wlStats);
+    std::vector<std::string> names;
+    for (const WakeLockInfo& info : wlStats) {
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+// Test that stats are listed from the most to the least recently used, with the least recently
+// used evicted once at capacity.
+TEST(WakeLockEntryListTest, TestLruOrder) {
+    WakeLockEntryList list(3, unique_fd());
+    list.updateOnAcquire("lock1", 1, 0);
+    list.updateOnAcquire("lock2", 1, 0);
+    list.updateOnAcquire("lock3", 1, 0);
+    list.updateOnRelease("lock1", 1, 0);
+    ASSERT_EQ(getNativeWakeLockNames(&list), std::vector<std::string>({"lock1", "lock3", "lock2"}));
+
+    list.updateOnAcquire("lock4", 1, 0);
+    ASSERT_EQ(getNativeWakeLockNames(&list), std::vector<std::string>({"lock4", "lock1", "lock3"}));
+
+    // Same name, different pid.
+    list.updateOnAcquire("lock3", 2, 0);
+    ASSERT_EQ(getNativeWakeLockNames(&list), std::vector<std::string>({"lock3", "lock4", "lock1"}));
+}
+
+// Test that stats stay reachable while entries are evicted and reinserted many times, which moves
+// entries around in the lookup index.
+TEST(WakeLockEntryListTest, TestManyEvictions) {
+    constexpr int kCapacity = 64;
+    WakeLockEntryList list(kCapacity, unique_fd());
+    for (int i = 0; i < 100 * kCapacity; i++) {
+        list.updateOnAcquire("lock" + std::to_string(i % (2 * kCapacity + 1)), i % 3, i);
+        list.updateOnRelease("lock" + std::to_string(i % (2 * kCapacity + 1)), i % 3, i + 1);
+    }
+
+    std::vector<WakeLockInfo> wlStats;
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), kCapacity);
+    for (size_t i = 0; i < wlStats.size(); i++) {
+        int last = 100 * kCapacity - 1 - i;
+        ASSERT_EQ(wlStats[i].name, "lock" + std::to_string(last % (2 * kCapacity + 1)));
+        ASSERT_EQ(wlStats[i].pid, last % 3);
+        ASSERT_FALSE(wlStats[i].isActive);
+        ASSERT_EQ(wlStats[i].totalTime, 1);
+        ASSERT_EQ(wlStats[i].lastChange, last + 1);
+    }
+}
+
+// Test that updateNow() updates the active stats only, including after active stats are evicted
+// and inactive ones reactivated.
+TEST(WakeLockEntryListTest, TestUpdateNow) {
+    WakeLockEntryList list(3, unique_fd());
+    TimestampType start = getTimeNow() - 1000;
+    list.updateOnAcquire("lock1", 1, start);
+    list.updateOnAcquire("lock2", 1, start);
+    list.updateOnAcquire("lock3", 1, start);
+    list.updateOnRelease("lock2", 1, start);
+    list.updateOnAcquire("lock2", 1, start);
+    list.updateOnRelease("lock3", 1, start);
+    // Evicts lock1, which is still active.
+    list.updateOnAcquire("lock4", 1, start);
+    list.updateNow();
+
+    std::vector<WakeLockInfo> wlStats;
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 3);
+    for (const WakeLockInfo& info : wlStats) {
+        if (info.name == "lock3") {
+            ASSERT_FALSE(info.isActive);
+            ASSERT_EQ(info.totalTime, 0);
+            ASSERT_EQ(info.lastChange, start);
+        } else {
+            ASSERT_TRUE(info.isActive);
+            ASSERT_GE(info.totalTime, 1000);
+            ASSERT_GT(info.lastChange, start);
+        }
+    }
+}
+
+// Test that the name of a removed key stays valid for its queued events, also when a key is made
+// with the name again before they are folded.
+TEST(WakeLockEntryListTest, TestStatsKeys) {
+    WakeLockEntryList list(3, unique_fd());
+    WakeLockStatsKey key1 = list.addKey("lock1", 1);
+    WakeLockStatsKey key2 = list.addKey("lock1", 2);
+    ASSERT_EQ(key1.name, key2.name);
+    ASSERT_EQ(*key1.name, "lock1");
+    ASSERT_NE(key1.hash, key2.hash);
+    list.updateOnAcquire(key1, 100);
+    list.updateOnRelease(key1, 200);
+    list.removeKey(key1);
+    list.removeKey(key2);
+
+    WakeLockStatsKey key3 = list.addKey("lock2", 1);
+    ASSERT_NE(key3.name, key1.name);
+    list.updateOnAcquire(key3, 300);
+
+    std::vector<WakeLockInfo> wlStats;
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_EQ(wlStats[0].name, "lock2");
+    ASSERT_EQ(wlStats[1].name, "lock1");
+    ASSERT_EQ(wlStats[1].totalTime, 100);
+
+    list.updateOnRelease(key3, 400);
+    list.removeKey(key3);
+    WakeLockStatsKey key4 = list.addKey("lock2", 1);
+    list.updateOnAcquire(key4, 500);
+    list.removeKey(key4);
+    wlStats.clear();
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats[0].name, "lock2");
+    ASSERT_EQ(wlStats[0].activeCount, 2);
+    ASSERT_EQ(wlStats[0].totalTime, 100);
+
+    // The name was erased by the previous read, a new key makes it again.
+    WakeLockStatsKey key5 = list.addKey("lock2", 1);
+    list.updateOnRelease(key5, 600);
+    list.removeKey(key5);
+    wlStats.clear();
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats[0].name, "lock2");
+    ASSERT_EQ(wlStats[0].totalTime, 200);
+}
+
+static std::vector<std::string> getSortedNames(const std::vector<WakeLockInfo>& wlStats) {
+    std::vector<std::string> names;
+    for (const WakeLockInfo& info : wlStats) {
+        names.push_back(info.name);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Test that deltas hold the native and kernel stats changed and removed since a generation.
+TEST(WakeLockEntryListTest, TestDelta) {
+    using ::testing::ElementsAre;
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    WakeLockEntryList list(
+        3, unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))));
+    list.updateOnAcquire("lock1", 1, 0);
+    list.updateOnAcquire("lock2", 1, 0);
+    list.updateOnRelease("lock1", 1, 0);
+
+    WakeLockStatsDelta delta;
+    list.getWakeLockStatsDelta(0, &delta);
+    ASSERT_TRUE(delta.full);
+    ASSERT_GT(delta.generation, 0);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock1", "lock2", "ws0"));
+
+    // Wakeup sources first seen by a full read are stamped after it, and repeated once.
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("ws0"));
+
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.full);
+    ASSERT_TRUE(delta.changed.empty());
+    ASSERT_TRUE(delta.removed.empty());
+
+    list.updateOnAcquire("lock3", 1, 0);
+    writeWakeupSource(dir, "wakeup0", "ws0", 2);
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock3", "ws0"));
+    ASSERT_TRUE(delta.removed.empty());
+
+    // Evicts lock2, the least recently used.
+    list.updateOnAcquire("lock4", 1, 0);
+    removeWakeupSource(dir, "wakeup0");
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock4"));
+    ASSERT_THAT(getSortedNames(delta.removed), ElementsAre("lock2", "ws0"));
+    for (const WakeLockInfo& info : delta.removed) {
+        ASSERT_EQ(info.isKernelWakelock, info.name == "ws0");
+    }
+
+    // Active wake locks change on every update.
+    list.updateNow();
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_FALSE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock3", "lock4"));
+
+    // Generations from another instance of the service.
+    list.getWakeLockStatsDelta(delta.generation + 1000, &delta);
+    ASSERT_TRUE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock1", "lock3", "lock4"));
+}
+
+// Test that all the stats are returned once the evictions since the generation asked for were
+// forgotten.
+TEST(WakeLockEntryListTest, TestDeltaForgottenEvictions) {
+    using ::testing::ElementsAre;
+    WakeLockEntryList list(1, unique_fd());
+    list.updateOnAcquire("lock1", 1, 0);
+    WakeLockStatsDelta delta;
+    list.getWakeLockStatsDelta(0, &delta);
+
+    list.updateOnAcquire("lock2", 1, 0);
+    list.updateOnAcquire("lock3", 1, 0);
+    list.getWakeLockStatsDelta(delta.generation, &delta);
+    ASSERT_TRUE(delta.full);
+    ASSERT_THAT(getSortedNames(delta.changed), ElementsAre("lock3"));
+    ASSERT_TRUE(delta.removed.empty());
+}
+
+static std::vector<std::string> getNames(const std::vector<WakeLockInfo>& wlStats) {
+    std::vector<std::string> names;
+    for (const WakeLockInfo& info : wlStats) {
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+// Test that the top wake locks merge the native and kernel ones, and stay exact as ranked wake
+// locks are evicted.
+TEST(WakeLockEntryListTest, TestTopWakeLocks) {
+    using ::testing::ElementsAre;
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 100);
+    WakeLockEntryList list(
+        kMaxTopWakeLocks + 1,
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))));
+    // lockN is acquired N + 1 times, for N ms each time.
+    for (size_t i = 0; i <= kMaxTopWakeLocks; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            list.updateOnAcquire("lock" + std::to_string(i), 1, j);
+            list.updateOnRelease("lock" + std::to_string(i), 1, j + i);
+        }
+    }
+
+    std::vector<WakeLockInfo> wlStats;
+    list.getTopWakeLockStats(WakeLockMetric::ACTIVE_COUNT, 3, 0ms, &wlStats);
+    ASSERT_THAT(getNames(wlStats), ElementsAre("ws0", "lock64", "lock63"));
+    wlStats.clear();
+    list.getTopWakeLockStats(WakeLockMetric::TOTAL_TIME, 2, 0ms, &wlStats);
+    ASSERT_THAT(getNames(wlStats), ElementsAre("lock64", "lock63"));
+    ASSERT_EQ(wlStats[0].totalTime, 64 * 65);
+
+    // Evicts lock0, which isn't ranked, then lock1, which is.
+    list.updateOnAcquire("lock65", 1, 0);
+    for (int i = 0; i < 100; i++) {
+        list.updateOnAcquire("lock66", 1, 0);
+        list.updateOnRelease("lock66", 1, 0);
+    }
+    removeWakeupSource(dir, "wakeup0");
+
+    std::vector<WakeLockInfo> allStats;
+    list.getWakeLockStats(&allStats);
+    std::vector<int64_t> expected;
+    for (const WakeLockInfo& info : allStats) {
+        expected.push_back(info.activeCount);
+    }
+    std::sort(expected.rbegin(), expected.rend());
+    expected.resize(kMaxTopWakeLocks);
+    wlStats.clear();
+    list.getTopWakeLockStats(WakeLockMetric::ACTIVE_COUNT, kMaxTopWakeLocks, 0ms, &wlStats);
+    std::vector<int64_t> actual;
+    for (const WakeLockInfo& info : wlStats) {
+        actual.push_back(info.activeCount);
+    }
+    ASSERT_EQ(actual, expected);
+}
+
+// Test that releases are counted by hold time, from a new histogram for each new stats entry.
+TEST(WakeLockEntryListTest, TestHoldTimes) {
+    ASSERT_EQ(getHoldTimeBucket(-1), 0);
+    ASSERT_EQ(getHoldTimeBucket(0), 0);
+    ASSERT_EQ(getHoldTimeBucket(1), 1);
+    ASSERT_EQ(getHoldTimeBucket(3), 2);
+    ASSERT_EQ(getHoldTimeBucket(4), 3);
+    ASSERT_EQ(getHoldTimeBucket(INT64_MAX), kNumHoldTimeBuckets - 1);
+
+    WakeLockEntryList list(2, unique_fd());
+    for (TimestampType holdTime : {0, 5, 6, 1000, 10000000}) {
+        list.updateOnAcquire("lock1", 1, 100);
+        list.updateOnRelease("lock1", 1, 100 + holdTime);
+    }
+    // Releasing an inactive wake lock isn't a hold.
+    list.updateOnRelease("lock1", 1, 200);
+    list.updateOnAcquire("lock2", 1, 0);
+
+    std::vector<WakeLockHoldTimes> holdTimes;
+    list.getWakeLockHoldTimes(&holdTimes);
+    ASSERT_EQ(holdTimes.size(), 2);
+    ASSERT_EQ(holdTimes[0].name, "lock2");
+    ASSERT_EQ(holdTimes[0].counts, std::vector<int64_t>(kNumHoldTimeBuckets, 0));
+    ASSERT_EQ(holdTimes[1].name, "lock1");
+    ASSERT_EQ(holdTimes[1].pid, 1);
+    std::vector<int64_t> expected(kNumHoldTimeBuckets, 0);
+    expected[0] = 1;
+    expected[3] = 2;
+    expected[10] = 1;
+    expected[kNumHoldTimeBuckets - 1] = 1;
+    ASSERT_EQ(holdTimes[1].counts, expected);
+
+    TemporaryFile file;
+    list.dumpHoldTimes(file.fd);
+    std::string dump;
+    ASSERT_TRUE(ReadFileToString(file.path, &dump));
+    ASSERT_NE(dump.find(" | lock1 "), std::string::npos);
+    ASSERT_NE(dump.find(" | 0-1ms: 1, 4-8ms: 2, 512-1024ms: 1, >=4194304ms: 1\n"),
+              std::string::npos);
+
+    // Evicts lock1, whose slot lock3 takes over.
+    list.updateOnAcquire("lock3", 1, 0);
+    list.updateOnRelease("lock3", 1, 2);
+    holdTimes.clear();
+    list.getWakeLockHoldTimes(&holdTimes);
+    ASSERT_EQ(holdTimes[0].name, "lock3");
+    expected.assign(kNumHoldTimeBuckets, 0);
+    expected[2] = 1;
+    ASSERT_EQ(holdTimes[0].counts, expected);
+}
+
+// Test that dumps hold a row for each native and kernel wake lock, as wide as the table.
+TEST(WakeLockEntryListTest, TestDump) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    WakeLockEntryList list(
+        10, unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))));
+    list.updateOnAcquire("lock1", 1, 0);
+    list.updateOnAcquire("lock2", 2, 0);
+    list.updateOnRelease("lock2", 2, 10);
+
+    TemporaryFile file;
+    list.dump(file.fd);
+    std::string dump;
+    ASSERT_TRUE(ReadFileToString(file.path, &dump));
+
+    std::vector<std::string> lines = Split(dump, "\n");
+    // Header of five lines, three rows, a divider and the empty string after the last newline.
+    ASSERT_EQ(lines.size(), 10);
+    ASSERT_EQ(lines[9], "");
+    for (size_t i = 5; i < 8; i++) {
+        // As wide as the column names.
+        ASSERT_EQ(lines[i].size(), lines[3].size()) << lines[i];
+    }
+    ASSERT_EQ(lines[5].find(" | lock2 "), 0);
+    ASSERT_NE(lines[5].find("Inactive"), std::string::npos);
+    ASSERT_NE(lines[5].find(" 10ms | "), std::string::npos);
+    ASSERT_EQ(lines[6].find(" | lock1 "), 0);
+    ASSERT_NE(lines[6].find("Active "), std::string::npos);
+    ASSERT_EQ(lines[7].find(" | ws0 "), 0);
+    ASSERT_NE(lines[7].find("Kernel"), std::string::npos);
+}
+
+// Test that readers copying the stats while they are updated see consistent entries.
+TEST(WakeLockEntryListTest, TestConcurrentReads) {
+    constexpr int kNumLocks = 8;
+    constexpr int kNumUpdates = 2000;
+    WakeLockEntryList list(kNumLocks, unique_fd());
+    std::atomic<bool> done = false;
+    std::thread writer([&] {
+        for (int i = 0; i < kNumUpdates; i++) {
+            std::string name = "lock" + std::to_string(i % kNumLocks);
+            list.updateOnAcquire(name, 1, i);
+            list.updateOnRelease(name, 1, i + 1);
+        }
+        done = true;
+    });
+
+    while (!done) {
+        list.updateNow();
+        std::vector<WakeLockInfo> wlStats;
+        list.getWakeLockStats(&wlStats);
+        for (const WakeLockInfo& info : wlStats) {
+            ASSERT_EQ(info.name.compare(0, 4, "lock"), 0);
+            ASSERT_GE(info.totalTime, 0);
+            ASSERT_LE(info.activeCount, kNumUpdates / kNumLocks);
+        }
+    }
+    writer.join();
+
+    std::vector<WakeLockInfo> wlStats;
+    list.getWakeLockStats(&wlStats);
+    ASSERT_EQ(wlStats.size(), kNumLocks);
+    for (const WakeLockInfo& info : wlStats) {
+        ASSERT_FALSE(info.isActive);
+        ASSERT_EQ(info.activeCount, kNumUpdates / kNumLocks);
+        ASSERT_EQ(info.totalTime, kNumUpdates / kNumLocks);
+    }
+}
+
+// Writes the name and active count of the wakeup source in directory id under dir, creating it
+// if needed.
+static void writeWakeupSource(const TemporaryDir& dir, const std::string& id,
+                              const std::string& name, int64_t activeCount) {
+    std::string path = std::string(dir.path) + "/" + id;
+    mkdir(path.c_str(), S_IRWXU);
+    ASSERT_TRUE(WriteStringToFile(name + "\n", path + "/name"));
+    ASSERT_TRUE(WriteStringToFile(std::to_string(activeCount) + "\n", path + "/active_count"));
+}
+
+static void removeWakeupSource(const TemporaryDir& dir, const std::string& id) {
+    std::string path = std::string(dir.path) + "/" + id;
+    ASSERT_EQ(unlink((path + "/name").c_str()), 0);
+    ASSERT_EQ(unlink((path + "/active_count").c_str()), 0);
+    ASSERT_EQ(rmdir(path.c_str()), 0);
+}
+
+static std::vector<WakeLockInfo> getKernelWakelockStats(KernelWakelockStatsReader* reader) {
+    std::vector<WakeLockInfo> wlStats;
+    reader->getStats(&wlStats);
+    std::sort(wlStats.begin(), wlStats.end(),
+              [](const WakeLockInfo& a, const WakeLockInfo& b) { return a.name < b.name; });
+    return wlStats;
+}
+
+TEST(KernelWakelockStatsReaderTest, TestRereadsStats) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    KernelWakelockStatsReader reader(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))));
+
+    std::vector<WakeLockInfo> wlStats = getKernelWakelockStats(&reader);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].name, "ws0");
+    ASSERT_EQ(wlStats[0].activeCount, 1);
+    ASSERT_EQ(wlStats[0].pid, -1);
+    ASSERT_TRUE(wlStats[0].isKernelWakelock);
+
+    // The stat files kept open are read from the start again.
+    writeWakeupSource(dir, "wakeup0", "ws0", 12345);
+    wlStats = getKernelWakelockStats(&reader);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].activeCount, 12345);
+}
+
+TEST(KernelWakelockStatsReaderTest, TestWakeupSourcesComeAndGo) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 0);
+    KernelWakelockStatsReader reader(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))));
+    ASSERT_EQ(getKernelWakelockStats(&reader).size(), 1);
+
+    writeWakeupSource(dir, "wakeup1", "ws1", 1);
+    std::vector<WakeLockInfo> wlStats = getKernelWakelockStats(&reader);
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_EQ(wlStats[0].name, "ws0");
+    ASSERT_EQ(wlStats[1].name, "ws1");
+    ASSERT_EQ(wlStats[1].activeCount, 1);
+
+    removeWakeupSource(dir, "wakeup0");
+    wlStats = getKernelWakelockStats(&reader);
+    ASSERT_EQ(wlStats.size(), 1);
+    ASSERT_EQ(wlStats[0].name, "ws1");
+
+    // A new wakeup source reusing the directory name of a removed one.
+    writeWakeupSource(dir, "wakeup0", "ws2", 2);
+    wlStats = getKernelWakelockStats(&reader);
+    ASSERT_EQ(wlStats.size(), 2);
+    ASSERT_EQ(wlStats[0].name, "ws1");
+    ASSERT_EQ(wlStats[1].name, "ws2");
+    ASSERT_EQ(wlStats[1].activeCount, 2);
+}
+
+TEST(KernelWakelockStatsReaderTest, TestParallelRead) {
+    constexpr int kNumSources = 300;
+    TemporaryDir dir;
+    for (int i = 0; i < kNumSources; i++) {
+        writeWakeupSource(dir, "wakeup" + std::to_string(i), "ws" + std::to_string(i), i);
+    }
+    KernelWakelockStatsReader serialReader(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 1);
+    KernelWakelockStatsReader parallelReader(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 4);
+
+    // Read twice, the second time with the workers already started.
+    for (int read = 0; read < 2; read++) {
+        std::vector<WakeLockInfo> expected;
+        serialReader.getStats(&expected);
+        // Stats are appended after existing elements.
+        std::vector<WakeLockInfo> wlStats(1);
+        parallelReader.getStats(&wlStats);
+        ASSERT_EQ(wlStats.size(), kNumSources + 1);
+        for (int i = 0; i < kNumSources; i++) {
+            ASSERT_EQ(wlStats[i + 1].name, expected[i].name);
+            ASSERT_EQ(wlStats[i + 1].activeCount, expected[i].activeCount);
+            ASSERT_TRUE(wlStats[i + 1].isKernelWakelock);
+        }
+    }
+
+    std::vector<WakeLockInfo> wlStats = getKernelWakelockStats(&parallelReader);
+    ASSERT_EQ(wlStats.size(), kNumSources);
+    for (const WakeLockInfo& info : wlStats) {
+        ASSERT_EQ(info.name, "ws" + std::to_string(info.activeCount));
+    }
+}
+
+static int64_t getCachedActiveCount(KernelWakelockStatsCache* cache,
+                                    std::chrono::milliseconds maxAge) {
+    std::vector<WakeLockInfo> wlStats;
+    cache->getStats(maxAge, &wlStats);
+    return wlStats.size() == 1 ? wlStats[0].activeCount : -1;
+}
+
+TEST(KernelWakelockStatsCacheTest, TestMaxAge) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    std::atomic<uint64_t> generation = 0;
+    KernelWakelockStatsCache cache(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 0ms,
+        &generation);
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 1);
+
+    writeWakeupSource(dir, "wakeup0", "ws0", 2);
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 1);
+    ASSERT_EQ(getCachedActiveCount(&cache, 0ms), 2);
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 2);
+
+    // The snapshot taken before suspending is dropped on resume.
+    writeWakeupSource(dir, "wakeup0", "ws0", 3);
+    cache.pause();
+    cache.resume();
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 3);
+}
+
+TEST(KernelWakelockStatsCacheTest, TestBackgroundRefresh) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    std::atomic<uint64_t> generation = 0;
+    KernelWakelockStatsCache cache(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 10ms,
+        &generation);
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 1);
+
+    // Polling the stats keeps them refreshed in the background.
+    writeWakeupSource(dir, "wakeup0", "ws0", 2);
+    for (int i = 0; i < 500 && getCachedActiveCount(&cache, 1h) != 2; i++) {
+        std::this_thread::sleep_for(5ms);
+    }
+    ASSERT_EQ(getCachedActiveCount(&cache, 1h), 2);
+}
+
+TEST(KernelWakelockStatsCacheTest, TestFreshReadsSkipBackgroundRefresh) {
+    TemporaryDir dir;
+    writeWakeupSource(dir, "wakeup0", "ws0", 1);
+    std::atomic<uint64_t> generation = 0;
+    KernelWakelockStatsCache cache(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 10ms,
+        &generation);
+    ASSERT_EQ(getCachedActiveCount(&cache, 0ms), 1);
+    ASSERT_EQ(generation, 1);
+
+    // Nothing takes a new snapshot, and stamps the change, until the next read.
+    writeWakeupSource(dir, "wakeup0", "ws0", 2);
+    std::this_thread::sleep_for(100ms);
+    ASSERT_EQ(generation, 1);
+    ASSERT_EQ(getCachedActiveCount(&cache, 0ms), 2);
+    ASSERT_EQ(generation, 2);
+}
+
+// Test that callers ranking a shared snapshot concurrently see the same ranking.
+TEST(KernelWakelockStatsCacheTest, TestTopStats) {
+    using ::testing::ElementsAre;
+    TemporaryDir dir;
+    for (int i = 0; i < 3; i++) {
+        writeWakeupSource(dir, "wakeup" + std::to_string(i), "ws" + std::to_string(i), i);
+    }
+    std::atomic<uint64_t> generation = 0;
+    KernelWakelockStatsCache cache(
+        unique_fd(TEMP_FAILURE_RETRY(open(dir.path, O_DIRECTORY | O_CLOEXEC | O_RDONLY))), 0ms,
+        &generation);
+    std::vector<WakeLockInfo> wlStats;
+    cache.getStats(1h, &wlStats);
+    ASSERT_EQ(wlStats.size(), 3);
+
+    std::vector<std::vector<WakeLockInfo>> results(4);
+    std::vector<std::thread> threads;
+    for (std::vector<WakeLockInfo>& result : results) {
+        threads.emplace_back(
+            [&] { cache.getTopStats(1h, WakeLockMetric::ACTIVE_COUNT, 2, &result); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const std::vector<WakeLockInfo>& result : results) {
+        ASSERT_THAT(getNames(result), ElementsAre("ws2", "ws1"));
+    }
+
+    // The ranking is of the snapshot, until a new one is read.
+    writeWakeupSource(dir, "wakeup0", "ws0", 10);
+    wlStats.clear();
+    cache.getTopStats(1h, WakeLockMetric::ACTIVE_COUNT, 1, &wlStats);
+    ASSERT_THAT(getNames(wlStats), ElementsAre("ws2"));
+    wlStats.clear();
+    cache.getTopStats(0ms, WakeLockMetric::ACTIVE_COUNT, 1, &wlStats);
+    ASSERT_THAT(getNames(wlStats), ElementsAre("ws0"));
+}
+
+static SuspendAttempt makeSuspendAttempt(int64_t startTimeMillis, uint32_t wakeupReasonId) {
+    return {
+        .startTimeMillis = startTimeMillis,
+        .endTimeMillis = startTimeMillis + 1,
+        .success = true,
+        .suspendTimeMillis = startTimeMillis + 2,
+        .suspendOverheadTimeMillis = startTimeMillis + 3,
+        .sleepTimeMillis = startTimeMillis + 4,
+        .wakeupReasonId = wakeupReasonId,
+    };
+}
+
+TEST(SuspendHistoryTest, TestEmpty) {
+    SuspendHistory suspendHistory(4, 4);
+
+    std::vector<SuspendAttemptInfo> history;
+    suspendHistory.getHistory(&history);
+    ASSERT_TRUE(history.empty());
+}
+
+TEST(SuspendHistoryTest, TestKeepsMostRecent) {
+    SuspendHistory suspendHistory(3, 4);
+    uint32_t id = suspendHistory.internWakeupReason({"a", "b"});
+
+    for (int i = 0; i < 5; i++) {
+        suspendHistory.record(makeSuspendAttempt(i * 10, id));
+    }
+
+    std::vector<SuspendAttemptInfo> history;
+    suspendHistory.getHistory(&history);
+    ASSERT_EQ(history.size(), 3);
+    for (int i = 0; i < 3; i++) {
+        int64_t start = (i + 2) * 10;
+        ASSERT_EQ(history[i].startTimeMillis, start);
+        ASSERT_EQ(history[i].endTimeMillis, start + 1);
+        ASSERT_TRUE(history[i].success);
+        ASSERT_EQ(history[i].suspendTimeMillis, start + 2);
+        ASSERT_EQ(history[i].suspendOverheadTimeMillis, start + 3);
+        ASSERT_EQ(history[i].sleepTimeMillis, start + 4);
+        ASSERT_EQ(history[i].wakeupReason, "a;b");
+    }
+}
+
+TEST(SuspendHistoryTest, TestInternWakeupReasons) {
+    // Room for "other" and two more reasons.
+    SuspendHistory suspendHistory(4, 3);
+
+    uint32_t a = suspendHistory.internWakeupReason({"a"});
+    uint32_t b = suspendHistory.internWakeupReason({"b"});
+    ASSERT_NE(a, b);
+    ASSERT_EQ(suspendHistory.internWakeupReason({"a"}), a);
+    ASSERT_EQ(suspendHistory.internWakeupReason({"c"}), SuspendHistory::kOtherWakeupReasonId);
+
+    suspendHistory.record(makeSuspendAttempt(0, SuspendHistory::kOtherWakeupReasonId));
+    std::vector<SuspendAttemptInfo> history;
+    suspendHistory.getHistory(&history);
+    ASSERT_EQ(history[0].wakeupReason, "other");
+}
+
+// Tests that readers only ever see fully written attempts while the writer keeps recording.
+TEST(SuspendHistoryTest, TestConcurrentReaders) {
+    constexpr int kNumAttempts = 100000;
+    SuspendHistory suspendHistory(16, 4);
+    std::atomic<bool> done = false;
+
+    std::thread writer([&] {
+        for (int i = 0; i < kNumAttempts; i++) {
+            suspendHistory.record(makeSuspendAttempt(i, SuspendHistory::kOtherWakeupReasonId));
+        }
+        done = true;
+    });
+
+    while (!done) {
+        std::vector<SuspendAttemptInfo> history;
+        suspendHistory.getHistory(&history);
+        ASSERT_LE(history.size(), 16);
+        for (size_t i = 0; i < history.size(); i++) {
+            ASSERT_EQ(history[i].endTimeMillis, history[i].startTimeMillis + 1);
+            ASSERT_EQ(history[i].sleepTimeMillis, history[i].startTimeMillis + 4);
+            if (i > 0) {
+                ASSERT_GT(history[i].startTimeMillis, history[i - 1].startTimeMillis);
+            }
+        }
+    }
+    writer.join();
+}
+
+TEST(SysfsReaderTest, TestReadFromStart) {
+    TemporaryFile file;
+    ASSERT_TRUE(WriteStringToFile("abc\n", file.path));
+    unique_fd fd{TEMP_FAILURE_RETRY(open(file.path, O_CLOEXEC | O_RDONLY))};
+
+    SysfsReader reader;
+    ASSERT_EQ(reader.read(fd), "abc\n");
+    // Subsequent reads start from the beginning of the file again.
+    ASSERT_EQ(reader.read(fd), "abc\n");
+}
+
+TEST(SysfsReaderTest, TestReadSocket) {
+    unique_fd readEnd, writeEnd;
+    ASSERT_TRUE(Socketpair(SOCK_STREAM, &readEnd, &writeEnd));
+    ASSERT_TRUE(WriteStringToFd("42", writeEnd));
+
+    SysfsReader reader;
+    ASSERT_EQ(reader.read(readEnd), "42");
+}
+
+TEST(SysfsReaderTest, TestParseSuspendTime) {
+    std::chrono::nanoseconds suspendOverhead, suspendTime;
+
+    ASSERT_TRUE(parseSuspendTime("0.012345678 10.500000000\n", &suspendOverhead, &suspendTime));
+    ASSERT_EQ(suspendOverhead, 12345678ns);
+    ASSERT_EQ(suspendTime, 10500ms);
+
+    ASSERT_TRUE(parseSuspendTime("0.020000 3", &suspendOverhead, &suspendTime));
+    ASSERT_EQ(suspendOverhead, 20ms);
+    ASSERT_EQ(suspendTime, 3s);
+
+    ASSERT_FALSE(parseSuspendTime("", &suspendOverhead, &suspendTime));
+    ASSERT_FALSE(parseSuspendTime("0.1", &suspendOverhead, &suspendTime));
+    ASSERT_FALSE(parseSuspendTime("abc def", &suspendOverhead, &suspendTime));
+}
+
+TEST(SysfsReaderTest, TestParseWakeupReasons) {
+    std::vector<std::string> reasons;
+
+    parseWakeupReasons("wxyz\n  abc \n\n", &reasons);
+    ASSERT_EQ(reasons, std::vector<std::string>({"wxyz", "abc"}));
+
+    parseWakeupReasons("d", &reasons);
+    ASSERT_EQ(reasons, std::vector<std::string>({"d"}));
+
+    parseWakeupReasons("\n \n", &reasons);
+    ASSERT_TRUE(reasons.empty());
+}
+
+static constexpr SleepTimeConfig kBackoffPolicyConfig = {
+    .baseSleepTime = 100ms,
+    .maxSleepTime = 400ms,
+    .sleepTimeScaleFactor = 2,
+    .backoffThreshold = 1,
+    .shortSuspendThreshold = 100ms,
+    .failedSuspendBackoffEnabled = true,
+    .shortSuspendBackoffEnabled = true,
+};
+
+static WakeLockInfo makeWakeLockInfo(const std::string& name, int64_t activeCount,
+                                     int64_t totalTime) {
+    WakeLockInfo info;
+    info.name = name;
+    info.pid = 1;
+    info.activeCount = activeCount;
+    info.totalTime = totalTime;
+    return info;
+}
+
+static WakeupInfo makeWakeupInfo(const std::string& name, int64_t count) {
+    WakeupInfo info;
+    info.name = name;
+    info.count = count;
+    return info;
+}
+
+// Test that windows sum up the growth of the stats in the intervals they cover.
+TEST(StatsHistoryTest, TestWindows) {
+    constexpr TimestampType kMinute = 60000;
+    StatsHistory history(1min, nullptr);
+    WakeLockStatsDelta delta;
+    delta.full = true;
+    delta.changed = {makeWakeLockInfo("lock1", 1, 10), makeWakeLockInfo("lock2", 1, 10)};
+    history.record(0, delta, {makeWakeupInfo("wakeup1", 3)});
+
+    delta.full = false;
+    delta.changed = {makeWakeLockInfo("lock1", 3, 50)};
+    history.record(kMinute, delta, {makeWakeupInfo("wakeup1", 4)});
+
+    // lock2 was removed, then added back.
+    delta.removed = {makeWakeLockInfo("lock2", 0, 0)};
+    delta.changed = {makeWakeLockInfo("lock1", 4, 70), makeWakeLockInfo("lock2", 1, 5)};
+    history.record(2 * kMinute, delta, {makeWakeupInfo("wakeup2", 2)});
+
+    StatsWindow window;
+    history.getWindow(2 * kMinute + 1, kMinute, &window);
+    ASSERT_EQ(window.startTime, kMinute);
+    ASSERT_EQ(window.endTime, 2 * kMinute);
+    ASSERT_EQ(window.wakeLocks.size(), 2);
+    ASSERT_EQ(window.wakeLocks[0].name, "lock1");
+    ASSERT_EQ(window.wakeLocks[0].activeCount, 1);
+    ASSERT_EQ(window.wakeLocks[0].totalTime, 20);
+    ASSERT_EQ(window.wakeLocks[1].name, "lock2");
+    ASSERT_EQ(window.wakeLocks[1].totalTime, 5);
+    ASSERT_EQ(window.wakeups.size(), 1);
+    ASSERT_EQ(window.wakeups[0].name, "wakeup2");
+    ASSERT_EQ(window.wakeups[0].count, 2);
+
+    history.getWindow(2 * kMinute + 1, 10 * kMinute, &window);
+    ASSERT_EQ(window.startTime, 0);
+    ASSERT_EQ(window.wakeLocks[0].name, "lock1");
+    ASSERT_EQ(window.wakeLocks[0].activeCount, 3);
+    ASSERT_EQ(window.wakeLocks[0].totalTime, 60);
+    ASSERT_EQ(window.wakeups.size(), 2);
+    ASSERT_EQ(window.wakeups[0].name, "wakeup2");
+    ASSERT_EQ(window.wakeups[1].name, "wakeup1");
+    ASSERT_EQ(window.wakeups[1].count, 1);
+}
+
+// Test that old intervals are merged into coarser ones, then dropped.
+TEST(StatsHistoryTest, TestCompaction) {
+    // 4 intervals, then 3 intervals twice as wide.
+    StatsHistory history(1min, nullptr, {{1, 4}, {2, 3}});
+    WakeLockStatsDelta delta;
+    for (int i = 0; i <= 20; i++) {
+        delta.changed = {makeWakeLockInfo("lock", i, 10 * i)};
+        history.record(i, delta, {});
+    }
+
+    StatsWindow window;
+    history.getWindow(20, 1, &window);
+    ASSERT_EQ(window.startTime, 19);
+    ASSERT_EQ(window.wakeLocks[0].activeCount, 1);
+    // Intervals 17 to 20 are kept as they are, the 6 before as 3 merged ones.
+    history.getWindow(20, 1000, &window);
+    ASSERT_EQ(window.startTime, 10);
+    ASSERT_EQ(window.wakeLocks[0].activeCount, 10);
+    ASSERT_EQ(window.wakeLocks[0].totalTime, 100);
+    history.getWindow(20, 7, &window);
+    ASSERT_EQ(window.startTime, 12);
+    ASSERT_EQ(window.wakeLocks[0].activeCount, 8);
+}
+
+// Test that intervals keep the wake locks and wakeups that grew the most, summing up the others.
+TEST(StatsHistoryTest, TestCapsIntervals) {
+    StatsHistory history(1min, nullptr);
+    WakeLockStatsDelta delta;
+    std::vector<WakeupInfo> wakeups;
+    history.record(0, delta, wakeups);
+    for (size_t i = 0; i < StatsHistory::kMaxWakeLocks + 10; i++) {
+        delta.changed.push_back(makeWakeLockInfo("lock" + std::to_string(i), 1, i + 1));
+    }
+    for (size_t i = 0; i < StatsHistory::kMaxWakeups + 5; i++) {
+        wakeups.push_back(makeWakeupInfo("wakeup" + std::to_string(i), i + 1));
+    }
+    history.record(1, delta, wakeups);
+
+    StatsWindow window;
+    history.getWindow(1, 1, &window);
+    ASSERT_EQ(window.wakeLocks.size(), StatsHistory::kMaxWakeLocks);
+    ASSERT_EQ(window.wakeLocks.back().totalTime, 11);
+    ASSERT_EQ(window.otherWakeLockActiveCount, 10);
+    ASSERT_EQ(window.otherWakeLockTotalTime, 55);
+    ASSERT_EQ(window.wakeups.size(), StatsHistory::kMaxWakeups);
+    ASSERT_EQ(window.wakeups.back().count, 6);
+    ASSERT_EQ(window.otherWakeupCount, 15);
+}
+
+// Test that the sampling thread records samples at CLOCK_BOOTTIME times, one sampling interval
+// apart.
+TEST(StatsHistoryTest, TestSamplesOnBoottime) {
+    std::atomic<int> samples = 0;
+    StatsHistory history(10ms, [&](int64_t, WakeLockStatsDelta*, std::vector<WakeupInfo>* wakeups) {
+        wakeups->push_back(makeWakeupInfo("wakeup1", ++samples));
+    });
+    const TimestampType start = StatsHistory::getBoottimeNow();
+    history.start();
+    for (int i = 0; i < 500 && samples < 4; i++) {
+        history.onResume();
+        std::this_thread::sleep_for(5ms);
+    }
+    ASSERT_GE(samples, 4);
+
+    StatsWindow window;
+    history.getWindow(StatsHistory::getBoottimeNow(), 1h / 1ms, &window);
+    ASSERT_GE(window.startTime, start);
+    ASSERT_GE(window.endTime - window.startTime, 20);
+    ASSERT_LE(window.endTime, StatsHistory::getBoottimeNow());
+    ASSERT_EQ(window.wakeups.size(), 1);
+    ASSERT_GE(window.wakeups[0].count, 2);
+}
+
+static std::vector<uint32_t> getRankedIds(const WakeLockRanking& ranking) {
+    std::vector<uint32_t> ids;
+    for (const WakeLockRanking::Entry& entry : ranking.getTop()) {
+        ids.push_back(entry.id);
+    }
+    return ids;
+}
+
+// Test that entries are ranked as their values grow, entering a full ranking past its last value.
+TEST(WakeLockRankingTest, TestRanksGrowingValues) {
+    WakeLockRanking ranking(kMaxTopWakeLocks + 1);
+    for (uint32_t id = 0; id <= kMaxTopWakeLocks; id++) {
+        ranking.update(id, id);
+    }
+    std::vector<uint32_t> ids = getRankedIds(ranking);
+    ASSERT_EQ(ids.size(), kMaxTopWakeLocks);
+    ASSERT_EQ(ids.front(), kMaxTopWakeLocks);
+    ASSERT_EQ(ids.back(), 1);
+
+    ranking.update(0, 1000);
+    ranking.update(2, 50);
+    ids = getRankedIds(ranking);
+    ASSERT_EQ(ids.size(), kMaxTopWakeLocks);
+    ASSERT_EQ(ids.front(), 0);
+    ASSERT_EQ(ids.back(), 3);
+    ASSERT_TRUE(std::is_sorted(
+        ranking.getTop().begin(), ranking.getTop().end(),
+        [](const auto& a, const auto& b) { return a.value > b.value; }));
+}
+
+// Test that removing a ranked entry from a full ranking marks it stale until it's rebuilt.
+TEST(WakeLockRankingTest, TestRemove) {
+    WakeLockRanking ranking(kMaxTopWakeLocks + 1);
+    ranking.update(0, 1);
+    ranking.update(1, 2);
+    // All of the entries are still ranked.
+    ranking.remove(0);
+    ASSERT_FALSE(ranking.isStale());
+    ASSERT_EQ(getRankedIds(ranking), std::vector<uint32_t>({1}));
+
+    for (uint32_t id = 2; id <= kMaxTopWakeLocks; id++) {
+        ranking.update(id, id);
+    }
+    ranking.remove(kMaxTopWakeLocks);
+    ASSERT_TRUE(ranking.isStale());
+    // Ignored until rebuilt.
+    ranking.update(0, 1000);
+    ASSERT_EQ(ranking.getTop().size(), kMaxTopWakeLocks - 1);
+
+    std::vector<WakeLockRanking::Entry> entries;
+    for (uint32_t id = 0; id < kMaxTopWakeLocks; id++) {
+        entries.push_back({id == 0 ? 1000 : id, id});
+    }
+    ranking.rebuild(entries);
+    ASSERT_FALSE(ranking.isStale());
+    std::vector<uint32_t> ids = getRankedIds(ranking);
+    ASSERT_EQ(ids.size(), kMaxTopWakeLocks);
+    ASSERT_EQ(ids.front(), 0);
+    ASSERT_EQ(ids.back(), 1);
+    ranking.update(kMaxTopWakeLocks, 2000);
+    ASSERT_EQ(getRankedIds(ranking).front(), kMaxTopWakeLocks);
+}
+
+// Test that text copied and referenced, padded and not, is written in order across flushes.
+TEST(DumpWriterTest, TestWritesInOrder) {
+    TemporaryFile file;
+    std::string expected;
+    const std::string longText(100, 'x');
+    {
+        DumpWriter writer(file.fd);
+        for (int i = 0; i < 500; i++) {
+            writer.write("a");
+            writer.writeRef(longText);
+            writer.writeLeft("b", 3);
+            writer.writeRight("c", 3);
+            writer.writeRight(-i, "ms", 8);
+            writer.writeFill('-', 2);
+            std::string number = std::to_string(-i) + "ms";
+            expected += "a" + longText + "b    c" + std::string(8 - number.size(), ' ') + number +
+                        "--";
+        }
+        // Too long for the padding.
+        writer.writeLeft("long", 2);
+        writer.writeRight(12345, "", 2);
+        expected += "long12345";
+        ASSERT_TRUE(writer.flush());
+    }
+
+    std::string actual;
+    ASSERT_TRUE(ReadFileToString(file.path, &actual));
+    ASSERT_EQ(actual, expected);
+}
+
+TEST(SuspendBackoffPolicyTest, TestExponential) {
+    ExponentialBackoffPolicy policy(kBackoffPolicyConfig);
+    const SuspendOutcome failed = {.success = false, .suspendTime = 0ns};
+
+    auto decision = policy.update(failed);
+    ASSERT_EQ(decision.sleepTime, 100ms);
+    ASSERT_EQ(decision.event, BackoffEvent::NONE);
+
+    decision = policy.update(failed);
+    ASSERT_EQ(decision.sleepTime, 200ms);
+    ASSERT_EQ(decision.event, BackoffEvent::NEW_BACKOFF);
+
+    decision = policy.update({.success = true, .suspendTime = 10ms});
+    ASSERT_EQ(decision.sleepTime, 400ms);
+    ASSERT_EQ(decision.event, BackoffEvent::CONTINUE_BACKOFF);
+
+    decision = policy.update(failed);
+    ASSERT_EQ(decision.sleepTime, 400ms);
+
+    decision = policy.update({.success = true, .suspendTime = 1s});
+    ASSERT_EQ(decision.sleepTime, 100ms);
+    ASSERT_EQ(decision.event, BackoffEvent::NONE);
+}
+
+TEST(SuspendBackoffPolicyTest, TestEwma) {
+    EwmaBackoffPolicy policy(kBackoffPolicyConfig, 0.5);
+    const SuspendOutcome failed = {.success = false, .suspendTime = 0ns};
+    const SuspendOutcome good = {.success = true, .suspendTime = 1s};
+
+    // A single bad suspend starts backing off, p = 0.5
+    auto decision = policy.update(failed);
+    ASSERT_EQ(decision.sleepTime, 200ms);
+    ASSERT_EQ(decision.event, BackoffEvent::NEW_BACKOFF);
+
+    // A good suspend only halves the bad suspend rate, p = 0.25
+    decision = policy.update(good);
+    ASSERT_EQ(decision.sleepTime, 133ms);
+    ASSERT_EQ(decision.event, BackoffEvent::CONTINUE_BACKOFF);
+
+    for (int i = 0; i < 10; i++) {
+        decision = policy.update(failed);
+    }
+    ASSERT_EQ(decision.sleepTime, kBackoffPolicyConfig.maxSleepTime);
+
+    for (int i = 0; i < 20; i++) {
+        decision = policy.update(good);
+    }
+    ASSERT_EQ(decision.sleepTime, kBackoffPolicyConfig.baseSleepTime);
+    ASSERT_EQ(decision.event, BackoffEvent::NONE);
+}
+
+TEST(SuspendBackoffPolicyTest, TestWakeupReasonSkipsAttempt) {
+    SleepTimeConfig config = kBackoffPolicyConfig;
+    config.shortSuspendBackoffEnabled = false;
+    WakeupReasonAwareBackoffPolicy policy(config);
+    const std::vector<std::string> quickReason = {"170 qpnp_rtc_alarm"};
+    const std::vector<std::string> slowReason = {"200 pwr_key"};
+
+    for (uint32_t i = 1; i < WakeupReasonAwareBackoffPolicy::kMinSamples; i++) {
+        auto decision =
+            policy.update({.success = true, .suspendTime = 10ms, .wakeupReasons = &quickReason});
+        ASSERT_EQ(decision.sleepTime, config.baseSleepTime);
+    }
+    auto decision =
+        policy.update({.success = true, .suspendTime = 10ms, .wakeupReasons = &quickReason});
+    ASSERT_EQ(decision.sleepTime, 2 * config.baseSleepTime);
+
+    decision = policy.update({.success = true, .suspendTime = 10ms, .wakeupReasons = &slowReason});
+    ASSERT_EQ(decision.sleepTime, config.baseSleepTime);
+}
+
+TEST(SuspendBackoffSimulatorTest, TestParseTraceEntry) {
+    SuspendTraceEntry entry;
+    ASSERT_FALSE(parseSuspendTraceEntry(
+        "    START (ms)       END (ms)  RESULT  SUSPEND (ms) OVERHEAD (ms)    SLEEP (ms)  WAKEUP "
+        "REASON",
+        &entry));
+
+    ASSERT_TRUE(parseSuspendTraceEntry(
+        "          1000           1130      ok          5000            30           100  "
+        "170 qpnp_rtc_alarm;200 pwr_key",
+        &entry));
+    ASSERT_EQ(entry.startTimeMillis, 1000);
+    ASSERT_TRUE(entry.success);
+    ASSERT_EQ(entry.suspendTimeMillis, 5000);
+    ASSERT_EQ(entry.suspendOverheadTimeMillis, 30);
+    ASSERT_EQ(entry.wakeupReasons, std::vector<std::string>({"170 qpnp_rtc_alarm", "200 pwr_key"}));
+
+    ASSERT_TRUE(parseSuspendTraceEntry("1 2 failed 0 10 100", &entry));
+    ASSERT_FALSE(entry.success);
+    ASSERT_TRUE(entry.wakeupReasons.empty());
+}
+
+TEST(SuspendBackoffSimulatorTest, TestReplayMatchesRecording) {
+    // Two long suspends 100ms apart, replayed with the same base sleep time.
+    const std::vector<SuspendTraceEntry> trace = {
+        {.startTimeMillis = 0, .success = true, .suspendTimeMillis = 1000,
+         .suspendOverheadTimeMillis = 10},
+        {.startTimeMillis = 110, .success = true, .suspendTimeMillis = 1000,
+         .suspendOverheadTimeMillis = 10},
+    };
+    ExponentialBackoffPolicy policy(kBackoffPolicyConfig);
+
+    SimulationResult result = simulateSuspendBackoff(kBackoffPolicyConfig, &policy, trace);
+    ASSERT_EQ(result.attempts, 2u);
+    ASSERT_EQ(result.failedAttempts, 0u);
+    ASSERT_EQ(result.wastedOverheadMillis, 0);
+    ASSERT_EQ(result.awakeMillis, 120);
+    ASSERT_EQ(result.suspendedMillis, 2000);
+}
+
+TEST(SuspendBackoffSimulatorTest, TestBackoffReducesWastedOverhead) {
+    std::vector<SuspendTraceEntry> trace;
+    for (int64_t i = 0; i < 100; i++) {
+        trace.push_back({.startTimeMillis = i * 110, .success = false,
+                         .suspendOverheadTimeMillis = 10});
+    }
+    SleepTimeConfig config = kBackoffPolicyConfig;
+    config.failedSuspendBackoffEnabled = false;
+    ExponentialBackoffPolicy noBackoff(config);
+    ExponentialBackoffPolicy backoff(kBackoffPolicyConfig);
+
+    SimulationResult noBackoffResult = simulateSuspendBackoff(config, &noBackoff, trace);
+    SimulationResult backoffResult = simulateSuspendBackoff(kBackoffPolicyConfig, &backoff, trace);
+    ASSERT_EQ(noBackoffResult.attempts, trace.size());
+    ASSERT_LT(backoffResult.attempts, noBackoffResult.attempts);
+    ASSERT_LT(backoffResult.wastedOverheadMillis, noBackoffResult.wastedOverheadMillis);
+    ASSERT_EQ(backoffResult.awakeMillis, noBackoffResult.awakeMillis);
+}
+
+static std::string readStatFile(int dirFd, const std::string& name) {
+    unique_fd fd{TEMP_FAILURE_RETRY(openat(dirFd, name.c_str(), O_CLOEXEC | O_RDONLY))};
+    std::string content;
+    if (fd < 0 || !ReadFdToString(fd, &content)) return "";
+    return content;
+}
+
+// Drives FakeKernel the way the autosuspend loop does.
+TEST(FakeKernelTest, TestSuspendAndAbort) {
+    FakeKernelConfig config;
+    config.reportedSuspendTime = 2s;
+    config.failEvery = 2;
+    config.wakeupReasons = {"170 qpnp_rtc_alarm", "200 pwr_key"};
+    FakeKernel kernel(config, 2 /* numWakeupSources */);
+    unique_fd wakeupCountFd = kernel.takeWakeupCountFd();
+    unique_fd stateFd = kernel.takeStateFd();
+    unique_fd suspendTimeFd = kernel.openSuspendTimeFd();
+    unique_fd wakeupReasonsFd = kernel.openWakeupReasonsFd();
+
+    SysfsReader reader;
+    for (uint64_t attempt = 1; attempt <= 4; attempt++) {
+        std::string wakeupCount(reader.read(wakeupCountFd));
+        ASSERT_EQ(wakeupCount, std::to_string(attempt));
+        ASSERT_TRUE(WriteStringToFd(wakeupCount, wakeupCountFd));
+
+        bool success = WriteStringToFd("mem", stateFd);
+        ASSERT_EQ(success, attempt % 2 == 1);
+        std::chrono::nanoseconds suspendOverhead, suspendTime;
+        ASSERT_TRUE(parseSuspendTime(reader.read(suspendTimeFd), &suspendOverhead, &suspendTime));
+        ASSERT_EQ(suspendOverhead, config.reportedSuspendOverhead);
+        ASSERT_EQ(suspendTime, success ? config.reportedSuspendTime : 0s);
+        std::string wakeupReasons(reader.read(wakeupReasonsFd));
+        ASSERT_EQ(wakeupReasons,
+                  success ? config.wakeupReasons[attempt / 2] + "\n"
+                          : "Abort: Pending Wakeup Sources: fake_kernel\n");
+
+        ASSERT_TRUE(kernel.waitForAttempts(attempt, 1s));
+    }
+
+    FakeKernelStats stats = kernel.getStats();
+    ASSERT_EQ(stats.attempts, 4u);
+    ASSERT_EQ(stats.aborted, 2u);
+
+    unique_fd suspendStatsFd = kernel.openSuspendStatsFd();
+    ASSERT_EQ(readStatFile(suspendStatsFd, "success"), "2\n");
+    ASSERT_EQ(readStatFile(suspendStatsFd, "fail"), "2\n");
+    ASSERT_EQ(readStatFile(suspendStatsFd, "last_failed_step"), "suspend\n");
+
+    unique_fd wakeupSourcesFd = kernel.openKernelWakelockStatsFd();
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup0/wakeup_count"), "1\n");
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup1/wakeup_count"), "1\n");
+}
+
+TEST(FakeKernelTest, TestSetNumWakeupSources) {
+    FakeKernel kernel(FakeKernelConfig{}, 1 /* numWakeupSources */);
+    unique_fd wakeupSourcesFd = kernel.openKernelWakelockStatsFd();
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup0/name"), "fake_wakeup_source_0\n");
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup2/name"), "");
+
+    kernel.setNumWakeupSources(3);
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup2/name"), "fake_wakeup_source_2\n");
+
+    kernel.setNumWakeupSources(1);
+    ASSERT_EQ(readStatFile(wakeupSourcesFd, "wakeup1/name"), "");
+}
+
 }  // namespace android
 
 int main(int argc, char** argv) {
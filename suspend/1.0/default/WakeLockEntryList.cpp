@@ -16,93 +16,106 @@
 
 #include "WakeLockEntryList.h"
 
-#include <android-base/file.h>
 #include <android-base/logging.h>
 
-#include <iomanip>
+#include <algorithm>
 
-using android::base::ReadFdToString;
+#include "DumpWriter.h"
 
 namespace android {
 namespace system {
 namespace suspend {
 namespace V1_0 {
 
-static std::ostream& operator<<(std::ostream& out, const WakeLockInfo& entry) {
-    const char* sep = " | ";
-    const char* notApplicable = "---";
+// Width of the wakelock stats table, and widths of its columns.
+static constexpr size_t kDumpWidth = 194;
+static constexpr size_t kNameWidth = 30;
+static constexpr size_t kPidWidth = 6;
+static constexpr size_t kTypeWidth = 6;
+static constexpr size_t kStatusWidth = 8;
+static constexpr size_t kStatWidth = 12;
+static constexpr size_t kPreventSuspendTimeWidth = 20;
+static constexpr size_t kLastChangeWidth = 16;
+
+static constexpr std::string_view kSep = " | ";
+static constexpr std::string_view kNotApplicable = "---";
+
+static void dumpEntry(DumpWriter* writer, const WakeLockInfo& entry) {
     bool kernelWakelock = entry.isKernelWakelock;
 
-    // clang-format off
-    out << sep
-        << std::left << std::setw(30) << entry.name << sep
-        << std::right << std::setw(6)
-        << ((kernelWakelock) ? notApplicable : std::to_string(entry.pid)) << sep
-        << std::left << std::setw(6) << ((kernelWakelock) ? "Kernel" : "Native") << sep
-        << std::left << std::setw(8) << ((entry.isActive) ? "Active" : "Inactive") << sep
-        << std::right << std::setw(12) << entry.activeCount << sep
-        << std::right << std::setw(12) << std::to_string(entry.totalTime) + "ms" << sep
-        << std::right << std::setw(12) << std::to_string(entry.maxTime) + "ms" << sep
-        << std::right << std::setw(12)
-        << ((kernelWakelock) ? std::to_string(entry.eventCount) : notApplicable) << sep
-        << std::right << std::setw(12)
-        << ((kernelWakelock) ? std::to_string(entry.wakeupCount) : notApplicable) << sep
-        << std::right << std::setw(12)
-        << ((kernelWakelock) ? std::to_string(entry.expireCount) : notApplicable) << sep
-        << std::right << std::setw(20)
-        << ((kernelWakelock) ? std::to_string(entry.preventSuspendTime) + "ms" : notApplicable)
-        << sep
-        << std::right << std::setw(16) << std::to_string(entry.lastChange) + "ms" << sep;
-    // clang-format on
-
-    return out;
-}
-
-std::ostream& operator<<(std::ostream& out, const WakeLockEntryList& list) {
-    std::vector<WakeLockInfo> wlStats;
-    list.getWakeLockStats(&wlStats);
-    int width = 194;
-    const char* sep = " | ";
-    std::stringstream ss;
-    ss << "  " << std::setfill('-') << std::setw(width) << "\n";
-    std::string div = ss.str();
-
-    out << div;
-
-    std::stringstream header;
-    header << sep << std::right << std::setw(((width - 14) / 2) + 14) << "WAKELOCK STATS"
-           << std::right << std::setw((width - 14) / 2) << sep << "\n";
-    out << header.str();
-
-    out << div;
+    writer->write(kSep);
+    writer->writeLeft(entry.name, kNameWidth);
+    writer->write(kSep);
+    if (kernelWakelock) {
+        writer->writeRight(kNotApplicable, kPidWidth);
+    } else {
+        writer->writeRight(entry.pid, "", kPidWidth);
+    }
+    writer->write(kSep);
+    writer->writeLeft(kernelWakelock ? "Kernel" : "Native", kTypeWidth);
+    writer->write(kSep);
+    writer->writeLeft(entry.isActive ? "Active" : "Inactive", kStatusWidth);
+    writer->write(kSep);
+    writer->writeRight(entry.activeCount, "", kStatWidth);
+    writer->write(kSep);
+    writer->writeRight(entry.totalTime, "ms", kStatWidth);
+    writer->write(kSep);
+    writer->writeRight(entry.maxTime, "ms", kStatWidth);
+    writer->write(kSep);
+    if (kernelWakelock) {
+        writer->writeRight(entry.eventCount, "", kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(entry.wakeupCount, "", kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(entry.expireCount, "", kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(entry.preventSuspendTime, "ms", kPreventSuspendTimeWidth);
+    } else {
+        writer->writeRight(kNotApplicable, kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(kNotApplicable, kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(kNotApplicable, kStatWidth);
+        writer->write(kSep);
+        writer->writeRight(kNotApplicable, kPreventSuspendTimeWidth);
+    }
+    writer->write(kSep);
+    writer->writeRight(entry.lastChange, "ms", kLastChangeWidth);
+    writer->write(kSep);
+    writer->write("\n");
+}
+
+static void dumpHeader(DumpWriter* writer, std::string_view div) {
+    constexpr std::string_view title = "WAKELOCK STATS";
+
+    writer->writeRef(div);
+    writer->write(kSep);
+    writer->writeRight(title, (kDumpWidth - title.size()) / 2 + title.size());
+    writer->writeRight(kSep, (kDumpWidth - title.size()) / 2);
+    writer->write("\n");
+    writer->writeRef(div);
 
     // Col names
-    // clang-format off
-    out << sep
-        << std::left << std::setw(30) << "NAME" << sep
-        << std::left << std::setw(6) << "PID" << sep
-        << std::left << std::setw(6) << "TYPE" << sep
-        << std::left << std::setw(8) << "STATUS" << sep
-        << std::left << std::setw(12) << "ACTIVE COUNT" << sep
-        << std::left << std::setw(12) << "TOTAL TIME" << sep
-        << std::left << std::setw(12) << "MAX TIME" << sep
-        << std::left << std::setw(12) << "EVENT COUNT" << sep
-        << std::left << std::setw(12) << "WAKEUP COUNT" << sep
-        << std::left << std::setw(12) << "EXPIRE COUNT" << sep
-        << std::left << std::setw(20) << "PREVENT SUSPEND TIME" << sep
-        << std::left << std::setw(16) << "LAST CHANGE" << sep
-        << "\n";
-    // clang-format on
-
-    out << div;
-
-    // Rows
-    for (const WakeLockInfo& entry : wlStats) {
-        out << entry << "\n";
-    }
-
-    out << div;
-    return out;
+    writer->write(kSep);
+    writer->writeLeft("NAME", kNameWidth);
+    writer->write(kSep);
+    writer->writeLeft("PID", kPidWidth);
+    writer->write(kSep);
+    writer->writeLeft("TYPE", kTypeWidth);
+    writer->write(kSep);
+    writer->writeLeft("STATUS", kStatusWidth);
+    writer->write(kSep);
+    for (const char* name : {"ACTIVE COUNT", "TOTAL TIME", "MAX TIME", "EVENT COUNT",
+                             "WAKEUP COUNT", "EXPIRE COUNT"}) {
+        writer->writeLeft(name, kStatWidth);
+        writer->write(kSep);
+    }
+    writer->writeLeft("PREVENT SUSPEND TIME", kPreventSuspendTimeWidth);
+    writer->write(kSep);
+    writer->writeLeft("LAST CHANGE", kLastChangeWidth);
+    writer->write(kSep);
+    writer->write("\n");
+    writer->writeRef(div);
 }
 
 /**
@@ -119,265 +132,694 @@ TimestampType getTimeNow() {
                .count();
 }
 
-WakeLockEntryList::WakeLockEntryList(size_t capacity, unique_fd kernelWakelockStatsFd)
-    : mCapacity(capacity), mKernelWakelockStatsFd(std::move(kernelWakelockStatsFd)) {}
+size_t getHoldTimeBucket(TimestampType holdTime) {
+    if (holdTime < 1) {
+        return 0;
+    }
+    // One more than the index of the highest bit set.
+    size_t bucket = 64 - __builtin_clzll(static_cast<uint64_t>(holdTime));
+    return std::min(bucket, kNumHoldTimeBuckets - 1);
+}
 
-/**
- * Evicts LRU from back of list if stats is at capacity.
- */
-void WakeLockEntryList::evictIfFull() {
-    if (mStats.size() == mCapacity) {
-        auto evictIt = mStats.end();
-        std::advance(evictIt, -1);
-        auto evictKey = std::make_pair(evictIt->name, evictIt->pid);
-        mLookupTable.erase(evictKey);
-        mStats.erase(evictIt);
-        LOG(ERROR) << "WakeLock Stats: Stats capacity met, consider adjusting capacity to "
-                      "avoid stats eviction.";
+// Shortest hold time counted by a HoldTimeHistogram bucket.
+static int64_t getHoldTimeBucketStart(size_t bucket) {
+    return bucket == 0 ? 0 : int64_t{1} << (bucket - 1);
+}
+
+// Smallest power of two at least twice the capacity, to keep probe sequences short.
+static size_t indexSize(size_t capacity) {
+    size_t size = 1;
+    while (size < 2 * capacity) {
+        size <<= 1;
     }
+    return size;
+}
+
+WakeLockEntryList::WakeLockEntryList(size_t capacity, unique_fd kernelWakelockStatsFd,
+                                     std::chrono::milliseconds kernelStatsRefreshInterval)
+    : mCapacity(capacity),
+      mKernelWakelockStats(std::move(kernelWakelockStatsFd), kernelStatsRefreshInterval,
+                           &mGeneration),
+      mSlots(capacity),
+      mIndex(indexSize(capacity), kNoSlot),
+      mRankings{WakeLockRanking(capacity), WakeLockRanking(capacity), WakeLockRanking(capacity)} {
+    for (Slot& slot : mSlots) {
+        slot.info = std::make_shared<WakeLockInfo>();
+    }
+    mEvictions.reserve(capacity);
+}
+
+uint64_t WakeLockEntryList::nextGeneration() {
+    return mGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
 }
 
 /**
- * Inserts entry as MRU.
+ * Hashes a stats key. The pid is mixed in rather than XORed with the name hash, so that the low
+ * bits used to pick a queue and an index bucket depend on both.
  */
-void WakeLockEntryList::insertEntry(WakeLockInfo entry) {
-    auto key = std::make_pair(entry.name, entry.pid);
-    mStats.emplace_front(std::move(entry));
-    mLookupTable[key] = mStats.begin();
+size_t WakeLockEntryList::hashKey(std::string_view name, int pid) {
+    uint64_t hash = std::hash<std::string_view>()(name);
+    hash ^= static_cast<uint64_t>(static_cast<uint32_t>(pid)) * 0x9e3779b97f4a7c15;
+    // Finalizer from MurmurHash3.
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash);
 }
 
 /**
- * Removes entry from the stats list.
+ * Returns the slot holding the stats of the given wakelock, or kNoSlot.
  */
-void WakeLockEntryList::deleteEntry(std::list<WakeLockInfo>::iterator entry) {
-    auto key = std::make_pair(entry->name, entry->pid);
-    mLookupTable.erase(key);
-    mStats.erase(entry);
+uint32_t WakeLockEntryList::findEntry(std::string_view name, int pid, size_t hash) const {
+    const size_t mask = mIndex.size() - 1;
+    for (size_t i = hash & mask; mIndex[i] != kNoSlot; i = (i + 1) & mask) {
+        const Slot& slot = mSlots[mIndex[i]];
+        if (slot.hash == hash && slot.info->pid == pid && slot.info->name == name) {
+            return mIndex[i];
+        }
+    }
+    return kNoSlot;
 }
 
 /**
- * Creates and returns a native wakelock entry.
+ * Returns an unused slot, evicting the LRU stat if stats is at capacity.
  */
-WakeLockInfo WakeLockEntryList::createNativeEntry(const std::string& name, int pid,
-                                                  TimestampType timeNow) const {
-    WakeLockInfo info;
+uint32_t WakeLockEntryList::allocateEntry() {
+    if (mNumEntries < mCapacity) {
+        return mNumEntries++;
+    }
 
-    info.name = name;
-    // It only makes sense to create a new entry on initial activation of the lock.
-    info.activeCount = 1;
-    info.lastChange = timeNow;
-    info.maxTime = 0;
-    info.totalTime = 0;
-    info.isActive = true;
-    info.activeTime = 0;
-    info.isKernelWakelock = false;
+    uint32_t slot = mLru;
+    recordEviction(slot);
+    unlink(slot);
+    unindexEntry(slot);
+    for (WakeLockRanking& ranking : mRankings) {
+        ranking.remove(slot);
+    }
+    if (mSlots[slot].info->isActive) {
+        unlinkActive(slot);
+    }
+    if (!mEvicted) {
+        mEvicted = true;
+        LOG(ERROR) << "WakeLock Stats: Stats capacity met, consider adjusting capacity to "
+                      "avoid stats eviction.";
+    }
+    return slot;
+}
 
-    info.pid = pid;
+void WakeLockEntryList::recordEviction(uint32_t slot) {
+    const WakeLockInfo& info = *mSlots[slot].info;
+    const uint64_t generation = nextGeneration();
+    if (mEvictions.size() < mCapacity) {
+        mEvictions.push_back({info.name, info.pid, generation});
+        return;
+    }
+    // Reuse the storage of the oldest eviction, so that steady-state eviction doesn't allocate.
+    Eviction& eviction = mEvictions[mNextEviction];
+    mForgottenGeneration = eviction.generation;
+    eviction.name.assign(info.name);
+    eviction.pid = info.pid;
+    eviction.generation = generation;
+    mNextEviction = (mNextEviction + 1) % mEvictions.size();
+}
 
-    info.eventCount = 0;
-    info.expireCount = 0;
-    info.preventSuspendTime = 0;
-    info.wakeupCount = 0;
+void WakeLockEntryList::rankEntry(uint32_t slot) {
+    const WakeLockInfo& info = *mSlots[slot].info;
+    for (size_t i = 0; i < kNumWakeLockMetrics; i++) {
+        mRankings[i].update(slot, getWakeLockMetric(info, static_cast<WakeLockMetric>(i)));
+    }
+}
 
-    return info;
+void WakeLockEntryList::indexEntry(uint32_t slot) {
+    const size_t mask = mIndex.size() - 1;
+    size_t i = mSlots[slot].hash & mask;
+    while (mIndex[i] != kNoSlot) {
+        i = (i + 1) & mask;
+    }
+    mIndex[i] = slot;
 }
 
-/*
- * Checks whether a given directory entry is a stat file we're interested in.
+/**
+ * Removes slot from mIndex, shifting back the entries that follow it in its probe sequence so
+ * that lookups don't need tombstones.
  */
-static bool isStatFile(const struct dirent* de) {
-    const char* statName = de->d_name;
-    if (!strcmp(statName, ".") || !strcmp(statName, "..") || !strcmp(statName, "device") ||
-        !strcmp(statName, "power") || !strcmp(statName, "subsystem") ||
-        !strcmp(statName, "uevent")) {
-        return false;
+void WakeLockEntryList::unindexEntry(uint32_t slot) {
+    const size_t mask = mIndex.size() - 1;
+    size_t hole = mSlots[slot].hash & mask;
+    while (mIndex[hole] != slot) {
+        hole = (hole + 1) & mask;
     }
-    return true;
+    for (size_t i = (hole + 1) & mask; mIndex[i] != kNoSlot; i = (i + 1) & mask) {
+        size_t home = mSlots[mIndex[i]].hash & mask;
+        // The entry can fill the hole unless its home lies cyclically in (hole, i].
+        bool homeAfterHole = hole < i ? (home > hole && home <= i) : (home > hole || home <= i);
+        if (!homeAfterHole) {
+            mIndex[hole] = mIndex[i];
+            hole = i;
+        }
+    }
+    mIndex[hole] = kNoSlot;
 }
 
-/*
- * Creates and returns a kernel wakelock entry with data read from mKernelWakelockStatsFd
+/**
+ * Inserts slot as MRU.
  */
-WakeLockInfo WakeLockEntryList::createKernelEntry(const std::string& kwlId) const {
-    WakeLockInfo info;
-
-    info.activeCount = 0;
-    info.lastChange = 0;
-    info.maxTime = 0;
-    info.totalTime = 0;
-    info.isActive = false;
-    info.activeTime = 0;
-    info.isKernelWakelock = true;
-
-    info.pid = -1;  // N/A
-
-    info.eventCount = 0;
-    info.expireCount = 0;
-    info.preventSuspendTime = 0;
-    info.wakeupCount = 0;
-
-    unique_fd wakelockFd{TEMP_FAILURE_RETRY(
-        openat(mKernelWakelockStatsFd, kwlId.c_str(), O_DIRECTORY | O_CLOEXEC | O_RDONLY))};
-    if (wakelockFd < 0) {
-        PLOG(ERROR) << "Error opening kernel wakelock stats for: " << kwlId;
-    }
-
-    std::unique_ptr<DIR, decltype(&closedir)> wakelockDp(fdopendir(dup(wakelockFd.get())),
-                                                         &closedir);
-    if (wakelockDp) {
-        struct dirent* de;
-        while ((de = readdir(wakelockDp.get()))) {
-            if (!isStatFile(de)) {
-                continue;
-            }
+void WakeLockEntryList::linkFront(uint32_t slot) {
+    mSlots[slot].prev = kNoSlot;
+    mSlots[slot].next = mMru;
+    if (mMru != kNoSlot) {
+        mSlots[mMru].prev = slot;
+    } else {
+        mLru = slot;
+    }
+    mMru = slot;
+}
 
-            std::string statName(de->d_name);
-            unique_fd statFd{
-                TEMP_FAILURE_RETRY(openat(wakelockFd, statName.c_str(), O_CLOEXEC | O_RDONLY))};
-            if (statFd < 0) {
-                PLOG(ERROR) << "Error opening " << statName << " for " << kwlId;
-            }
+void WakeLockEntryList::unlink(uint32_t slot) {
+    Slot& entry = mSlots[slot];
+    if (entry.prev != kNoSlot) {
+        mSlots[entry.prev].next = entry.next;
+    } else {
+        mMru = entry.next;
+    }
+    if (entry.next != kNoSlot) {
+        mSlots[entry.next].prev = entry.prev;
+    } else {
+        mLru = entry.prev;
+    }
+}
 
-            std::string valStr;
-            if (!ReadFdToString(statFd.get(), &valStr)) {
-                PLOG(ERROR) << "Error reading " << statName << " for " << kwlId;
-                continue;
-            }
+void WakeLockEntryList::linkActive(uint32_t slot) {
+    mSlots[slot].activePrev = kNoSlot;
+    mSlots[slot].activeNext = mActive;
+    if (mActive != kNoSlot) {
+        mSlots[mActive].activePrev = slot;
+    }
+    mActive = slot;
+}
 
-            // Trim newline
-            valStr.erase(std::remove(valStr.begin(), valStr.end(), '\n'), valStr.end());
+void WakeLockEntryList::unlinkActive(uint32_t slot) {
+    Slot& entry = mSlots[slot];
+    if (entry.activePrev != kNoSlot) {
+        mSlots[entry.activePrev].activeNext = entry.activeNext;
+    } else {
+        mActive = entry.activeNext;
+    }
+    if (entry.activeNext != kNoSlot) {
+        mSlots[entry.activeNext].activePrev = entry.activePrev;
+    }
+}
 
-            if (statName == "name") {
-                info.name = valStr;
-                continue;
-            }
+/**
+ * Returns the entry in slot for modification. If readers still hold the current version of the
+ * entry, it is copied first so that their snapshot isn't modified under them.
+ */
+WakeLockInfo& WakeLockEntryList::writableEntry(uint32_t slot) {
+    std::shared_ptr<WakeLockInfo>& info = mSlots[slot].info;
+    // Readers take and drop their references under mStatsLock.
+    if (info.use_count() > 1) {
+        info = std::make_shared<WakeLockInfo>(*info);
+    }
+    return *info;
+}
 
-            int64_t statVal = std::stoll(valStr);
-
-            if (statName == "active_count") {
-                info.activeCount = statVal;
-            } else if (statName == "active_time_ms") {
-                info.activeTime = statVal;
-            } else if (statName == "event_count") {
-                info.eventCount = statVal;
-            } else if (statName == "expire_count") {
-                info.expireCount = statVal;
-            } else if (statName == "last_change_ms") {
-                info.lastChange = statVal;
-            } else if (statName == "max_time_ms") {
-                info.maxTime = statVal;
-            } else if (statName == "prevent_suspend_time_ms") {
-                info.preventSuspendTime = statVal;
-            } else if (statName == "total_time_ms") {
-                info.totalTime = statVal;
-            } else if (statName == "wakeup_count") {
-                info.wakeupCount = statVal;
-            }
-        }
+/**
+ * Initializes a native wakelock entry in place, reusing the storage of the entry it replaces.
+ */
+void WakeLockEntryList::initNativeEntry(WakeLockInfo* info, std::string_view name, int pid,
+                                        TimestampType timeNow) {
+    info->name.assign(name);
+    // It only makes sense to create a new entry on initial activation of the lock.
+    info->activeCount = 1;
+    info->lastChange = timeNow;
+    info->maxTime = 0;
+    info->totalTime = 0;
+    info->isActive = true;
+    info->activeTime = 0;
+    info->isKernelWakelock = false;
+
+    info->pid = pid;
+
+    info->eventCount = 0;
+    info->expireCount = 0;
+    info->preventSuspendTime = 0;
+    info->wakeupCount = 0;
+}
+
+WakeLockStatsKey WakeLockEntryList::addKey(const std::string& name, int pid) {
+    const size_t hash = hashKey(name, pid);
+    std::lock_guard<std::mutex> lock(mNamesLock);
+    auto it = mNames.try_emplace(name).first;
+    it->second.refs++;
+    it->second.freeable = false;
+    return {&it->first, pid, hash};
+}
+
+void WakeLockEntryList::removeKey(const WakeLockStatsKey& key) {
+    std::lock_guard<std::mutex> lock(mNamesLock);
+    auto it = mNames.find(*key.name);
+    Name& name = it->second;
+    if (--name.refs == 0 && !name.removed) {
+        name.removed = true;
+        mRemovedNames.push_back(&*it);
     }
+}
 
-    // Derived stats
-    info.isActive = info.activeTime > 0;
+void WakeLockEntryList::updateOnAcquire(const WakeLockStatsKey& key, TimestampType timeNow) {
+    queueEvent({key, timeNow, WakeLockEvent::ACQUIRE});
+}
 
-    return info;
+void WakeLockEntryList::updateOnRelease(const WakeLockStatsKey& key, TimestampType timeNow) {
+    queueEvent({key, timeNow, WakeLockEvent::RELEASE});
 }
 
-void WakeLockEntryList::getKernelWakelockStats(std::vector<WakeLockInfo>* aidl_return) const {
-    std::unique_ptr<DIR, decltype(&closedir)> dp(fdopendir(dup(mKernelWakelockStatsFd.get())),
-                                                 &closedir);
-    if (dp) {
-        // rewinddir, else subsequent calls will not get any kernel wakelocks.
-        rewinddir(dp.get());
+void WakeLockEntryList::updateOnAcquire(const std::vector<WakeLockStatsKey>& keys,
+                                        TimestampType timeNow) {
+    for (const WakeLockStatsKey& key : keys) {
+        queueEvent({key, timeNow, WakeLockEvent::ACQUIRE});
+    }
+}
 
-        struct dirent* de;
-        while ((de = readdir(dp.get()))) {
-            std::string kwlId(de->d_name);
-            if ((kwlId == ".") || (kwlId == "..")) {
-                continue;
-            }
-            WakeLockInfo entry = createKernelEntry(kwlId);
-            aidl_return->emplace_back(std::move(entry));
-        }
+void WakeLockEntryList::updateOnRelease(const std::vector<WakeLockStatsKey>& keys,
+                                        TimestampType timeNow) {
+    for (const WakeLockStatsKey& key : keys) {
+        queueEvent({key, timeNow, WakeLockEvent::RELEASE});
     }
 }
 
 void WakeLockEntryList::updateOnAcquire(const std::string& name, int pid, TimestampType timeNow) {
+    WakeLockStatsKey key = addKey(name, pid);
+    updateOnAcquire(key, timeNow);
+    removeKey(key);
+}
+
+void WakeLockEntryList::updateOnRelease(const std::string& name, int pid, TimestampType timeNow) {
+    WakeLockStatsKey key = addKey(name, pid);
+    updateOnRelease(key, timeNow);
+    removeKey(key);
+}
+
+void WakeLockEntryList::queueEvent(WakeLockEvent event) {
+    event.sequence = mNextEventSequence.fetch_add(1, std::memory_order_relaxed);
+    size_t queue = event.key.hash % kNumEventQueues;
+    if (mEventQueues[queue].push(event)) {
+        return;
+    }
+
+    // The queue is full. Fold in everything queued so far along with the event, so that it isn't
+    // reordered with the earlier events of the same wake lock.
     std::lock_guard<std::mutex> lock(mStatsLock);
+    foldEvents(&event);
+}
+
+void WakeLockEntryList::foldEvents(const WakeLockEvent* unqueuedEvent) {
+    // The events of the names removed so far are all queued by now, and drained below.
+    {
+        std::lock_guard<std::mutex> namesLock(mNamesLock);
+        mFreedNames.swap(mRemovedNames);
+        for (NameEntry* entry : mFreedNames) {
+            // A key may have been made with the name again since it was removed.
+            entry->second.freeable = entry->second.refs == 0;
+        }
+    }
+
+    for (auto& queue : mEventQueues) {
+        queue.drain(&mPendingEvents);
+    }
+    if (unqueuedEvent != nullptr) {
+        mPendingEvents.push_back(*unqueuedEvent);
+    }
+    // Events of different wake locks may be in different queues, restore the order they were
+    // numbered in.
+    std::sort(mPendingEvents.begin(), mPendingEvents.end(),
+              [](const WakeLockEvent& a, const WakeLockEvent& b) {
+                  return a.sequence < b.sequence;
+              });
+    for (const WakeLockEvent& event : mPendingEvents) {
+        foldEvent(event);
+    }
+    mPendingEvents.clear();
 
-    auto key = std::make_pair(name, pid);
-    auto it = mLookupTable.find(key);
-    if (it == mLookupTable.end()) {
-        evictIfFull();
-        WakeLockInfo newEntry = createNativeEntry(name, pid, timeNow);
-        insertEntry(newEntry);
+    if (mFreedNames.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> namesLock(mNamesLock);
+    for (NameEntry* entry : mFreedNames) {
+        Name& name = entry->second;
+        if (name.freeable) {
+            mNames.erase(mNames.find(entry->first));
+        } else if (name.refs == 0) {
+            // A key was made with the name and removed again, its events may not have been
+            // drained yet.
+            mRemovedNames.push_back(entry);
+        } else {
+            name.removed = false;
+        }
+    }
+    mFreedNames.clear();
+}
+
+void WakeLockEntryList::foldEvent(const WakeLockEvent& event) {
+    const WakeLockStatsKey& key = event.key;
+    const std::string& name = *key.name;
+    if (event.kind == WakeLockEvent::ACQUIRE) {
+        acquireEntry(name, key.pid, key.hash, event.timeNow);
     } else {
-        auto staleEntry = it->second;
-        WakeLockInfo updatedEntry = *staleEntry;
+        releaseEntry(name, key.pid, key.hash, event.timeNow);
+    }
+}
+
+void WakeLockEntryList::acquireEntry(std::string_view name, int pid, size_t hash,
+                                     TimestampType timeNow) {
+    uint32_t slot = findEntry(name, pid, hash);
+    if (slot == kNoSlot) {
+        slot = allocateEntry();
+        initNativeEntry(&writableEntry(slot), name, pid, timeNow);
+        mSlots[slot].hash = hash;
+        mSlots[slot].holdTimes.fill(0);
+        indexEntry(slot);
+        linkActive(slot);
+    } else {
+        WakeLockInfo& entry = writableEntry(slot);
+        if (!entry.isActive) {
+            linkActive(slot);
+        }
 
         // Update entry
-        updatedEntry.isActive = true;
-        updatedEntry.activeTime = 0;
-        updatedEntry.activeCount++;
-        updatedEntry.lastChange = timeNow;
+        entry.isActive = true;
+        entry.activeTime = 0;
+        entry.activeCount++;
+        entry.lastChange = timeNow;
 
-        deleteEntry(staleEntry);
-        insertEntry(std::move(updatedEntry));
+        unlink(slot);
     }
+    linkFront(slot);
+    mSlots[slot].generation = mSlots[slot].frontGeneration = nextGeneration();
+    rankEntry(slot);
 }
 
-void WakeLockEntryList::updateOnRelease(const std::string& name, int pid, TimestampType timeNow) {
-    std::lock_guard<std::mutex> lock(mStatsLock);
-
-    auto key = std::make_pair(name, pid);
-    auto it = mLookupTable.find(key);
-    if (it == mLookupTable.end()) {
+void WakeLockEntryList::releaseEntry(std::string_view name, int pid, size_t hash,
+                                     TimestampType timeNow) {
+    uint32_t slot = findEntry(name, pid, hash);
+    if (slot == kNoSlot) {
         LOG(INFO) << "WakeLock Stats: A stats entry for, \"" << name
                   << "\" was not found. This is most likely due to it being evicted.";
     } else {
-        auto staleEntry = it->second;
-        WakeLockInfo updatedEntry = *staleEntry;
+        WakeLockInfo& entry = writableEntry(slot);
+        TimestampType timeDelta = timeNow - entry.lastChange;
+        if (entry.isActive) {
+            unlinkActive(slot);
+            mSlots[slot].holdTimes[getHoldTimeBucket(entry.activeTime + timeDelta)]++;
+        }
 
         // Update entry
-        TimestampType timeDelta = timeNow - updatedEntry.lastChange;
-        updatedEntry.isActive = false;
-        updatedEntry.activeTime += timeDelta;
-        updatedEntry.maxTime = std::max(updatedEntry.maxTime, updatedEntry.activeTime);
-        updatedEntry.activeTime = 0;  // No longer active
-        updatedEntry.totalTime += timeDelta;
-        updatedEntry.lastChange = timeNow;
-
-        deleteEntry(staleEntry);
-        insertEntry(std::move(updatedEntry));
+        entry.isActive = false;
+        entry.activeTime += timeDelta;
+        entry.maxTime = std::max(entry.maxTime, entry.activeTime);
+        entry.activeTime = 0;  // No longer active
+        entry.totalTime += timeDelta;
+        entry.lastChange = timeNow;
+
+        unlink(slot);
+        linkFront(slot);
+        mSlots[slot].generation = mSlots[slot].frontGeneration = nextGeneration();
+        rankEntry(slot);
     }
 }
+
 /**
  * Updates the native wakelock stats based on the current time.
  */
 void WakeLockEntryList::updateNow() {
     std::lock_guard<std::mutex> lock(mStatsLock);
+    foldEvents();
 
     TimestampType timeNow = getTimeNow();
+    const uint64_t generation = mActive != kNoSlot ? nextGeneration() : 0;
+
+    for (uint32_t slot = mActive; slot != kNoSlot; slot = mSlots[slot].activeNext) {
+        mSlots[slot].generation = generation;
+        WakeLockInfo& entry = writableEntry(slot);
+        TimestampType timeDelta = timeNow - entry.lastChange;
+        entry.activeTime += timeDelta;
+        entry.maxTime = std::max(entry.maxTime, entry.activeTime);
+        entry.totalTime += timeDelta;
+        entry.lastChange = timeNow;
+        rankEntry(slot);
+    }
+}
+
+void WakeLockEntryList::getWakeLockStats(std::vector<WakeLockInfo>* aidl_return) {
+    getWakeLockStats(std::chrono::milliseconds::zero(), aidl_return);
+}
+
+void WakeLockEntryList::getWakeLockStats(std::chrono::milliseconds maxKernelStatsAge,
+                                         std::vector<WakeLockInfo>* aidl_return) {
+    // Only references to the current version of each entry are taken under the lock; the entries
+    // themselves, names included, are copied after releasing it.
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        foldEvents();
+        snapshot.reserve(mNumEntries);
+        for (uint32_t slot = mMru; slot != kNoSlot; slot = mSlots[slot].next) {
+            snapshot.push_back(mSlots[slot].info);
+        }
+    }
+    copyEntries(&snapshot, aidl_return);
+    // Under no circumstances should the lock be held while getting kernel wakelock stats
+    mKernelWakelockStats.getStats(maxKernelStatsAge, aidl_return);
+}
+
+/**
+ * Appends copies of entries to aidl_return and drops them.
+ */
+void WakeLockEntryList::copyEntries(std::vector<std::shared_ptr<const WakeLockInfo>>* entries,
+                                    std::vector<WakeLockInfo>* aidl_return) {
+    aidl_return->reserve(aidl_return->size() + entries->size());
+    for (const auto& entry : *entries) {
+        aidl_return->push_back(*entry);
+    }
+    dropEntries(entries);
+}
+
+void WakeLockEntryList::dropEntries(
+    std::vector<std::shared_ptr<const WakeLockInfo>>* entries) {
+    // Writers check under the lock whether an entry is shared, drop the references under it too
+    // so that the reads of the entries happen before they are modified in place.
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    entries->clear();
+}
+
+/**
+ * Writes the wakelock stats table to fd. The entries are rendered in place rather than copied
+ * out, through a fixed buffer, so that dumping takes the same memory however many there are.
+ */
+void WakeLockEntryList::dump(int fd) {
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        foldEvents();
+        snapshot.reserve(mNumEntries);
+        for (uint32_t slot = mMru; slot != kNoSlot; slot = mSlots[slot].next) {
+            snapshot.push_back(mSlots[slot].info);
+        }
+    }
+    // Dumps can make do with the kernel wakelock stats refreshed in the background.
+    std::shared_ptr<const std::vector<WakeLockInfo>> kernelStats =
+        mKernelWakelockStats.getStatsSnapshot(mKernelWakelockStats.getRefreshInterval());
+
+    std::string div(kDumpWidth + 2, '-');
+    div[0] = div[1] = ' ';
+    div.back() = '\n';
+
+    DumpWriter writer(fd);
+    dumpHeader(&writer, div);
+    for (const auto& entry : snapshot) {
+        dumpEntry(&writer, *entry);
+    }
+    for (const WakeLockInfo& entry : *kernelStats) {
+        dumpEntry(&writer, entry);
+    }
+    writer.writeRef(div);
+    writer.flush();
+
+    dropEntries(&snapshot);
+}
 
-    for (std::list<WakeLockInfo>::iterator it = mStats.begin(); it != mStats.end(); ++it) {
-        if (it->isActive) {
-            TimestampType timeDelta = timeNow - it->lastChange;
-            it->activeTime += timeDelta;
-            it->maxTime = std::max(it->maxTime, it->activeTime);
-            it->totalTime += timeDelta;
-            it->lastChange = timeNow;
+void WakeLockEntryList::snapshotHoldTimes(
+    std::vector<std::shared_ptr<const WakeLockInfo>>* entries,
+    std::vector<HoldTimeHistogram>* histograms) {
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    foldEvents();
+    entries->reserve(mNumEntries);
+    histograms->reserve(mNumEntries);
+    for (uint32_t slot = mMru; slot != kNoSlot; slot = mSlots[slot].next) {
+        entries->push_back(mSlots[slot].info);
+        histograms->push_back(mSlots[slot].holdTimes);
+    }
+}
+
+void WakeLockEntryList::getWakeLockHoldTimes(std::vector<WakeLockHoldTimes>* aidl_return) {
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
+    std::vector<HoldTimeHistogram> histograms;
+    snapshotHoldTimes(&snapshot, &histograms);
+
+    aidl_return->reserve(aidl_return->size() + snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        WakeLockHoldTimes& holdTimes = aidl_return->emplace_back();
+        holdTimes.name = snapshot[i]->name;
+        holdTimes.pid = snapshot[i]->pid;
+        holdTimes.counts.assign(histograms[i].begin(), histograms[i].end());
+    }
+    dropEntries(&snapshot);
+}
+
+/**
+ * Writes a row for each native wake lock with the hold time buckets it has releases in, labeled
+ * with the range of hold times they count.
+ */
+void WakeLockEntryList::dumpHoldTimes(int fd) {
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
+    std::vector<HoldTimeHistogram> histograms;
+    snapshotHoldTimes(&snapshot, &histograms);
+
+    DumpWriter writer(fd);
+    writer.write("WAKELOCK HOLD TIMES\n");
+    for (size_t i = 0; i < snapshot.size(); i++) {
+        writer.write(kSep);
+        writer.writeLeft(snapshot[i]->name, kNameWidth);
+        writer.write(kSep);
+        writer.writeRight(snapshot[i]->pid, "", kPidWidth);
+        writer.write(kSep);
+        std::string_view separator = "";
+        for (size_t bucket = 0; bucket < kNumHoldTimeBuckets; bucket++) {
+            if (histograms[i][bucket] == 0) {
+                continue;
+            }
+            writer.write(separator);
+            separator = ", ";
+            if (bucket == kNumHoldTimeBuckets - 1) {
+                writer.write(">=");
+                writer.writeRight(getHoldTimeBucketStart(bucket), "ms: ", 0);
+            } else {
+                writer.writeRight(getHoldTimeBucketStart(bucket), "-", 0);
+                writer.writeRight(getHoldTimeBucketStart(bucket + 1), "ms: ", 0);
+            }
+            writer.writeRight(histograms[i][bucket], "", 0);
         }
+        writer.write("\n");
     }
+    writer.flush();
+
+    dropEntries(&snapshot);
+}
+
+void WakeLockEntryList::getWakeLockStatsDelta(int64_t sinceGeneration,
+                                              WakeLockStatsDelta* delta) {
+    getWakeLockStatsDelta(std::chrono::milliseconds::zero(), sinceGeneration, delta);
 }
 
-void WakeLockEntryList::getWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const {
+void WakeLockEntryList::getWakeLockStatsDelta(std::chrono::milliseconds maxKernelStatsAge,
+                                              int64_t sinceGeneration, WakeLockStatsDelta* delta) {
+    const uint64_t since = static_cast<uint64_t>(sinceGeneration);
+    delta->changed.clear();
+    delta->removed.clear();
+
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        foldEvents();
+        // Changes stamped up to this generation are visible to the reads below. Later ones may
+        // also be, and will then be reported again by the next call.
+        const uint64_t generation = mGeneration.load();
+        delta->generation = static_cast<int64_t>(generation);
+        delta->full = sinceGeneration <= 0 || since > generation || since < mForgottenGeneration;
+        if (delta->full) {
+            snapshot.reserve(mNumEntries);
+            for (uint32_t slot = mMru; slot != kNoSlot; slot = mSlots[slot].next) {
+                snapshot.push_back(mSlots[slot].info);
+            }
+        } else {
+            // The MRU end of the list holds the entries acquired or released since, the others
+            // only change while active.
+            uint32_t slot = mMru;
+            for (; slot != kNoSlot && mSlots[slot].frontGeneration > since;
+                 slot = mSlots[slot].next) {
+                snapshot.push_back(mSlots[slot].info);
+            }
+            for (slot = mActive; slot != kNoSlot; slot = mSlots[slot].activeNext) {
+                if (mSlots[slot].generation > since && mSlots[slot].frontGeneration <= since) {
+                    snapshot.push_back(mSlots[slot].info);
+                }
+            }
+            for (const Eviction& eviction : mEvictions) {
+                if (eviction.generation > since) {
+                    WakeLockInfo& info = delta->removed.emplace_back();
+                    info.name = eviction.name;
+                    info.pid = eviction.pid;
+                }
+            }
+        }
+    }
+    copyEntries(&snapshot, &delta->changed);
+
     // Under no circumstances should the lock be held while getting kernel wakelock stats
+    if (delta->full) {
+        mKernelWakelockStats.getStats(maxKernelStatsAge, &delta->changed);
+    } else if (!mKernelWakelockStats.getStatsDelta(maxKernelStatsAge, since, &delta->changed,
+                                                   &delta->removed)) {
+        // The kernel wakelocks removed since were forgotten, start over.
+        getWakeLockStatsDelta(maxKernelStatsAge, 0, delta);
+    }
+}
+
+void WakeLockEntryList::getTopWakeLockStats(WakeLockMetric metric, size_t k,
+                                            std::chrono::milliseconds maxKernelStatsAge,
+                                            std::vector<WakeLockInfo>* aidl_return) {
+    k = std::min(k, kMaxTopWakeLocks);
+    std::vector<std::shared_ptr<const WakeLockInfo>> snapshot;
     {
         std::lock_guard<std::mutex> lock(mStatsLock);
-        for (const WakeLockInfo& entry : mStats) {
-            aidl_return->emplace_back(entry);
+        foldEvents();
+        WakeLockRanking& ranking = mRankings[static_cast<size_t>(metric)];
+        if (ranking.isStale()) {
+            std::vector<WakeLockRanking::Entry> entries(mNumEntries);
+            for (uint32_t slot = 0; slot < mNumEntries; slot++) {
+                entries[slot] = {getWakeLockMetric(*mSlots[slot].info, metric), slot};
+            }
+            ranking.rebuild(std::move(entries));
+        }
+        for (const WakeLockRanking::Entry& entry : ranking.getTop()) {
+            if (snapshot.size() == k) {
+                break;
+            }
+            snapshot.push_back(mSlots[entry.id].info);
         }
     }
-    getKernelWakelockStats(aidl_return);
+    std::vector<WakeLockInfo> nativeStats;
+    copyEntries(&snapshot, &nativeStats);
+    std::vector<WakeLockInfo> kernelStats;
+    // Under no circumstances should the lock be held while getting kernel wakelock stats
+    mKernelWakelockStats.getTopStats(maxKernelStatsAge, metric, k, &kernelStats);
+
+    // Both are in descending order, merge their first k.
+    size_t i = 0;
+    size_t j = 0;
+    while (i + j < k && (i < nativeStats.size() || j < kernelStats.size())) {
+        bool takeNative = j == kernelStats.size() ||
+                          (i < nativeStats.size() && getWakeLockMetric(nativeStats[i], metric) >=
+                                                         getWakeLockMetric(kernelStats[j], metric));
+        aidl_return->push_back(std::move(takeNative ? nativeStats[i++] : kernelStats[j++]));
+    }
+}
+
+void WakeLockEntryList::pauseKernelStatsRefresh() {
+    mKernelWakelockStats.pause();
+}
+
+void WakeLockEntryList::resumeKernelStatsRefresh() {
+    mKernelWakelockStats.resume();
 }
 
 }  // namespace V1_0
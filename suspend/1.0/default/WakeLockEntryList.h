@@ -18,16 +18,30 @@
 #define ANDROID_SYSTEM_SUSPEND_WAKE_LOCK_ENTRY_LIST_H
 
 #include <android-base/unique_fd.h>
+#include <android/system/suspend/internal/WakeLockHoldTimes.h>
 #include <android/system/suspend/internal/WakeLockInfo.h>
+#include <android/system/suspend/internal/WakeLockStatsDelta.h>
 #include <utils/Mutex.h>
 
-#include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "KernelWakelockStatsCache.h"
+#include "WakeLockEventQueue.h"
+#include "WakeLockRanking.h"
+
+using ::android::system::suspend::internal::WakeLockHoldTimes;
 using ::android::system::suspend::internal::WakeLockInfo;
+using ::android::system::suspend::internal::WakeLockStatsDelta;
 
 namespace android {
 namespace system {
@@ -39,47 +53,187 @@ using TimestampType = int64_t;
 
 TimestampType getTimeNow();
 
+// Number of releases of a native wake lock by hold time, in buckets of doubling width. Bucket 0
+// counts holds under 1ms, bucket i holds of [2^(i-1), 2^i) ms, and the last bucket all the longer
+// holds too, so that holds of up to about 70 minutes are told apart. Each stats entry has one, for
+// 96 bytes per entry, or 94 KiB at the capacity of 1000 entries the service runs with.
+constexpr size_t kNumHoldTimeBuckets = 24;
+using HoldTimeHistogram = std::array<uint32_t, kNumHoldTimeBuckets>;
+
+// Returns the HoldTimeHistogram bucket counting holds of holdTime ms.
+size_t getHoldTimeBucket(TimestampType holdTime);
+
 /*
  * WakeLockEntryList to collect wake lock stats.
+ *
+ * Acquires and releases only queue an event, without taking mStatsLock. Queued events are folded
+ * into the stats before they are read, so reads are up to date, which makes reads modify the list.
+ * Events are spread over several queues to reduce contention, and numbered as they're queued so
+ * that each fold can restore their order. An event is numbered before it is pushed, so it may
+ * still miss a fold that gets an event numbered after it, and the LRU order of different wake
+ * locks is only approximate. Events identify wake locks by a WakeLockStatsKey, made when the wake
+ * lock is created, so that queueing them doesn't allocate.
+ *
+ * Every change to the stats is stamped with a generation, from a counter shared with the kernel
+ * wakelock stats, so that readers can ask for the stats changed since a generation.
  * This class is thread safe.
  */
 class WakeLockEntryList {
    public:
-    WakeLockEntryList(size_t capacity, unique_fd kernelWakelockStatsFd);
+    WakeLockEntryList(
+        size_t capacity, unique_fd kernelWakelockStatsFd,
+        std::chrono::milliseconds kernelStatsRefreshInterval = std::chrono::milliseconds::zero());
+    // Hash of the stats key of a wake lock.
+    static size_t hashKey(std::string_view name, int pid);
+    // Makes the stats key of a wake lock, interning its name. Must be matched by a call to
+    // removeKey() once the wake lock has been released.
+    WakeLockStatsKey addKey(const std::string& name, int pid);
+    void removeKey(const WakeLockStatsKey& key);
+    void updateOnAcquire(const WakeLockStatsKey& key, TimestampType timeNow);
+    void updateOnRelease(const WakeLockStatsKey& key, TimestampType timeNow);
+    // Same as above for a batch of wake locks.
+    void updateOnAcquire(const std::vector<WakeLockStatsKey>& keys, TimestampType timeNow);
+    void updateOnRelease(const std::vector<WakeLockStatsKey>& keys, TimestampType timeNow);
+    // Same as above for a wake lock without a key, which is added for the update only.
     void updateOnAcquire(const std::string& name, int pid, TimestampType timeNow);
     void updateOnRelease(const std::string& name, int pid, TimestampType timeNow);
     // updateNow() should be called before getWakeLockStats() to ensure stats are
     // updated wrt the current time.
     void updateNow();
-    void getWakeLockStats(std::vector<WakeLockInfo>* aidl_return) const;
-    friend std::ostream& operator<<(std::ostream& out, const WakeLockEntryList& list);
+    void getWakeLockStats(std::vector<WakeLockInfo>* aidl_return);
+    // Same as above, with kernel wakelock stats read up to maxKernelStatsAge ago.
+    void getWakeLockStats(std::chrono::milliseconds maxKernelStatsAge,
+                          std::vector<WakeLockInfo>* aidl_return);
+    // Returns the stats that changed after sinceGeneration, or all of them if sinceGeneration is 0,
+    // unknown or older than the evictions remembered.
+    void getWakeLockStatsDelta(int64_t sinceGeneration, WakeLockStatsDelta* delta);
+    // Same as above, with kernel wakelock stats read up to maxKernelStatsAge ago.
+    void getWakeLockStatsDelta(std::chrono::milliseconds maxKernelStatsAge, int64_t sinceGeneration,
+                               WakeLockStatsDelta* delta);
+    // Appends the stats of the up to k wake locks, native and kernel, with the largest value of
+    // metric, in descending order. k is at most kMaxTopWakeLocks.
+    void getTopWakeLockStats(WakeLockMetric metric, size_t k,
+                             std::chrono::milliseconds maxKernelStatsAge,
+                             std::vector<WakeLockInfo>* aidl_return);
+    // Returns the hold time histograms of the native wake locks, most recently used first.
+    void getWakeLockHoldTimes(std::vector<WakeLockHoldTimes>* aidl_return);
+    // Called before and after the device suspends, see KernelWakelockStatsCache.
+    void pauseKernelStatsRefresh();
+    void resumeKernelStatsRefresh();
+    // Writes the stats as a table, for dumpsys.
+    void dump(int fd);
+    // Writes the hold time histograms of the native wake locks, for dumpsys.
+    void dumpHoldTimes(int fd);
 
    private:
-    void evictIfFull() REQUIRES(mStatsLock);
-    void insertEntry(WakeLockInfo entry) REQUIRES(mStatsLock);
-    void deleteEntry(std::list<WakeLockInfo>::iterator entry) REQUIRES(mStatsLock);
-    WakeLockInfo createNativeEntry(const std::string& name, int pid, TimestampType timeNow) const;
-    WakeLockInfo createKernelEntry(const std::string& name) const;
-    void getKernelWakelockStats(std::vector<WakeLockInfo>* aidl_return) const;
-
-    // Hash for WakeLockEntry key (pair<std::string, int>)
-    struct LockHash {
-        std::size_t operator()(const std::pair<std::string, int>& key) const {
-            return std::hash<std::string>()(key.first) ^ std::hash<int>()(key.second);
-        }
+    void queueEvent(WakeLockEvent event);
+    void foldEvents(const WakeLockEvent* unqueuedEvent = nullptr) REQUIRES(mStatsLock);
+    void foldEvent(const WakeLockEvent& event) REQUIRES(mStatsLock);
+    void acquireEntry(std::string_view name, int pid, size_t hash, TimestampType timeNow)
+        REQUIRES(mStatsLock);
+    void releaseEntry(std::string_view name, int pid, size_t hash, TimestampType timeNow)
+        REQUIRES(mStatsLock);
+    uint32_t findEntry(std::string_view name, int pid, size_t hash) const REQUIRES(mStatsLock);
+    uint32_t allocateEntry() REQUIRES(mStatsLock);
+    void indexEntry(uint32_t slot) REQUIRES(mStatsLock);
+    void unindexEntry(uint32_t slot) REQUIRES(mStatsLock);
+    void linkFront(uint32_t slot) REQUIRES(mStatsLock);
+    void unlink(uint32_t slot) REQUIRES(mStatsLock);
+    void linkActive(uint32_t slot) REQUIRES(mStatsLock);
+    void unlinkActive(uint32_t slot) REQUIRES(mStatsLock);
+    WakeLockInfo& writableEntry(uint32_t slot) REQUIRES(mStatsLock);
+    void recordEviction(uint32_t slot) REQUIRES(mStatsLock);
+    void rankEntry(uint32_t slot) REQUIRES(mStatsLock);
+    uint64_t nextGeneration();
+    void copyEntries(std::vector<std::shared_ptr<const WakeLockInfo>>* entries,
+                     std::vector<WakeLockInfo>* aidl_return);
+    void dropEntries(std::vector<std::shared_ptr<const WakeLockInfo>>* entries);
+    void snapshotHoldTimes(std::vector<std::shared_ptr<const WakeLockInfo>>* entries,
+                           std::vector<HoldTimeHistogram>* histograms);
+    static void initNativeEntry(WakeLockInfo* info, std::string_view name, int pid,
+                                TimestampType timeNow);
+
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    // A stats entry, linked into the LRU list and, while active, into the active list by slot
+    // index.
+    struct Slot {
+        std::shared_ptr<WakeLockInfo> info;
+        size_t hash = 0;
+        uint32_t prev = kNoSlot;
+        uint32_t next = kNoSlot;
+        uint32_t activePrev = kNoSlot;
+        uint32_t activeNext = kNoSlot;
+        // Generations at which the entry last changed and was last moved to the MRU end.
+        uint64_t generation = 0;
+        uint64_t frontGeneration = 0;
+        HoldTimeHistogram holdTimes{};
     };
 
+    struct Eviction {
+        std::string name;
+        int pid = 0;
+        uint64_t generation = 0;
+    };
+
+    struct Name {
+        // Number of keys made with the name and not removed yet.
+        uint32_t refs = 0;
+        // Whether the name is in mRemovedNames or mFreedNames.
+        bool removed = false;
+        // Set by foldEvents() for the names it frees that have no keys, cleared if a key is made
+        // with the name meanwhile.
+        bool freeable = false;
+    };
+    using NameEntry = std::pair<const std::string, Name>;
+
     size_t mCapacity;
-    unique_fd mKernelWakelockStatsFd;
+    // Last generation handed out, here or by mKernelWakelockStats.
+    std::atomic<uint64_t> mGeneration{0};
+    KernelWakelockStatsCache mKernelWakelockStats;
+
+    static constexpr size_t kNumEventQueues = 8;
+
+    std::mutex mStatsLock;
+
+    // Drained by readers while holding mStatsLock.
+    std::array<WakeLockEventQueue, kNumEventQueues> mEventQueues;
+    std::atomic<uint64_t> mNextEventSequence{0};
+    // Reused by foldEvents() so that steady-state folding doesn't allocate.
+    std::vector<WakeLockEvent> mPendingEvents GUARDED_BY(mStatsLock);
 
-    mutable std::mutex mStatsLock;
+    // Names of the keys, which point to them. The nodes of the map don't move, so foldEvents()
+    // reads the names of the events it folds without mNamesLock. The name of a removed key may
+    // still be used by its queued events, so a name is only erased by the first foldEvents() after
+    // its last key is removed. Taken after mStatsLock, and only briefly by foldEvents().
+    std::mutex mNamesLock;
+    std::unordered_map<std::string, Name> mNames GUARDED_BY(mNamesLock);
+    // Names whose last key was removed, to erase once their events are folded.
+    std::vector<NameEntry*> mRemovedNames GUARDED_BY(mNamesLock);
+    // Names being freed by foldEvents(), taken from mRemovedNames before draining the queues.
+    std::vector<NameEntry*> mFreedNames GUARDED_BY(mStatsLock);
 
-    // std::list and std::unordered map are used to support both inserting a stat
-    // and eviction of the LRU stat in O(1) time. The LRU stat is maintained at
-    // the back of the list.
-    std::list<WakeLockInfo> mStats GUARDED_BY(mStatsLock);
-    std::unordered_map<std::pair<std::string, int>, std::list<WakeLockInfo>::iterator, LockHash>
-        mLookupTable GUARDED_BY(mStatsLock);
+    // The stats are stored in mCapacity slots allocated upfront, so that updating, inserting and
+    // evicting a stat don't allocate. Slots in use form a doubly linked list from the MRU stat to
+    // the LRU stat, and are looked up through mIndex, a linear probing hash table of slot indices
+    // kept at most half full.
+    // Entries are refcounted so that getWakeLockStats() can copy them without holding mStatsLock.
+    // An entry still held by a reader is copied before being modified.
+    std::vector<Slot> mSlots GUARDED_BY(mStatsLock);
+    std::vector<uint32_t> mIndex GUARDED_BY(mStatsLock);
+    uint32_t mNumEntries GUARDED_BY(mStatsLock) = 0;
+    uint32_t mMru GUARDED_BY(mStatsLock) = kNoSlot;
+    uint32_t mLru GUARDED_BY(mStatsLock) = kNoSlot;
+    // Head of the unordered list of active stats, the only ones updateNow() needs to update.
+    uint32_t mActive GUARDED_BY(mStatsLock) = kNoSlot;
+    bool mEvicted GUARDED_BY(mStatsLock) = false;
+    // Ring buffer of the mCapacity most recent evictions, for getWakeLockStatsDelta().
+    std::vector<Eviction> mEvictions GUARDED_BY(mStatsLock);
+    size_t mNextEviction GUARDED_BY(mStatsLock) = 0;
+    // Latest generation of the evictions overwritten in mEvictions.
+    uint64_t mForgottenGeneration GUARDED_BY(mStatsLock) = 0;
+    // Top stats by each WakeLockMetric, kept up to date as the stats change.
+    std::array<WakeLockRanking, kNumWakeLockMetrics> mRankings GUARDED_BY(mStatsLock);
 };
 
 }  // namespace V1_0
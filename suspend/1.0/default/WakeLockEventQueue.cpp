@@ -0,0 +1,72 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockEventQueue.h"
+
+#include <sched.h>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+WakeLockEventQueue::WakeLockEventQueue() {
+    for (size_t i = 0; i < kCapacity; i++) {
+        mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+// Bounded queue from Dmitry Vyukov: a producer reserves a cell by advancing mEnqueuePos, then
+// publishes the event by bumping the cell sequence.
+bool WakeLockEventQueue::push(const WakeLockEvent& event) {
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &mCells[pos & (kCapacity - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->event = event;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void WakeLockEventQueue::drain(std::vector<WakeLockEvent>* events) {
+    const size_t end = mEnqueuePos.load(std::memory_order_acquire);
+    for (; mDequeuePos != end; mDequeuePos++) {
+        Cell& cell = mCells[mDequeuePos & (kCapacity - 1)];
+        // The cell was reserved before end was read, its producer is about to publish it.
+        while (cell.sequence.load(std::memory_order_acquire) != mDequeuePos + 1) {
+            sched_yield();
+        }
+        events->push_back(cell.event);
+        cell.sequence.store(mDequeuePos + kCapacity, std::memory_order_release);
+    }
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
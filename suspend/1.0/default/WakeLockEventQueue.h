@@ -0,0 +1,89 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using TimestampType = int64_t;
+
+// Stats key of a wake lock, made once by WakeLockEntryList::addKey() when the wake lock is
+// created, so that queueing its events doesn't copy its name.
+struct WakeLockStatsKey {
+    // Name interned by WakeLockEntryList, valid until the events of the key are folded.
+    const std::string* name = nullptr;
+    int pid = 0;
+    // WakeLockEntryList::hashKey() of the name and pid.
+    size_t hash = 0;
+};
+
+struct WakeLockEvent {
+    enum Kind : uint8_t {
+        ACQUIRE,
+        RELEASE,
+    };
+
+    WakeLockStatsKey key;
+    TimestampType timeNow = 0;
+    Kind kind = ACQUIRE;
+    // Order in which the event was queued, across all queues.
+    uint64_t sequence = 0;
+};
+
+/*
+ * WakeLockEventQueue is a bounded lock-free queue of wake lock events, with any number of
+ * producers and a single consumer at a time. Events are popped in the order their producers
+ * reserved a slot for them.
+ */
+class WakeLockEventQueue {
+   public:
+    static constexpr size_t kCapacity = 256;
+
+    WakeLockEventQueue();
+    // Returns false if the queue is full.
+    bool push(const WakeLockEvent& event);
+    // Appends every event pushed before the call to events, waiting for the ones whose push is
+    // in progress. Must not be called concurrently with itself.
+    void drain(std::vector<WakeLockEvent>* events);
+
+   private:
+    struct Cell {
+        // Position at which the cell can next be pushed to, plus one once the event is published.
+        std::atomic<size_t> sequence;
+        WakeLockEvent event;
+    };
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two");
+
+    std::array<Cell, kCapacity> mCells;
+    alignas(64) std::atomic<size_t> mEnqueuePos{0};
+    // Only used by the consumer.
+    alignas(64) size_t mDequeuePos = 0;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
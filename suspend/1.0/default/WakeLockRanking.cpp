@@ -0,0 +1,123 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockRanking.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+int64_t getWakeLockMetric(const WakeLockInfo& info, WakeLockMetric metric) {
+    switch (metric) {
+        case WakeLockMetric::TOTAL_TIME:
+            return info.totalTime;
+        case WakeLockMetric::ACTIVE_COUNT:
+            return info.activeCount;
+        case WakeLockMetric::MAX_TIME:
+            return info.maxTime;
+    }
+    return 0;
+}
+
+std::vector<uint32_t> selectTopWakeLocks(const std::vector<WakeLockInfo>& infos,
+                                         WakeLockMetric metric, size_t k) {
+    std::vector<uint32_t> indices(infos.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    k = std::min(k, indices.size());
+    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(),
+                      [&](uint32_t a, uint32_t b) {
+                          return getWakeLockMetric(infos[a], metric) >
+                                 getWakeLockMetric(infos[b], metric);
+                      });
+    indices.resize(k);
+    return indices;
+}
+
+WakeLockRanking::WakeLockRanking(size_t capacity) : mRanks(capacity, kNotRanked) {
+    mTop.reserve(kMaxTopWakeLocks);
+}
+
+void WakeLockRanking::update(uint32_t id, int64_t value) {
+    if (mStale) {
+        return;
+    }
+    uint32_t rank = mRanks[id];
+    if (rank != kNotRanked) {
+        mTop[rank].value = value;
+    } else if (mTop.size() < kMaxTopWakeLocks) {
+        // All of the entries are ranked until the ranking is full.
+        rank = mTop.size();
+        mTop.push_back({value, id});
+        mRanks[id] = rank;
+    } else if (value > mTop.back().value) {
+        rank = mTop.size() - 1;
+        mRanks[mTop[rank].id] = kNotRanked;
+        mTop[rank] = {value, id};
+        mRanks[id] = rank;
+    } else {
+        return;
+    }
+    moveUp(rank);
+}
+
+void WakeLockRanking::moveUp(uint32_t rank) {
+    while (rank > 0 && mTop[rank].value > mTop[rank - 1].value) {
+        std::swap(mTop[rank], mTop[rank - 1]);
+        mRanks[mTop[rank].id] = rank;
+        rank--;
+    }
+    mRanks[mTop[rank].id] = rank;
+}
+
+void WakeLockRanking::remove(uint32_t id) {
+    uint32_t rank = mRanks[id];
+    if (rank == kNotRanked) {
+        return;
+    }
+    // Unranked entries might belong in the gap.
+    if (mTop.size() == kMaxTopWakeLocks) {
+        mStale = true;
+    }
+    mTop.erase(mTop.begin() + rank);
+    mRanks[id] = kNotRanked;
+    for (uint32_t i = rank; i < mTop.size(); i++) {
+        mRanks[mTop[i].id] = i;
+    }
+}
+
+void WakeLockRanking::rebuild(std::vector<Entry> entries) {
+    for (const Entry& entry : mTop) {
+        mRanks[entry.id] = kNotRanked;
+    }
+    size_t size = std::min(entries.size(), kMaxTopWakeLocks);
+    std::partial_sort(entries.begin(), entries.begin() + size, entries.end(),
+                      [](const Entry& a, const Entry& b) { return a.value > b.value; });
+    mTop.assign(entries.begin(), entries.begin() + size);
+    for (uint32_t i = 0; i < mTop.size(); i++) {
+        mRanks[mTop[i].id] = i;
+    }
+    mStale = false;
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/system/suspend/internal/WakeLockInfo.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+using ::android::system::suspend::internal::WakeLockInfo;
+
+// Stats wake locks can be ranked by, as in ISuspendControlServiceInternal.
+enum class WakeLockMetric : int32_t {
+    TOTAL_TIME = 0,
+    ACTIVE_COUNT = 1,
+    MAX_TIME = 2,
+};
+
+constexpr size_t kNumWakeLockMetrics = 3;
+// Most wake locks returned by a top wake locks query.
+constexpr size_t kMaxTopWakeLocks = 64;
+
+int64_t getWakeLockMetric(const WakeLockInfo& info, WakeLockMetric metric);
+
+// Returns the indices in infos of the up to k entries with the largest value of metric, in
+// descending order.
+std::vector<uint32_t> selectTopWakeLocks(const std::vector<WakeLockInfo>& infos,
+                                         WakeLockMetric metric, size_t k);
+
+/*
+ * WakeLockRanking keeps the ids of the kMaxTopWakeLocks entries with the largest value of a metric,
+ * in descending order, as the values change. Ids are below the capacity passed in.
+ *
+ * The values of the entries must only grow. An entry can then only enter the ranking by growing
+ * past the last ranked value, and only move up within it, so that each update takes a comparison
+ * unless the entry is ranked. Removing a ranked entry from a full ranking leaves a gap that only a
+ * rebuild from all of the entries can fill; the ranking is marked stale until then.
+ * This class is not thread safe.
+ */
+class WakeLockRanking {
+   public:
+    struct Entry {
+        int64_t value;
+        uint32_t id;
+    };
+
+    explicit WakeLockRanking(size_t capacity);
+
+    // Called when the entry id is added or its value grows.
+    void update(uint32_t id, int64_t value);
+    void remove(uint32_t id);
+    bool isStale() const { return mStale; }
+    // Ranks entries again from scratch.
+    void rebuild(std::vector<Entry> entries);
+    const std::vector<Entry>& getTop() const { return mTop; }
+
+   private:
+    void moveUp(uint32_t rank);
+
+    static constexpr uint32_t kNotRanked = UINT32_MAX;
+
+    std::vector<Entry> mTop;
+    // Position of each id in mTop.
+    std::vector<uint32_t> mRanks;
+    bool mStale = false;
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockTokenTable.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+// Generations are kept positive and non-zero so that tokens are too.
+static constexpr uint32_t kMaxGeneration = 0x7fffffff;
+
+static int64_t makeToken(uint32_t index, uint32_t generation) {
+    return static_cast<int64_t>(generation) << 32 | index;
+}
+
+status_t WakeLockTokenTable::acquire(const sp<IBinder>& client,
+                                     const sp<IBinder::DeathRecipient>& recipient, Entry entry,
+                                     int64_t* token) {
+    std::scoped_lock lock(mLock);
+
+    // Only remote binders can be linked to death
+    if (mClients.count(client.get()) == 0 && client->remoteBinder() != nullptr) {
+        status_t status = client->linkToDeath(recipient);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+
+    uint32_t index;
+    if (mFreeSlots.empty()) {
+        index = mSlots.size();
+        mSlots.push_back({.generation = 1});
+    } else {
+        index = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    Slot& slot = mSlots[index];
+    slot.entry = std::move(entry);
+    slot.client = client.get();
+
+    Client& owner = mClients[client.get()];
+    owner.binder = client;
+    owner.numWakeLocks++;
+    *token = makeToken(index, slot.generation);
+    return NO_ERROR;
+}
+
+status_t WakeLockTokenTable::release(int64_t token, uid_t uid,
+                                     const sp<IBinder::DeathRecipient>& recipient, Entry* entry) {
+    std::scoped_lock lock(mLock);
+
+    uint32_t index = static_cast<uint32_t>(token);
+    if (token < 0 || index >= mSlots.size()) {
+        return BAD_VALUE;
+    }
+    Slot& slot = mSlots[index];
+    if (slot.client == nullptr || makeToken(index, slot.generation) != token) {
+        return BAD_VALUE;
+    }
+    if (slot.entry.uid != uid) {
+        return PERMISSION_DENIED;
+    }
+
+    auto client = mClients.find(slot.client);
+    if (--client->second.numWakeLocks == 0) {
+        const sp<IBinder>& binder = client->second.binder;
+        if (binder->remoteBinder() != nullptr) {
+            binder->unlinkToDeath(recipient);
+        }
+        mClients.erase(client);
+    }
+    *entry = std::move(slot.entry);
+    releaseSlot(index);
+    return NO_ERROR;
+}
+
+std::vector<WakeLockTokenTable::Entry> WakeLockTokenTable::releaseClient(const IBinder* client) {
+    std::scoped_lock lock(mLock);
+
+    std::vector<Entry> entries;
+    if (mClients.erase(client) == 0) {
+        return entries;
+    }
+    for (uint32_t index = 0; index < mSlots.size(); index++) {
+        if (mSlots[index].client == client) {
+            entries.push_back(std::move(mSlots[index].entry));
+            releaseSlot(index);
+        }
+    }
+    return entries;
+}
+
+size_t WakeLockTokenTable::size() const {
+    std::scoped_lock lock(mLock);
+    return mSlots.size() - mFreeSlots.size();
+}
+
+void WakeLockTokenTable::releaseSlot(uint32_t index) {
+    Slot& slot = mSlots[index];
+    slot.client = nullptr;
+    slot.generation = slot.generation == kMaxGeneration ? 1 : slot.generation + 1;
+    mFreeSlots.push_back(index);
+}
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
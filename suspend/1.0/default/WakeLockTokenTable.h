@@ -0,0 +1,95 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <binder/IBinder.h>
+#include <sys/types.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WakeLockEventQueue.h"
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * WakeLockTokenTable keeps track of the wake locks acquired with
+ * ISuspendControlServiceInternal::acquireWakeLockToken().
+ *
+ * Wake locks are stored in a table of slots, which are reused once released. A token is made of
+ * the slot index in its lower 32 bits and of the slot generation, bumped on every reuse, in its
+ * upper 32 bits, so that a stale token can't release another wake lock held in the same slot.
+ * Tokens are guessable though, so a wake lock can only be released by the uid that acquired it.
+ * Each wake lock belongs to a client binder, whose wake locks can all be released at once when it
+ * dies. The table links to the death of a client with its first wake lock and unlinks with its
+ * last, under the same lock as the table updates, so that links match the clients held.
+ * This class is thread safe.
+ */
+class WakeLockTokenTable {
+   public:
+    struct Entry {
+        std::string name;
+        int pid = 0;
+        uid_t uid = 0;
+        WakeLockStatsKey statsKey;
+    };
+
+    // Sets *token to the token of the new wake lock. If client doesn't hold any wake lock yet and
+    // is remote, links recipient to its death. Returns the linking error, if any, in which case no
+    // wake lock is acquired.
+    status_t acquire(const sp<IBinder>& client, const sp<IBinder::DeathRecipient>& recipient,
+                     Entry entry, int64_t* token);
+    // Returns BAD_VALUE if token doesn't refer to a held wake lock, and PERMISSION_DENIED if it was
+    // acquired by another uid. Otherwise, sets *entry to the released wake lock and, if it was the
+    // last one held by its client, unlinks recipient from the death of the client.
+    status_t release(int64_t token, uid_t uid, const sp<IBinder::DeathRecipient>& recipient,
+                     Entry* entry);
+    // Releases all the wake locks held by client.
+    std::vector<Entry> releaseClient(const IBinder* client);
+    size_t size() const;
+
+   private:
+    struct Slot {
+        Entry entry;
+        const IBinder* client = nullptr;
+        uint32_t generation = 0;
+    };
+
+    struct Client {
+        sp<IBinder> binder;
+        size_t numWakeLocks = 0;
+    };
+
+    void releaseSlot(uint32_t index) REQUIRES(mLock);
+
+    mutable std::mutex mLock;
+    std::vector<Slot> mSlots GUARDED_BY(mLock);
+    std::vector<uint32_t> mFreeSlots GUARDED_BY(mLock);
+    std::unordered_map<const IBinder*, Client> mClients GUARDED_BY(mLock);
+};
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
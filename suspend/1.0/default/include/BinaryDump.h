@@ -0,0 +1,85 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace system {
+namespace suspend {
+namespace V1_0 {
+
+/*
+ * Stats printed by "dumpsys suspend_control_internal --binary", as plain structs so that dumps
+ * can be decoded on the host without the AIDL types.
+ *
+ * The format starts with kBinaryDumpMagic and a version, followed by sections, each a tag, a
+ * length and a payload. Decoders skip the sections they don't know. Integers are varints, signed
+ * ones zigzag encoded. Strings are stored once in a leading section and referred to by index.
+ * The integer stats of wake locks and wakeups are stored as differences from the previous entry.
+ */
+struct DumpedWakeLock {
+    std::string name;
+    bool isKernelWakelock = false;
+    bool isActive = false;
+    int32_t pid = 0;
+    int64_t activeCount = 0;
+    int64_t lastChange = 0;
+    int64_t maxTime = 0;
+    int64_t totalTime = 0;
+    int64_t activeTime = 0;
+    int64_t eventCount = 0;
+    int64_t expireCount = 0;
+    int64_t preventSuspendTime = 0;
+    int64_t wakeupCount = 0;
+};
+
+struct DumpedWakeup {
+    std::string name;
+    int64_t count = 0;
+};
+
+// A named stat of the kernel suspend stats and suspend info sections, holding an integer or a
+// string.
+struct DumpedStat {
+    std::string name;
+    bool isString = false;
+    int64_t value = 0;
+    std::string stringValue;
+};
+
+struct BinaryDump {
+    std::vector<DumpedWakeLock> wakeLocks;
+    std::vector<DumpedWakeup> wakeups;
+    std::vector<DumpedStat> kernelSuspendStats;
+    std::vector<DumpedStat> suspendInfo;
+};
+
+constexpr std::string_view kBinaryDumpMagic = "SSBD";
+constexpr uint64_t kBinaryDumpVersion = 1;
+
+std::string encodeBinaryDump(const BinaryDump& dump);
+// Returns false if data is not a binary dump or is truncated.
+bool decodeBinaryDump(std::string_view data, BinaryDump* dump);
+
+}  // namespace V1_0
+}  // namespace suspend
+}  // namespace system
+}  // namespace android
@@ -38,7 +38,9 @@ using android::base::Socketpair;
 using android::base::unique_fd;
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
+using android::system::suspend::V1_0::BackoffPolicyType;
 using android::system::suspend::V1_0::ISystemSuspend;
+using android::system::suspend::V1_0::kDefaultSleepTimeConfig;
 using android::system::suspend::V1_0::SleepTimeConfig;
 using android::system::suspend::V1_0::SuspendControlService;
 using android::system::suspend::V1_0::SuspendControlServiceInternal;
@@ -55,13 +57,24 @@ static constexpr char kSysPowerState[] = "/sys/power/state";
 static constexpr char kSysKernelWakeupReasons[] = "/sys/kernel/wakeup_reasons/last_resume_reason";
 static constexpr char kSysKernelSuspendTime[] = "/sys/kernel/wakeup_reasons/last_suspend_time";
 
-static constexpr uint32_t kDefaultMaxSleepTimeMillis = 60000;
-static constexpr uint32_t kDefaultBaseSleepTimeMillis = 100;
-static constexpr double kDefaultSleepTimeScaleFactor = 2.0;
-static constexpr uint32_t kDefaultBackoffThresholdCount = 0;
-static constexpr uint32_t kDefaultShortSuspendThresholdMillis = 0;
-static constexpr bool kDefaultFailedSuspendBackoffEnabled = true;
-static constexpr bool kDefaultShortSuspendBackoffEnabled = false;
+static constexpr uint32_t kDefaultKernelWakelockRefreshMillis = 0;
+
+// Values other than the enum_values of the property read as unset.
+static BackoffPolicyType getBackoffPolicyProperty() {
+    const auto policy = SuspendProperties::backoff_policy();
+    if (!policy) {
+        return kDefaultSleepTimeConfig.backoffPolicy;
+    }
+    switch (*policy) {
+        case SuspendProperties::backoff_policy_values::EXPONENTIAL:
+            return BackoffPolicyType::EXPONENTIAL;
+        case SuspendProperties::backoff_policy_values::EWMA:
+            return BackoffPolicyType::EWMA;
+        case SuspendProperties::backoff_policy_values::WAKEUP_REASON:
+            return BackoffPolicyType::WAKEUP_REASON;
+    }
+    return kDefaultSleepTimeConfig.backoffPolicy;
+}
 
 int main() {
     unique_fd wakeupCountFd{TEMP_FAILURE_RETRY(open(kSysPowerWakeupCount, O_CLOEXEC | O_RDWR))};
@@ -102,22 +115,27 @@ int main() {
         Socketpair(SOCK_STREAM, &wakeupCountFd, &stateFd);
     }
 
+    const SleepTimeConfig& defaults = kDefaultSleepTimeConfig;
     SleepTimeConfig sleepTimeConfig = {
         .baseSleepTime = std::chrono::milliseconds(
-            SuspendProperties::base_sleep_time_millis().value_or(kDefaultBaseSleepTimeMillis)),
+            SuspendProperties::base_sleep_time_millis().value_or(defaults.baseSleepTime.count())),
         .maxSleepTime = std::chrono::milliseconds(
-            SuspendProperties::max_sleep_time_millis().value_or(kDefaultMaxSleepTimeMillis)),
+            SuspendProperties::max_sleep_time_millis().value_or(defaults.maxSleepTime.count())),
         .sleepTimeScaleFactor =
-            SuspendProperties::sleep_time_scale_factor().value_or(kDefaultSleepTimeScaleFactor),
+            SuspendProperties::sleep_time_scale_factor().value_or(defaults.sleepTimeScaleFactor),
         .backoffThreshold =
-            SuspendProperties::backoff_threshold_count().value_or(kDefaultBackoffThresholdCount),
+            SuspendProperties::backoff_threshold_count().value_or(defaults.backoffThreshold),
         .shortSuspendThreshold =
             std::chrono::milliseconds(SuspendProperties::short_suspend_threshold_millis().value_or(
-                kDefaultShortSuspendThresholdMillis)),
+                defaults.shortSuspendThreshold.count())),
         .failedSuspendBackoffEnabled = SuspendProperties::failed_suspend_backoff_enabled().value_or(
-            kDefaultFailedSuspendBackoffEnabled),
+            defaults.failedSuspendBackoffEnabled),
         .shortSuspendBackoffEnabled = SuspendProperties::short_suspend_backoff_enabled().value_or(
-            kDefaultShortSuspendBackoffEnabled),
+            defaults.shortSuspendBackoffEnabled),
+        .eventDrivenAutosuspendEnabled =
+            SuspendProperties::event_driven_autosuspend_enabled().value_or(
+                defaults.eventDrivenAutosuspendEnabled),
+        .backoffPolicy = getBackoffPolicyProperty(),
     };
 
     configureRpcThreadpool(1, true /* callerWillJoin */);
@@ -143,7 +161,9 @@ int main() {
     sp<SystemSuspend> suspend = new SystemSuspend(
         std::move(wakeupCountFd), std::move(stateFd), std::move(suspendStatsFd), kStatsCapacity,
         std::move(kernelWakelockStatsFd), std::move(wakeupReasonsFd), std::move(suspendTimeFd),
-        sleepTimeConfig, suspendControl, suspendControlInternal, true /* mUseSuspendCounter*/);
+        sleepTimeConfig, suspendControl, suspendControlInternal, true /* mUseSuspendCounter*/,
+        std::chrono::milliseconds(SuspendProperties::kernel_wakelock_refresh_millis().value_or(
+            kDefaultKernelWakelockRefreshMillis)));
 
     status_t status = suspend->registerAsService();
     if (android::OK != status) {